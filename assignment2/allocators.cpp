@@ -0,0 +1,202 @@
+#include "allocators.h"
+#include "logger.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<size_t> totalAllocations(0);
+
+static void countAllocation() {
+    totalAllocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void* countedAllocate(size_t size) {
+    countAllocation();
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+// Blocks from here must be freed with alignedFree()
+static void* countedAllocate(size_t size, size_t alignment) {
+    countAllocation();
+#ifdef _WIN32
+    void* p = _aligned_malloc(size ? size : 1, alignment);
+#else
+    void* p = nullptr;
+    if (posix_memalign(&p, std::max(alignment, sizeof(void*)), size ? size : 1) != 0) p = nullptr;
+#endif
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+static void alignedFree(void* p) {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+// Replacing the global allocation functions counts every heap allocation,
+// including the ones made inside the standard library
+void* operator new(size_t size) { return countedAllocate(size); }
+void* operator new[](size_t size) { return countedAllocate(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return countedAllocate(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept { return operator new(size, tag); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { free(p); }
+
+// Over-aligned types (alignas beyond max_align_t) come through these
+void* operator new(size_t size, std::align_val_t alignment) { return countedAllocate(size, (size_t)alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return countedAllocate(size, (size_t)alignment); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    try {
+        return countedAllocate(size, (size_t)alignment);
+    } catch (...) {
+        return nullptr;
+    }
+}
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t& tag) noexcept {
+    return operator new(size, alignment, tag);
+}
+void operator delete(void* p, std::align_val_t) noexcept { alignedFree(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { alignedFree(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { alignedFree(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { alignedFree(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { alignedFree(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { alignedFree(p); }
+
+size_t allocationCount() {
+    return totalAllocations.load(std::memory_order_relaxed);
+}
+
+FrameAllocationStats::FrameAllocationStats(unsigned warmup)
+    : warmupFrames(warmup), frames(0), framesWithAllocations(0), frameStart(0), steadyAllocations(0) {
+}
+
+void FrameAllocationStats::beginFrame() {
+    frameStart = allocationCount();
+}
+
+void FrameAllocationStats::endFrame() {
+    frames++;
+    if (frames <= warmupFrames) return;
+    size_t count = allocationCount() - frameStart;
+    if (count > 0) {
+        framesWithAllocations++;
+        steadyAllocations += count;
+    }
+}
+
+void FrameAllocationStats::logSummary() const {
+    if (frames <= warmupFrames) return;
+    logInfo("Heap allocations on all threads after %u warm-up frames: %zu in %u of %u frames",
+            warmupFrames, steadyAllocations, framesWithAllocations, frames - warmupFrames);
+}
+
+// The buffers and overflow blocks come from countedAllocate(), so frames on
+// which the arena still grows or overflows show up in FrameAllocationStats
+FrameArena::FrameArena(size_t initialCapacity) : current(0) {
+    for (Buffer& buffer : buffers) {
+        buffer.data = initialCapacity ? (char*)countedAllocate(initialCapacity) : nullptr;
+        buffer.capacity = initialCapacity;
+        buffer.overflow.reserve(16);
+    }
+}
+
+FrameArena::~FrameArena() {
+    for (Buffer& buffer : buffers) {
+        reset(buffer);
+        free(buffer.data);
+    }
+}
+
+void FrameArena::reset(Buffer& buffer) {
+    for (void* block : buffer.overflow) alignedFree(block);
+    buffer.overflow.clear();
+
+    // Grow to what the last frame on this buffer needed, so the next one fits
+    if (buffer.requested > buffer.capacity) {
+        size_t capacity = buffer.capacity ? buffer.capacity : 4096;
+        while (capacity < buffer.requested) capacity *= 2;
+        free(buffer.data);
+        buffer.data = nullptr; // left empty if the allocation below throws
+        buffer.capacity = 0;
+        buffer.data = (char*)countedAllocate(capacity);
+        buffer.capacity = capacity;
+    }
+    buffer.used = 0;
+    buffer.requested = 0;
+}
+
+void FrameArena::beginFrame() {
+    current ^= 1;
+    reset(buffers[current]);
+}
+
+void* FrameArena::allocate(size_t bytes, size_t alignment) {
+    Buffer& buffer = buffers[current];
+    // Aligns the address, not the offset: the buffer itself is only aligned
+    // for max_align_t
+    uintptr_t base = (uintptr_t)buffer.data;
+    size_t offset = ((base + buffer.used + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+    // Once something overflowed, where this would land in one big buffer is
+    // unknown, so count the most padding it could need
+    bool overflowed = buffer.requested > buffer.used;
+    buffer.requested = (overflowed ? buffer.requested + alignment - 1 : offset) + bytes;
+    if (buffer.data && offset + bytes <= buffer.capacity) {
+        buffer.used = offset + bytes;
+        return buffer.data + offset;
+    }
+
+    // Does not fit this frame; the buffer grows when it is next reused
+    void* block = countedAllocate(bytes, alignment);
+    buffer.overflow.push_back(block);
+    return block;
+}
+
+PoolAllocator::PoolAllocator(size_t blockSize, size_t chunkBlocks)
+    : blocksPerChunk(chunkBlocks ? chunkBlocks : 1), freeList(nullptr) {
+    // Every block can hold a free-list link and keeps the chunk's alignment
+    const size_t align = alignof(std::max_align_t);
+    size = std::max(blockSize, sizeof(FreeBlock));
+    size = (size + align - 1) & ~(align - 1);
+}
+
+PoolAllocator::~PoolAllocator() {
+    for (void* chunk : chunks) ::operator delete(chunk);
+}
+
+void* PoolAllocator::allocate() {
+    if (!freeList) {
+        char* chunk = (char*)::operator new(size * blocksPerChunk);
+        chunks.push_back(chunk);
+        for (size_t i = blocksPerChunk; i-- > 0;) {
+            FreeBlock* block = (FreeBlock*)(chunk + i * size);
+            block->next = freeList;
+            freeList = block;
+        }
+    }
+    FreeBlock* block = freeList;
+    freeList = block->next;
+    return block;
+}
+
+void PoolAllocator::deallocate(void* p) {
+    if (!p) return;
+    FreeBlock* block = (FreeBlock*)p;
+    block->next = freeList;
+    freeList = block;
+}
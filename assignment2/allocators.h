@@ -0,0 +1,132 @@
+#ifndef ALLOCATORS_H
+#define ALLOCATORS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Heap allocations of the whole process, counted by the global operator new
+// in allocators.cpp (all its forms) and by FrameArena's own buffers
+size_t allocationCount();
+
+// Counts heap allocations per frame once the first frames (window creation,
+// caches filling up) are over. All threads count, as frames are partly
+// recorded on the job workers.
+class FrameAllocationStats {
+public:
+    explicit FrameAllocationStats(unsigned warmupFrames = 120);
+    void beginFrame();
+    void endFrame();
+    void logSummary() const;
+
+private:
+    unsigned warmupFrames;
+    unsigned frames;
+    unsigned framesWithAllocations;
+    size_t frameStart;
+    size_t steadyAllocations;
+};
+
+// Bump allocator for data that lives for one frame (vertex batches, draw
+// lists). Two buffers are used in turn, so data written in one frame stays
+// valid while the GPU reads it during the next. Allocations that do not fit
+// go to the heap and the buffer grows to the peak size when it is reused, so
+// after a few frames nothing touches the heap.
+class FrameArena {
+public:
+    explicit FrameArena(size_t initialCapacity = 1 << 20);
+    ~FrameArena();
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    // Switches buffers; everything allocated two frames ago is released
+    void beginFrame();
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+    size_t used() const { return buffers[current].used; }
+
+private:
+    struct Buffer {
+        char* data = nullptr;
+        size_t capacity = 0;
+        size_t used = 0;
+        size_t requested = 0;        // bytes asked for, including overflow
+        std::vector<void*> overflow; // heap blocks to free on reuse
+    };
+
+    Buffer buffers[2];
+    int current;
+
+    void reset(Buffer& buffer);
+};
+
+// STL allocator on a FrameArena; deallocate is a no-op. Containers using it
+// must not outlive the frame.
+template <typename T> class ArenaAllocator {
+public:
+    typedef T value_type;
+
+    explicit ArenaAllocator(FrameArena& arena) : arena(&arena) {}
+    template <typename U> ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t n) { return (T*)arena->allocate(n * sizeof(T), alignof(T)); }
+    void deallocate(T*, size_t) {}
+
+    template <typename U> bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template <typename U> bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+
+    FrameArena* arena;
+};
+
+// Fixed-size blocks carved out of larger chunks and recycled through a free
+// list. Blocks never move, and freeing and reallocating them does not touch
+// the heap. Not thread-safe.
+class PoolAllocator {
+public:
+    explicit PoolAllocator(size_t blockSize, size_t blocksPerChunk = 64);
+    ~PoolAllocator();
+    PoolAllocator(const PoolAllocator&) = delete;
+    PoolAllocator& operator=(const PoolAllocator&) = delete;
+
+    void* allocate();
+    void deallocate(void* block);
+    size_t blockSize() const { return size; }
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    size_t size;
+    size_t blocksPerChunk;
+    FreeBlock* freeList;
+    std::vector<void*> chunks;
+};
+
+// STL allocator on a PoolAllocator for containers that allocate blocks of a
+// fixed size (deque blocks, list and map nodes). Requests larger than a pool
+// block go to the heap.
+template <typename T> class PoolAdapter {
+public:
+    typedef T value_type;
+
+    explicit PoolAdapter(PoolAllocator& pool) : pool(&pool) {}
+    template <typename U> PoolAdapter(const PoolAdapter<U>& other) : pool(other.pool) {}
+
+    T* allocate(size_t n) {
+        if (n * sizeof(T) <= pool->blockSize() && alignof(T) <= alignof(std::max_align_t)) {
+            return (T*)pool->allocate();
+        }
+        return (T*)::operator new(n * sizeof(T));
+    }
+    void deallocate(T* p, size_t n) {
+        if (n * sizeof(T) <= pool->blockSize() && alignof(T) <= alignof(std::max_align_t)) pool->deallocate(p);
+        else ::operator delete(p);
+    }
+
+    template <typename U> bool operator==(const PoolAdapter<U>& other) const { return pool == other.pool; }
+    template <typename U> bool operator!=(const PoolAdapter<U>& other) const { return pool != other.pool; }
+
+    PoolAllocator* pool;
+};
+
+#endif
@@ -0,0 +1,308 @@
+#include "animation_scheduler.h"
+#include "allocators.h"
+#include "jobs.h"
+#include "scene_graph.h"
+#include <algorithm>
+#include <cmath>
+
+const float DEG_TO_RAD = 3.14159265358979323846f / 180.0f;
+const size_t FRAME_BLOCK = 192; // bytes; the animations here need less, larger frames go to the heap
+const size_t TWEENS_PER_JOB = 4096;
+const uint64_t SPIN_TICKS = 3600; // how often a spin resumes; the angles do not depend on it
+
+// Coroutine frames. Animations are spawned and finished on one thread only.
+// Never destroyed, so schedulers with static storage can free their frames at exit.
+static PoolAllocator& framePool() {
+    static PoolAllocator* pool = new PoolAllocator(FRAME_BLOCK);
+    return *pool;
+}
+
+void* AnimationTask::promise_type::operator new(size_t size) {
+    if (size <= FRAME_BLOCK) return framePool().allocate();
+    return ::operator new(size);
+}
+
+void AnimationTask::promise_type::operator delete(void* frame, size_t size) {
+    if (size <= FRAME_BLOCK) framePool().deallocate(frame);
+    else ::operator delete(frame);
+}
+
+TimerWheel::TimerWheel() : current(0), count(0) {
+    for (int level = 0; level < LEVELS; level++) {
+        occupied[level] = 0;
+        for (int slot = 0; slot < SLOTS; slot++) slots[level][slot] = nullptr;
+    }
+}
+
+void TimerWheel::place(AnimationWait* wait) {
+    uint64_t delta = wait->due - current;
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= (uint64_t)1 << (SLOT_BITS * (level + 1))) level++;
+    int slot;
+    if (delta >= (uint64_t)1 << (SLOT_BITS * LEVELS)) {
+        // Beyond the wheel: the last slot of the top level to come round, placed again from there
+        slot = (int)((current >> (SLOT_BITS * level)) - 1) & (SLOTS - 1);
+    } else {
+        slot = (int)(wait->due >> (SLOT_BITS * level)) & (SLOTS - 1);
+    }
+    wait->next = slots[level][slot];
+    slots[level][slot] = wait;
+    occupied[level] |= (uint64_t)1 << slot;
+}
+
+void TimerWheel::insert(AnimationWait* wait, AnimationWait**& dueTail) {
+    if (wait->due <= current) {
+        wait->next = nullptr;
+        *dueTail = wait;
+        dueTail = &wait->next;
+        return;
+    }
+    place(wait);
+    count++;
+}
+
+// Spreads the slot of `level` that starts at the current tick over the levels below
+void TimerWheel::cascade(int level, AnimationWait**& dueTail) {
+    int slot = (int)(current >> (SLOT_BITS * level)) & (SLOTS - 1);
+    AnimationWait* wait = slots[level][slot];
+    slots[level][slot] = nullptr;
+    occupied[level] &= ~((uint64_t)1 << slot);
+    while (wait) {
+        AnimationWait* next = wait->next;
+        if (wait->due <= current) {
+            wait->next = nullptr;
+            *dueTail = wait;
+            dueTail = &wait->next;
+            count--;
+        } else {
+            place(wait);
+        }
+        wait = next;
+    }
+}
+
+void TimerWheel::fire(int slot, AnimationWait**& dueTail) {
+    AnimationWait* wait = slots[0][slot];
+    slots[0][slot] = nullptr;
+    occupied[0] &= ~((uint64_t)1 << slot);
+    while (wait) {
+        AnimationWait* next = wait->next;
+        wait->next = nullptr;
+        *dueTail = wait;
+        dueTail = &wait->next;
+        count--;
+        wait = next;
+    }
+}
+
+void TimerWheel::advance(uint64_t to, AnimationWait**& dueTail) {
+    while (current < to) {
+        if (count == 0) {
+            current = to;
+            break;
+        }
+        if (occupied[0] == 0) {
+            // Nothing fires before level 0 wraps around; jump to the tick before it
+            uint64_t wrap = (current | (SLOTS - 1)) + 1;
+            if (wrap > to) {
+                current = to;
+                break;
+            }
+            current = wrap - 1;
+        }
+        current++;
+        // Top level first, so waits moved down can move further down at the same tick
+        for (int level = LEVELS - 1; level > 0; level--) {
+            if ((current & (((uint64_t)1 << (SLOT_BITS * level)) - 1)) == 0) cascade(level, dueTail);
+        }
+        int slot = (int)current & (SLOTS - 1);
+        if (occupied[0] & ((uint64_t)1 << slot)) fire(slot, dueTail);
+    }
+}
+
+AnimationScheduler::AnimationScheduler(SceneGraph& scene)
+    : scene(scene), ready(nullptr), readyTail(&ready), liveList(nullptr), live(0), resumed(0), nextTweenEnd(UINT64_MAX) {}
+
+AnimationScheduler::~AnimationScheduler() {
+    while (liveList) {
+        AnimationWait* wait = liveList;
+        liveList = wait->liveNext;
+        wait->handle.destroy();
+    }
+}
+
+void AnimationScheduler::reserve(size_t animations, size_t tweenCount) {
+    tweens.reserve(tweens.size() + tweenCount);
+    // Grow the frame pool by allocating the blocks once
+    std::vector<void*> blocks(animations);
+    for (size_t i = 0; i < animations; i++) blocks[i] = framePool().allocate();
+    for (size_t i = 0; i < animations; i++) framePool().deallocate(blocks[i]);
+}
+
+void AnimationScheduler::spawn(AnimationTask task) {
+    AnimationHandle h = task.handle;
+    task.handle = nullptr;
+    AnimationWait& wait = h.promise().wait;
+    wait.handle = h;
+    wait.livePrev = nullptr;
+    wait.liveNext = liveList;
+    if (liveList) liveList->livePrev = &wait;
+    liveList = &wait;
+    live++;
+
+    h.resume();
+    if (h.done()) finish(&wait);
+}
+
+void AnimationScheduler::finish(AnimationWait* wait) {
+    if (wait->livePrev) wait->livePrev->liveNext = wait->liveNext;
+    else liveList = wait->liveNext;
+    if (wait->liveNext) wait->liveNext->livePrev = wait->livePrev;
+    live--;
+    wait->handle.destroy();
+}
+
+void AnimationScheduler::park(AnimationWait& wait, AnimationHandle h, uint64_t ticks) {
+    wait.handle = h;
+    wait.due = wheel.now() + std::max(ticks, (uint64_t)1);
+    wheel.insert(&wait, readyTail);
+}
+
+void AnimationScheduler::makeReady(AnimationWait* wait) {
+    wait->next = nullptr;
+    *readyTail = wait;
+    readyTail = &wait->next;
+}
+
+void AnimationScheduler::resumeReady() {
+    // Animations woken here (events) are appended and resumed in this loop too
+    while (ready) {
+        AnimationWait* wait = ready;
+        ready = wait->next;
+        if (!ready) readyTail = &ready;
+        wait->next = nullptr;
+        resumed++;
+        wait->handle.resume();
+        if (wait->handle.done()) finish(wait);
+    }
+}
+
+// One tick of a stepped tween, the same arithmetic as the per-frame updates it replaces
+static float stepValue(TweenKind kind, float value, float step) {
+    value += step;
+    if (kind == TWEEN_ROTATE_Z) {
+        if (value > 360.0f) value -= 360.0f;
+        if (value < -360.0f) value += 360.0f;
+    }
+    return value;
+}
+
+void AnimationScheduler::setProperty(int node, TweenKind kind, float value, SceneDirtyRange& dirty) {
+    if (kind == TWEEN_SCALE_XY) {
+        scene.setScale(node, value, value, 1.0f, dirty);
+    } else {
+        scene.setRotation(node, quatFromAxisAngle(0.0f, 0.0f, 1.0f, value * DEG_TO_RAD), dirty);
+    }
+}
+
+void AnimationScheduler::applyTween(Tween& tween, uint64_t now, SceneDirtyRange& dirty) {
+    float value;
+    if (tween.stepped) {
+        uint64_t until = std::min(now, tween.end);
+        for (; tween.reached < until; tween.reached++) tween.value = stepValue(tween.kind, tween.value, tween.step);
+        value = tween.value;
+    } else {
+        float t = now >= tween.end ? 1.0f : (float)(now - tween.start) / (float)(tween.end - tween.start);
+        value = tween.from + (tween.to - tween.from) * t;
+    }
+    setProperty(tween.node, tween.kind, value, dirty);
+    if (now >= tween.end) *tween.result = value;
+}
+
+void AnimationScheduler::TweenAwaiter::await_suspend(AnimationHandle h) {
+    uint64_t now = scheduler.wheel.now();
+    Tween tween = {node, kind, stepped, from, to, from, to, now, now + std::max(ticks, (uint64_t)1), now, &reached};
+    SceneDirtyRange dirty;
+    scheduler.setProperty(node, kind, from, dirty);
+    scheduler.scene.markDirty(dirty);
+    scheduler.tweens.push_back(tween);
+    scheduler.nextTweenEnd = std::min(scheduler.nextTweenEnd, tween.end);
+    // Resumed by the timer wheel in the advance() that writes the last value
+    scheduler.park(h.promise().wait, h, tween.end - tween.start);
+}
+
+void AnimationScheduler::updateTweens(JobSystem* jobs) {
+    if (tweens.empty()) return;
+    uint64_t now = wheel.now();
+    Tween* data = tweens.data();
+    auto updateRange = [&](size_t begin, size_t end, SceneDirtyRange& dirty) {
+        for (size_t i = begin; i < end; i++) applyTween(data[i], now, dirty);
+    };
+
+    parallelUpdateDirty(scene, jobs, tweens.size(), TWEENS_PER_JOB, updateRange);
+
+    // Drop the finished tweens, keeping the order (a later tween of the same node wins)
+    if (nextTweenEnd > now) return;
+    nextTweenEnd = UINT64_MAX;
+    size_t kept = 0;
+    for (size_t i = 0; i < tweens.size(); i++) {
+        if (data[i].end <= now) continue;
+        nextTweenEnd = std::min(nextTweenEnd, data[i].end);
+        data[kept++] = data[i];
+    }
+    tweens.resize(kept);
+}
+
+void AnimationScheduler::advance(uint64_t ticks, JobSystem* jobs) {
+    resumed = 0;
+    wheel.advance(wheel.now() + ticks, readyTail);
+    updateTweens(jobs);
+    resumeReady();
+}
+
+void AnimationEvent::signal() {
+    // Waiters were pushed at the front; wake them in the order they started waiting
+    AnimationWait* reversed = nullptr;
+    while (waiting) {
+        AnimationWait* wait = waiting;
+        waiting = wait->next;
+        wait->next = reversed;
+        reversed = wait;
+    }
+    while (reversed) {
+        AnimationWait* wait = reversed;
+        reversed = wait->next;
+        scheduler.makeReady(wait);
+    }
+}
+
+// Ticks of `step` from `value` until it reaches `limit` (from the side it starts on),
+// counting the step that gets there; `value` becomes the value after it
+static uint64_t ticksToReach(float& value, float step, float limit) {
+    uint64_t ticks = 0;
+    bool below = step > 0.0f;
+    do {
+        float next = value + step;
+        if (next == value) return UINT32_MAX; // no progress (a zero or tiny step): effectively never
+        value = next;
+        ticks++;
+    } while (below ? value < limit : value > limit);
+    return ticks;
+}
+
+AnimationTask spinAnimation(AnimationScheduler& scheduler, int node, float degreesPerTick, float startDegrees) {
+    float angle = startDegrees;
+    for (;;) angle = co_await scheduler.steps(node, TWEEN_ROTATE_Z, angle, degreesPerTick, SPIN_TICKS);
+}
+
+AnimationTask breatheAnimation(AnimationScheduler& scheduler, int node, float speed, float minScale, float maxScale,
+                               bool growing) {
+    float scale = scheduler.sceneGraph().scale(node)[0];
+    for (;;) {
+        float step = growing ? speed : -speed;
+        float end = scale;
+        uint64_t ticks = ticksToReach(end, step, growing ? maxScale : minScale);
+        scale = co_await scheduler.steps(node, TWEEN_SCALE_XY, scale, step, ticks);
+        growing = !growing;
+    }
+}
@@ -0,0 +1,251 @@
+#ifndef ANIMATION_SCHEDULER_H
+#define ANIMATION_SCHEDULER_H
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <vector>
+
+class JobSystem;
+class SceneGraph;
+struct SceneDirtyRange;
+
+// Where a suspended animation waits: a timer wheel slot, an event or the
+// ready list. Lives in the coroutine frame, so waiting never allocates.
+struct AnimationWait {
+    AnimationWait* next = nullptr;
+    uint64_t due = 0; // tick to resume at, while in the timer wheel
+    std::coroutine_handle<> handle;
+    AnimationWait* liveNext = nullptr; // every animation the scheduler owns
+    AnimationWait* livePrev = nullptr;
+};
+
+// Return type of animation coroutines. An animation starts when handed to
+// AnimationScheduler::spawn(), which owns it from then on.
+class AnimationTask {
+public:
+    struct promise_type {
+        AnimationWait wait;
+
+        AnimationTask get_return_object() {
+            return AnimationTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+
+        // Frames come from a pool (see AnimationScheduler::reserve)
+        static void* operator new(size_t size);
+        static void operator delete(void* frame, size_t size);
+    };
+
+    AnimationTask(AnimationTask&& other) noexcept : handle(other.handle) { other.handle = nullptr; }
+    AnimationTask(const AnimationTask&) = delete;
+    AnimationTask& operator=(const AnimationTask&) = delete;
+    ~AnimationTask() {
+        if (handle) handle.destroy();
+    }
+
+private:
+    friend class AnimationScheduler;
+    explicit AnimationTask(std::coroutine_handle<promise_type> h) : handle(h) {}
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+typedef std::coroutine_handle<AnimationTask::promise_type> AnimationHandle;
+
+// Hierarchical timer wheel of LEVELS levels with SLOTS slots each; slot i of
+// level l holds the waits due in the i-th block of SLOTS^l ticks (modulo
+// SLOTS). Inserting is constant time. When level 0 wraps around, the next
+// slot of level 1 is spread over level 0, and so on up, so every wait is
+// moved at most LEVELS - 1 times before it is due. Waits further out than the
+// wheel reaches sit in its last level and are placed again when it comes round.
+class TimerWheel {
+public:
+    TimerWheel();
+
+    uint64_t now() const { return current; }
+    size_t size() const { return count; }
+
+    // Waits due now or earlier go straight to `due`
+    void insert(AnimationWait* wait, AnimationWait**& dueTail);
+    // Moves time forward and appends the waits that fell due, in tick order
+    void advance(uint64_t to, AnimationWait**& dueTail);
+
+private:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 6;
+    static const int SLOTS = 1 << SLOT_BITS;
+
+    AnimationWait* slots[LEVELS][SLOTS];
+    uint64_t occupied[LEVELS]; // bit i: slot i is not empty
+    uint64_t current;
+    size_t count;
+
+    void place(AnimationWait* wait);
+    void cascade(int level, AnimationWait**& dueTail);
+    void fire(int slot, AnimationWait**& dueTail);
+};
+
+// Scene graph properties a tween can drive
+enum TweenKind {
+    TWEEN_SCALE_XY, // uniform x and y scale, z stays 1
+    TWEEN_ROTATE_Z  // rotation about z, in degrees
+};
+
+// Runs animations written as coroutines against a tick clock that the demo
+// advances (one tick per frame in main). An animation suspends with
+//
+//     co_await scheduler.delay(ticks);                          // wait
+//     co_await scheduler.tween(node, TWEEN_SCALE_XY, a, b, ticks); // move a node
+//     co_await event;                                           // AnimationEvent
+//
+// Waiting animations are parked in a timer wheel and cost nothing until due.
+// Tweens are the part that changes every frame: they are plain entries in an
+// array, updated in one pass (in parallel with a job system), while the
+// coroutine that started one sleeps in the wheel until its end. A frame
+// therefore costs the running tweens plus the animations that wake up.
+class AnimationScheduler {
+public:
+    explicit AnimationScheduler(SceneGraph& scene);
+    ~AnimationScheduler();
+    AnimationScheduler(const AnimationScheduler&) = delete;
+    AnimationScheduler& operator=(const AnimationScheduler&) = delete;
+
+    // Makes room for this many more animations and running tweens, so that
+    // spawning them later (e.g. from an input callback) does not allocate
+    void reserve(size_t animations, size_t tweenCount);
+    // Takes ownership and runs the animation up to its first wait
+    void spawn(AnimationTask task);
+    // Moves the clock forward: updates the tweens, then resumes every animation
+    // whose wait is over, until none is left to resume at the new time
+    void advance(uint64_t ticks = 1, JobSystem* jobs = nullptr);
+    uint64_t now() const { return wheel.now(); }
+    SceneGraph& sceneGraph() { return scene; }
+
+    size_t animationCount() const { return live; }
+    size_t tweenCount() const { return tweens.size(); }
+    size_t resumedLastAdvance() const { return resumed; }
+    // Calls f(node, kind, value, step) for every running tween with the value
+    // it has now and its change per tick, e.g. to save where animations are
+    template <typename Func> void forEachTween(Func f) const;
+
+    struct DelayAwaiter {
+        AnimationScheduler& scheduler;
+        uint64_t ticks;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(AnimationHandle h) { scheduler.park(h.promise().wait, h, ticks); }
+        void await_resume() const noexcept {}
+    };
+    struct TweenAwaiter {
+        AnimationScheduler& scheduler;
+        int node;
+        TweenKind kind;
+        bool stepped;
+        float from, to; // `to` is the step per tick when stepped
+        uint64_t ticks;
+        float reached;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(AnimationHandle h);
+        float await_resume() const noexcept { return reached; }
+    };
+
+    // Resumes after at least one tick, so a loop of delays always yields
+    DelayAwaiter delay(uint64_t ticks) { return DelayAwaiter{*this, ticks}; }
+    // Moves the node's property from `from` to `to` linearly over `ticks`
+    // (at least one), and resumes once it has arrived, with the last value
+    TweenAwaiter tween(int node, TweenKind kind, float from, float to, uint64_t ticks) {
+        return TweenAwaiter{*this, node, kind, false, from, to, ticks, to};
+    }
+    // Sets the node's property to `from` and adds `step` every tick for `ticks`
+    // ticks (at least one), as a per-frame update would, so the values match it
+    // and the GPU circles exactly. Rotations go back a turn past +-360 degrees.
+    // Resumes with the last value.
+    TweenAwaiter steps(int node, TweenKind kind, float from, float step, uint64_t ticks) {
+        return TweenAwaiter{*this, node, kind, true, from, step, ticks, from};
+    }
+
+private:
+    friend class AnimationEvent;
+
+    struct Tween {
+        int node;
+        TweenKind kind;
+        bool stepped;
+        float from, to;    // linear tweens
+        float value, step; // stepped tweens: the value at tick `reached`
+        uint64_t start, end, reached;
+        float* result;     // the awaiter's, gets the last value
+    };
+
+    SceneGraph& scene;
+    TimerWheel wheel;
+    AnimationWait* ready;       // resume in order
+    AnimationWait** readyTail;
+    AnimationWait* liveList;
+    size_t live, resumed;
+    std::vector<Tween> tweens;
+    uint64_t nextTweenEnd; // earliest end of a running tween
+
+    void park(AnimationWait& wait, AnimationHandle h, uint64_t ticks);
+    void makeReady(AnimationWait* wait);
+    void resumeReady();
+    void updateTweens(JobSystem* jobs);
+    void finish(AnimationWait* wait);
+    void applyTween(Tween& tween, uint64_t now, SceneDirtyRange& dirty);
+    void setProperty(int node, TweenKind kind, float value, SceneDirtyRange& dirty);
+};
+
+template <typename Func> void AnimationScheduler::forEachTween(Func f) const {
+    uint64_t now = wheel.now();
+    for (const Tween& tween : tweens) {
+        if (tween.stepped) {
+            f(tween.node, tween.kind, tween.value, tween.step);
+        } else {
+            float t = now >= tween.end ? 1.0f : (float)(now - tween.start) / (float)(tween.end - tween.start);
+            f(tween.node, tween.kind, tween.from + (tween.to - tween.from) * t,
+              (tween.to - tween.from) / (float)(tween.end - tween.start));
+        }
+    }
+}
+
+// Something animations can wait for. signal() wakes every animation waiting
+// at the time; they run in the scheduler's next advance(), or in the current
+// one when signaled from an animation. Must outlive its waiting animations.
+class AnimationEvent {
+public:
+    explicit AnimationEvent(AnimationScheduler& scheduler) : scheduler(scheduler), waiting(nullptr) {}
+
+    struct Awaiter {
+        AnimationEvent& event;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(AnimationHandle h) {
+            h.promise().wait.handle = h;
+            h.promise().wait.next = event.waiting;
+            event.waiting = &h.promise().wait;
+        }
+        void await_resume() const noexcept {}
+    };
+    Awaiter operator co_await() { return Awaiter{*this}; }
+
+    void signal();
+
+private:
+    AnimationScheduler& scheduler;
+    AnimationWait* waiting;
+};
+
+// Spins a node about z forever by degreesPerTick every tick, starting at
+// startDegrees
+AnimationTask spinAnimation(AnimationScheduler& scheduler, int node, float degreesPerTick, float startDegrees = 0.0f);
+// Swings a node's scale between minScale and maxScale forever, changing it by
+// `speed` per tick; first from the current scale towards maxScale, or towards
+// minScale when not growing. It turns on the first step that reaches a limit,
+// so it may overshoot by up to a step, like the GPU circles.
+AnimationTask breatheAnimation(AnimationScheduler& scheduler, int node, float speed, float minScale, float maxScale,
+                               bool growing = true);
+
+#endif
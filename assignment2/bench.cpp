@@ -0,0 +1,145 @@
+#include "bench.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <thread>
+
+#if !defined(__GNUC__)
+// An opaque store the optimizer has to assume is read
+static const void* volatile benchSink;
+void benchEscape(const void* p) {
+    benchSink = p;
+}
+#endif
+
+BenchState::BenchState(size_t size, size_t count)
+    : problemSize(size), iterations(count), remaining(count), itemsPerIteration(0) {
+}
+
+bool BenchState::keepRunning() {
+    if (remaining == iterations) start = Clock::now();
+    if (remaining == 0) {
+        stop = Clock::now();
+        return false;
+    }
+    remaining--;
+    return true;
+}
+
+BenchRunner::BenchRunner() : minTime(0.2), repetitions(3) {
+}
+
+void BenchRunner::add(const char* name, BenchFunc func, std::initializer_list<size_t> sizes) {
+    for (size_t size : sizes) {
+        Case c = {std::string(name) + "/" + std::to_string(size), func, size};
+        cases.push_back(c);
+    }
+}
+
+bool BenchRunner::parseArguments(int argc, char** argv) {
+    executable = argv[0];
+    bool ok = true;
+    for (int i = 1; i < argc && ok; i++) {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) filter = argv[++i];
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) outputPath = argv[++i];
+        else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) minTime = atof(argv[++i]);
+        else if (strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc) repetitions = std::max(1, atoi(argv[++i]));
+        else ok = false;
+    }
+    if (!ok) {
+        fprintf(stderr, "Usage: %s [--filter <substring>] [--out <file.json>] [--min-time <seconds>] [--repetitions <n>]\n",
+                argv[0]);
+    }
+    return ok;
+}
+
+BenchRunner::Result BenchRunner::run(const Case& c) const {
+    // Grow the iteration count until one run is long enough to time
+    size_t iterations = 1;
+    double seconds = 0.0;
+    size_t items = 0;
+    for (;;) {
+        BenchState state(c.size, iterations);
+        c.func(state);
+        seconds = std::chrono::duration<double>(state.stop - state.start).count();
+        items = state.itemsPerIteration;
+        if (seconds >= minTime || iterations >= ((size_t)1 << 40)) break;
+        double scale = seconds > 0.0 ? 1.4 * minTime / seconds : 100.0;
+        iterations = (size_t)(iterations * std::min(100.0, std::max(2.0, scale)));
+    }
+
+    std::vector<double> perIteration(1, seconds / iterations);
+    for (int r = 1; r < repetitions; r++) {
+        BenchState state(c.size, iterations);
+        c.func(state);
+        perIteration.push_back(std::chrono::duration<double>(state.stop - state.start).count() / iterations);
+    }
+    std::sort(perIteration.begin(), perIteration.end());
+    double median = perIteration[perIteration.size() / 2];
+
+    Result result = {c.name, iterations, median * 1e9, items && median > 0.0 ? items / median : 0.0};
+    return result;
+}
+
+int BenchRunner::runAll() {
+    fprintf(stderr, "%-40s %14s %14s %16s\n", "Benchmark", "Time (ns)", "Iterations", "Items/s");
+    for (const Case& c : cases) {
+        if (!filter.empty() && c.name.find(filter) == std::string::npos) continue;
+        Result result = run(c);
+        fprintf(stderr, "%-40s %14.1f %14zu %16.4g\n", result.name.c_str(), result.nanoseconds, result.iterations,
+                result.itemsPerSecond);
+        results.push_back(result);
+    }
+    if (!outputPath.empty() && !writeJson(outputPath.c_str(), executable.c_str())) return 1;
+    return 0;
+}
+
+// Benchmark names and paths are plain ASCII; quotes and backslashes still get escaped
+static void writeJsonString(FILE* file, const char* s) {
+    fputc('"', file);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fputc('\\', file);
+        fputc(*s, file);
+    }
+    fputc('"', file);
+}
+
+bool BenchRunner::writeJson(const char* path, const char* executablePath) const {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "Cannot write %s\n", path);
+        return false;
+    }
+
+    char date[64];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+#ifdef NDEBUG
+    const char* buildType = "release";
+#else
+    const char* buildType = "debug";
+#endif
+
+    fprintf(file, "{\n  \"context\": {\n    \"date\": \"%s\",\n    \"executable\": ", date);
+    writeJsonString(file, executablePath);
+    fprintf(file, ",\n    \"num_cpus\": %u,\n    \"library_build_type\": \"%s\"\n  },\n  \"benchmarks\": [",
+            std::thread::hardware_concurrency(), buildType);
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        fprintf(file, "%s\n    {\n      \"name\": ", i ? "," : "");
+        writeJsonString(file, r.name.c_str());
+        fprintf(file, ",\n      \"run_type\": \"iteration\",\n      \"iterations\": %zu,\n", r.iterations);
+        // Only wall time is measured; cpu_time repeats it for tools that expect the field
+        fprintf(file, "      \"real_time\": %.3f,\n      \"cpu_time\": %.3f,\n      \"time_unit\": \"ns\"",
+                r.nanoseconds, r.nanoseconds);
+        if (r.itemsPerSecond > 0.0) fprintf(file, ",\n      \"items_per_second\": %.6g", r.itemsPerSecond);
+        fprintf(file, "\n    }");
+    }
+    fprintf(file, "\n  ]\n}\n");
+    bool ok = ferror(file) == 0;
+    ok = fclose(file) == 0 && ok;
+    if (!ok) fprintf(stderr, "Cannot write %s\n", path);
+    return ok;
+}
@@ -0,0 +1,93 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <chrono>
+#include <cstddef>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+// Small self-contained benchmark harness, so the benchmarks build offline.
+// A benchmark does its setup, then times its loop body with
+//
+//     while (state.keepRunning()) { ... }
+//
+// The harness raises the iteration count until a run takes at least the
+// minimum time, repeats the run and reports the median. Results print as a
+// table and can be written as JSON in the layout Google Benchmark uses, so
+// its compare.py can diff two runs.
+class BenchState {
+public:
+    BenchState(size_t size, size_t iterations);
+
+    size_t size() const { return problemSize; }
+    bool keepRunning();
+    // Items handled per iteration (matrices, circles, ...), for items_per_second
+    void setItemsPerIteration(size_t items) { itemsPerIteration = items; }
+
+private:
+    friend class BenchRunner;
+    typedef std::chrono::steady_clock Clock;
+
+    size_t problemSize;
+    size_t iterations, remaining;
+    size_t itemsPerIteration;
+    Clock::time_point start, stop;
+};
+
+typedef void (*BenchFunc)(BenchState& state);
+
+class BenchRunner {
+public:
+    BenchRunner();
+
+    // Runs func once per size as "name/size"
+    void add(const char* name, BenchFunc func, std::initializer_list<size_t> sizes);
+    // --filter <substring>, --out <file.json>, --min-time <seconds>, --repetitions <n>
+    bool parseArguments(int argc, char** argv);
+    int runAll();
+
+private:
+    struct Case {
+        std::string name;
+        BenchFunc func;
+        size_t size;
+    };
+    struct Result {
+        std::string name;
+        size_t iterations;
+        double nanoseconds; // per iteration, median of the repetitions
+        double itemsPerSecond;
+    };
+
+    std::vector<Case> cases;
+    std::vector<Result> results;
+    std::string executable;
+    std::string filter;
+    std::string outputPath;
+    double minTime;
+    int repetitions;
+
+    Result run(const Case& c) const;
+    bool writeJson(const char* path, const char* executable) const;
+};
+
+// Keeps the compiler from dropping a computation whose result is unused
+#if defined(__GNUC__)
+template <typename T> inline void doNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+inline void clobberMemory() {
+    asm volatile("" : : : "memory");
+}
+#else
+void benchEscape(const void* p);
+template <typename T> inline void doNotOptimize(const T& value) {
+    benchEscape(&value);
+}
+inline void clobberMemory() {
+    benchEscape(nullptr);
+}
+#endif
+
+#endif
@@ -0,0 +1,383 @@
+// Microbenchmarks for the math, animation and batching code shared by the
+// demos. Build in release mode and compare runs with, for example:
+//   benchmarks --out before.json ... benchmarks --out after.json
+//   compare.py benchmarks before.json after.json   (from Google Benchmark's tools)
+#include "animation_scheduler.h"
+#include "bench.h"
+#include "bvh.h"
+#include "circles.h"
+#include "command_list.h"
+#include "ecs.h"
+#include "jobs.h"
+#include "logger.h"
+#include "matrix.h"
+#include "quaternion.h"
+#include "render_queue.h"
+#include "scene_graph.h"
+#include "soft_raster.h"
+#include <algorithm>
+#include <vector>
+
+static JobSystem jobs;
+
+// Matrices with distinct, non-trivial contents
+static std::vector<float> makeMatrices(size_t count) {
+    std::vector<float> matrices(count * 16);
+    for (size_t i = 0; i < matrices.size(); i++) matrices[i] = 0.001f * (float)(i % 97) - 0.05f;
+    return matrices;
+}
+
+static void benchMultiplyMatrix(BenchState& state) {
+    size_t n = state.size();
+    std::vector<float> a = makeMatrices(n), b = makeMatrices(n + 1), result(n * 16);
+    while (state.keepRunning()) {
+        for (size_t i = 0; i < n; i++) multiplyMatrix(&result[i * 16], &a[i * 16], &b[i * 16 + 16]);
+        clobberMemory();
+    }
+    state.setItemsPerIteration(n);
+}
+
+static void benchRotateZMatrix(BenchState& state) {
+    size_t n = state.size();
+    std::vector<float> result(n * 16);
+    while (state.keepRunning()) {
+        for (size_t i = 0; i < n; i++) rotateZMatrix(&result[i * 16], 0.001f * i);
+        clobberMemory();
+    }
+    state.setItemsPerIteration(n);
+}
+
+// Scale, rotation and translation chained through multiplyMatrix, as before the scene graph
+static void benchEulerTransformChain(BenchState& state) {
+    size_t n = state.size();
+    std::vector<float> result(n * 16);
+    float scale[16], rx[16], ry[16], rz[16], translate[16], t0[16], t1[16], t2[16];
+    while (state.keepRunning()) {
+        for (size_t i = 0; i < n; i++) {
+            float angle = 0.001f * i;
+            scaleMatrix(scale, 1.5f, 1.5f, 1.0f);
+            rotateXMatrix(rx, angle);
+            rotateYMatrix(ry, angle);
+            rotateZMatrix(rz, angle);
+            translateMatrix(translate, 0.1f, 0.2f, 0.0f);
+            multiplyMatrix(t0, rx, scale);
+            multiplyMatrix(t1, ry, t0);
+            multiplyMatrix(t2, rz, t1);
+            multiplyMatrix(&result[i * 16], translate, t2);
+        }
+        clobberMemory();
+    }
+    state.setItemsPerIteration(n);
+}
+
+// The scene graph's path for the same transform
+static void benchQuaternionCompose(BenchState& state) {
+    size_t n = state.size();
+    std::vector<float> result(n * 16);
+    const float translation[3] = {0.1f, 0.2f, 0.0f};
+    const float scale[3] = {1.5f, 1.5f, 1.0f};
+    while (state.keepRunning()) {
+        for (size_t i = 0; i < n; i++) {
+            float angle = 0.001f * i;
+            composeTransform(&result[i * 16], translation, quatFromEuler(angle, angle, angle), scale);
+        }
+        clobberMemory();
+    }
+    state.setItemsPerIteration(n);
+}
+
+static void benchQuatSlerp(BenchState& state) {
+    size_t n = state.size();
+    Quat from = quatFromEuler(0.1f, 0.2f, 0.3f), to = quatFromEuler(1.0f, -0.5f, 2.0f);
+    std::vector<Quat> result(n);
+    while (state.keepRunning()) {
+        for (size_t i = 0; i < n; i++) result[i] = quatSlerp(from, to, (float)i / n);
+        clobberMemory();
+    }
+    state.setItemsPerIteration(n);
+}
+
+// Breathing circles as main.cpp creates them, under one window node
+static void createBreathingCircles(EntityWorld& world, SceneGraph& scene, AnimationScheduler& animations,
+                                   size_t count) {
+    ComponentMask mask = MaskOf<Transform, Color, Renderable>::value;
+    world.reserve(mask, count);
+    scene.reserve(count + 1);
+    animations.reserve(count, count);
+    int windowNode = scene.createNode();
+    for (size_t i = 0; i < count; i++) {
+        Entity e = world.create(mask);
+        int node = scene.createNode(windowNode);
+        world.get<Transform>(e).node = node;
+        scene.setTranslation(node, 0.001f * (float)(i % 1000), 0.001f * (float)(i / 1000), 0.0f);
+        // Spread the phases so growing and shrinking circles mix
+        float scale = 0.5f + 1.5f * (float)(i % 64) / 64.0f;
+        scene.setScale(node, scale, scale, 1.0f);
+        animations.spawn(breatheAnimation(animations, node, 0.02f, 0.5f, 2.0f));
+    }
+    scene.updateWorld();
+}
+
+// One frame of updateAnimations() plus the world matrix update; every circle is always tweening
+static void animationFrame(BenchState& state, JobSystem* pool) {
+    EntityWorld world;
+    SceneGraph scene;
+    AnimationScheduler animations(scene);
+    createBreathingCircles(world, scene, animations, state.size());
+    while (state.keepRunning()) {
+        animations.advance(1, pool);
+        scene.updateWorld(pool);
+    }
+    state.setItemsPerIteration(state.size());
+}
+
+static void benchAnimateCircles(BenchState& state) {
+    animationFrame(state, nullptr);
+}
+
+static void benchAnimateCirclesJobs(BenchState& state) {
+    animationFrame(state, &jobs);
+}
+
+// A scripted sequence: pause, pulse for a few frames, and every few rounds wait for a shared beat
+static AnimationTask pulseScript(AnimationScheduler& animations, AnimationEvent& beat, int node, uint64_t pause) {
+    for (int round = 0;; round++) {
+        co_await animations.delay(pause);
+        co_await animations.tween(node, TWEEN_SCALE_XY, 1.0f, 1.5f, 8);
+        co_await animations.tween(node, TWEEN_SCALE_XY, 1.5f, 1.0f, 8);
+        if (round % 4 == 3) co_await beat;
+    }
+}
+
+// Many concurrent scripts of which only a few percent are moving in any
+// frame; the parked ones should cost nothing
+static void benchScriptedAnimations(BenchState& state) {
+    size_t n = state.size();
+    SceneGraph scene;
+    scene.reserve(n + 1);
+    int windowNode = scene.createNode();
+    AnimationScheduler animations(scene);
+    AnimationEvent beat(animations);
+    for (size_t i = 0; i < n; i++) {
+        int node = scene.createNode(windowNode);
+        animations.spawn(pulseScript(animations, beat, node, 300 + (i * 37) % 1000));
+    }
+    scene.updateWorld();
+    uint64_t frame = 0;
+    while (state.keepRunning()) {
+        animations.advance(1, &jobs);
+        if (++frame % 600 == 0) beat.signal();
+        scene.updateWorld(&jobs);
+    }
+    state.setItemsPerIteration(n);
+}
+
+static void benchBuildUnitCircle(BenchState& state) {
+    int segments = (int)state.size();
+    std::vector<float> points(2 * (segments + 1));
+    while (state.keepRunning()) {
+        buildUnitCircle(points.data(), segments);
+        clobberMemory();
+    }
+    state.setItemsPerIteration(segments);
+}
+
+// Recording one frame's breathing circles as a vertex batch into a reused
+// command list, as ShapeCommandRecorder in main.cpp does
+static void benchCircleBatch(BenchState& state) {
+    const int segments = 50;
+    size_t n = state.size();
+    std::vector<float> unitCircle(2 * (segments + 1));
+    buildUnitCircle(unitCircle.data(), segments);
+    std::vector<float> worlds = makeMatrices(n);
+    const float color[3] = {0.2f, 0.4f, 0.6f};
+    CommandList list;
+    while (state.keepRunning()) {
+        list.clear();
+        float* end = list.drawVertices(n * circleBatchFloats(segments));
+        for (size_t i = 0; i < n; i++) end = appendCircle(end, unitCircle.data(), segments, &worlds[i * 16], color, 0.1f);
+        doNotOptimize(end);
+        clobberMemory();
+    }
+    state.setItemsPerIteration(n);
+}
+
+// Keys like a scene with a few programs and meshes and arbitrary depths
+static std::vector<uint64_t> makeSortKeys(size_t count) {
+    std::vector<uint64_t> keys(count);
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < count; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        keys[i] = makeSortKey(seed >> 30, (seed >> 26) & 3, (seed >> 20) & 31, seed & 0xffffff, (seed >> 16) & 15);
+    }
+    return keys;
+}
+
+// Filling and radix-sorting one frame's render queue
+static void benchRenderQueueSort(BenchState& state) {
+    size_t n = state.size();
+    std::vector<uint64_t> keys = makeSortKeys(n);
+    RenderQueue queue;
+    while (state.keepRunning()) {
+        queue.clear();
+        for (size_t i = 0; i < n; i++) queue.push(keys[i], (uint32_t)i);
+        queue.sort();
+        doNotOptimize(queue.items());
+    }
+    state.setItemsPerIteration(n);
+}
+
+// The same with std::stable_sort, for comparison
+static void benchStdStableSort(BenchState& state) {
+    size_t n = state.size();
+    std::vector<uint64_t> keys = makeSortKeys(n);
+    std::vector<DrawItem> items;
+    items.reserve(n);
+    while (state.keepRunning()) {
+        items.clear();
+        for (size_t i = 0; i < n; i++) items.push_back(DrawItem{keys[i], (uint32_t)i});
+        std::stable_sort(items.begin(), items.end(), [](const DrawItem& a, const DrawItem& b) { return a.key < b.key; });
+        doNotOptimize(items.data());
+    }
+    state.setItemsPerIteration(n);
+}
+
+// Boxes of cube --objects: a square floor grid one unit apart, 0.4 across
+static std::vector<Aabb> makeFloorBoxes(size_t count) {
+    std::vector<Aabb> boxes(count);
+    size_t side = 1;
+    while (side * side < count) side++;
+    float offset = 0.5f * (side - 1);
+    for (size_t i = 0; i < count; i++) {
+        float center[3] = {i % side - offset, -1.0f, i / side - offset};
+        for (int axis = 0; axis < 3; axis++) {
+            boxes[i].min[axis] = center[axis] - 0.2f;
+            boxes[i].max[axis] = center[axis] + 0.2f;
+        }
+    }
+    return boxes;
+}
+
+// cube's default camera looking across the floor
+static Frustum makeCubeFrustum() {
+    float projection[16], view[16], viewProjection[16];
+    perspectiveMatrix(projection, 45.0f * 3.14159265f / 180.0f, 4.0f / 3.0f, 0.1f, 100.0f);
+    const float eye[3] = {0.0f, 0.0f, 2.5f}, target[3] = {0.0f, 0.0f, 0.0f}, up[3] = {0.0f, 1.0f, 0.0f};
+    lookAtMatrix(view, eye, target, up);
+    multiplyMatrix(viewProjection, projection, view);
+    Frustum frustum;
+    frustumFromMatrix(viewProjection, frustum);
+    return frustum;
+}
+
+// Frustum culling through the BVH; the cost follows the visible part of the floor
+static void benchBvhCull(BenchState& state) {
+    size_t n = state.size();
+    std::vector<Aabb> boxes = makeFloorBoxes(n);
+    Frustum frustum = makeCubeFrustum();
+    Bvh bvh;
+    bvh.build(boxes.data(), n);
+    std::vector<int> visible;
+    visible.reserve(n);
+    while (state.keepRunning()) {
+        visible.clear();
+        bvh.cull(frustum, visible);
+        doNotOptimize(visible.data());
+    }
+    state.setItemsPerIteration(n);
+}
+
+// Testing every box, for comparison
+static void benchLinearCull(BenchState& state) {
+    size_t n = state.size();
+    std::vector<Aabb> boxes = makeFloorBoxes(n);
+    Frustum frustum = makeCubeFrustum();
+    std::vector<int> visible;
+    visible.reserve(n);
+    while (state.keepRunning()) {
+        visible.clear();
+        for (size_t i = 0; i < n; i++) {
+            if (frustumIntersectsAabb(frustum, boxes[i])) visible.push_back((int)i);
+        }
+        doNotOptimize(visible.data());
+    }
+    state.setItemsPerIteration(n);
+}
+
+// Refitting after `size` objects of a 1M object floor moved
+static void benchBvhRefit(BenchState& state) {
+    size_t n = state.size();
+    const size_t count = 1000000;
+    std::vector<Aabb> boxes = makeFloorBoxes(count);
+    Bvh bvh;
+    bvh.build(boxes.data(), count);
+    float offset = 0.1f;
+    while (state.keepRunning()) {
+        for (size_t i = 0; i < n; i++) {
+            size_t object = i * (count / n);
+            Aabb box = boxes[object];
+            box.min[1] += offset;
+            box.max[1] += offset;
+            bvh.update((int)object, box);
+        }
+        offset = -offset;
+    }
+    state.setItemsPerIteration(n);
+}
+
+// cube.cpp's scene on the software rasterizer; size is the image height at 16:9
+static void benchSoftRasterCube(BenchState& state) {
+    static const float vertices[] = {
+        -0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 0.0f,  0.5f, -0.5f, -0.5f, 0.0f, 1.0f, 0.0f,
+         0.5f,  0.5f, -0.5f, 0.0f, 0.0f, 1.0f, -0.5f,  0.5f, -0.5f, 1.0f, 1.0f, 0.0f,
+        -0.5f, -0.5f,  0.5f, 1.0f, 0.0f, 1.0f,  0.5f, -0.5f,  0.5f, 0.0f, 1.0f, 1.0f,
+         0.5f,  0.5f,  0.5f, 1.0f, 1.0f, 1.0f, -0.5f,  0.5f,  0.5f, 0.5f, 0.5f, 0.5f};
+    static const unsigned indices[] = {0, 1, 2, 2, 3, 0, 4, 5, 6, 6, 7, 4, 4, 0, 3, 3, 7, 4,
+                                       1, 5, 6, 6, 2, 1, 4, 5, 1, 1, 0, 4, 3, 2, 6, 6, 7, 3};
+    const SoftVertexFormat format = {6, 3, 3};
+    int height = (int)state.size(), width = height * 16 / 9;
+
+    SceneGraph scene;
+    int cube = scene.createNode();
+    scene.setRotationEuler(cube, 30.0f, 40.0f, 0.0f);
+    scene.updateWorld();
+    SoftRasterizer rasterizer;
+    rasterizer.resize(width, height);
+    rasterizer.setDepthTest(true);
+    while (state.keepRunning()) {
+        rasterizer.clear(true, true);
+        rasterizer.setTransform(scene.worldMatrix(cube));
+        rasterizer.drawIndexedTriangles(vertices, format, indices, 36);
+        rasterizer.flush(&jobs);
+    }
+    state.setItemsPerIteration((size_t)width * height);
+}
+
+int main(int argc, char** argv) {
+    BenchRunner runner;
+    if (!runner.parseArguments(argc, argv)) return 1;
+    logStart(LogLevel::Warning);
+    jobs.start();
+
+    runner.add("multiplyMatrix", benchMultiplyMatrix, {1, 64, 4096});
+    runner.add("rotateZMatrix", benchRotateZMatrix, {1, 64, 4096});
+    runner.add("eulerTransformChain", benchEulerTransformChain, {1, 64, 4096});
+    runner.add("quaternionCompose", benchQuaternionCompose, {1, 64, 4096});
+    runner.add("quatSlerp", benchQuatSlerp, {64, 4096});
+    runner.add("animateCircles", benchAnimateCircles, {100, 1000, 10000, 100000});
+    runner.add("animateCirclesJobs", benchAnimateCirclesJobs, {1000, 10000, 100000, 1000000});
+    runner.add("scriptedAnimations", benchScriptedAnimations, {1000, 10000, 100000});
+    runner.add("buildUnitCircle", benchBuildUnitCircle, {16, 50, 256});
+    runner.add("circleBatch", benchCircleBatch, {1, 100, 1000, 10000});
+    runner.add("renderQueueSort", benchRenderQueueSort, {100, 10000, 1000000});
+    runner.add("stdStableSort", benchStdStableSort, {100, 10000, 1000000});
+    runner.add("bvhCull", benchBvhCull, {10000, 100000, 1000000});
+    runner.add("linearCull", benchLinearCull, {10000, 100000, 1000000});
+    runner.add("bvhRefit", benchBvhRefit, {100, 10000});
+    runner.add("softRasterCube", benchSoftRasterCube, {480, 1080, 2160});
+    int status = runner.runAll();
+
+    jobs.stop();
+    logStop();
+    return status;
+}
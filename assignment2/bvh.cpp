@@ -0,0 +1,294 @@
+#include "bvh.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define BVH_SSE 1
+#include <xmmintrin.h>
+#endif
+
+// Deeper than any tree build() makes (about log4 of the object count), times
+// the three siblings each level can leave on the stack
+static const int CULL_STACK_SIZE = 256;
+
+Aabb emptyAabb() {
+    Aabb box;
+    for (int i = 0; i < 3; i++) {
+        box.min[i] = FLT_MAX;
+        box.max[i] = -FLT_MAX;
+    }
+    return box;
+}
+
+static void growAabb(Aabb& box, const Aabb& other) {
+    for (int i = 0; i < 3; i++) {
+        box.min[i] = std::min(box.min[i], other.min[i]);
+        box.max[i] = std::max(box.max[i], other.max[i]);
+    }
+}
+
+static bool sameAabb(const Aabb& a, const Aabb& b) {
+    for (int i = 0; i < 3; i++) {
+        if (a.min[i] != b.min[i] || a.max[i] != b.max[i]) return false;
+    }
+    return true;
+}
+
+void transformAabb(const float* m, const Aabb& local, Aabb& world) {
+    if (local.min[0] > local.max[0]) {
+        world = local;
+        return;
+    }
+    // Center goes through the matrix, the half extents through its absolute values
+    float center[3], extent[3];
+    for (int i = 0; i < 3; i++) {
+        center[i] = 0.5f * (local.min[i] + local.max[i]);
+        extent[i] = 0.5f * (local.max[i] - local.min[i]);
+    }
+    for (int row = 0; row < 3; row++) {
+        const float* r = m + row * 4;
+        float c = r[0] * center[0] + r[1] * center[1] + r[2] * center[2] + r[3];
+        float e = std::fabs(r[0]) * extent[0] + std::fabs(r[1]) * extent[1] + std::fabs(r[2]) * extent[2];
+        world.min[row] = c - e;
+        world.max[row] = c + e;
+    }
+}
+
+void frustumFromMatrix(const float* m, Frustum& frustum) {
+    // Inside is -w <= x, y, z <= w, so each plane is the w row plus or minus another row
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 4; j++) {
+            frustum.planes[i * 2][j] = m[12 + j] + m[i * 4 + j];
+            frustum.planes[i * 2 + 1][j] = m[12 + j] - m[i * 4 + j];
+        }
+    }
+}
+
+bool frustumIntersectsAabb(const Frustum& frustum, const Aabb& box) {
+    for (int p = 0; p < 6; p++) {
+        const float* plane = frustum.planes[p];
+        // The corner farthest along the plane normal
+        float x = plane[0] >= 0.0f ? box.max[0] : box.min[0];
+        float y = plane[1] >= 0.0f ? box.max[1] : box.min[1];
+        float z = plane[2] >= 0.0f ? box.max[2] : box.min[2];
+        if (plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < 0.0f) return false;
+    }
+    return true;
+}
+
+// Bit i of `outside` is set when child i is entirely behind some plane, bit i
+// of `inside` when it is in front of all of them
+static void testChildren(const Frustum& frustum, const float* minX, const float* minY, const float* minZ,
+                         const float* maxX, const float* maxY, const float* maxZ, int& outside, int& inside) {
+#if BVH_SSE
+    const __m128 zero = _mm_setzero_ps();
+    __m128 out = zero;
+    __m128 in = _mm_cmpeq_ps(zero, zero);
+    for (int p = 0; p < 6; p++) {
+        const float* plane = frustum.planes[p];
+        // The farthest corner along the normal decides "outside", the nearest "inside"
+        bool px = plane[0] >= 0.0f, py = plane[1] >= 0.0f, pz = plane[2] >= 0.0f;
+        __m128 a = _mm_set1_ps(plane[0]), b = _mm_set1_ps(plane[1]), c = _mm_set1_ps(plane[2]);
+        __m128 d = _mm_set1_ps(plane[3]);
+        __m128 farDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, _mm_loadu_ps(px ? maxX : minX)),
+                                                   _mm_mul_ps(b, _mm_loadu_ps(py ? maxY : minY))),
+                                        _mm_add_ps(_mm_mul_ps(c, _mm_loadu_ps(pz ? maxZ : minZ)), d));
+        __m128 nearDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, _mm_loadu_ps(px ? minX : maxX)),
+                                                    _mm_mul_ps(b, _mm_loadu_ps(py ? minY : maxY))),
+                                         _mm_add_ps(_mm_mul_ps(c, _mm_loadu_ps(pz ? minZ : maxZ)), d));
+        out = _mm_or_ps(out, _mm_cmplt_ps(farDistance, zero));
+        in = _mm_and_ps(in, _mm_cmpge_ps(nearDistance, zero));
+    }
+    outside = _mm_movemask_ps(out);
+    inside = _mm_movemask_ps(in);
+#else
+    outside = 0;
+    inside = 15;
+    for (int p = 0; p < 6; p++) {
+        const float* plane = frustum.planes[p];
+        bool px = plane[0] >= 0.0f, py = plane[1] >= 0.0f, pz = plane[2] >= 0.0f;
+        for (int i = 0; i < 4; i++) {
+            float farDistance = plane[0] * (px ? maxX : minX)[i] + plane[1] * (py ? maxY : minY)[i] +
+                                plane[2] * (pz ? maxZ : minZ)[i] + plane[3];
+            float nearDistance = plane[0] * (px ? minX : maxX)[i] + plane[1] * (py ? minY : maxY)[i] +
+                                 plane[2] * (pz ? minZ : maxZ)[i] + plane[3];
+            if (farDistance < 0.0f) outside |= 1 << i;
+            if (!(nearDistance >= 0.0f)) inside &= ~(1 << i);
+        }
+    }
+#endif
+}
+
+Bvh::Bvh() : lastStats() {
+}
+
+void Bvh::clear() {
+    nodes.clear();
+    order.clear();
+    objectSlots.clear();
+    parentSlots.clear();
+}
+
+void Bvh::build(const Aabb* bounds, size_t count) {
+    clear();
+    objectSlots.resize(count);
+    order.resize(count);
+    centers.resize(count * 3);
+    for (size_t i = 0; i < count; i++) {
+        order[i] = (int)i;
+        for (int axis = 0; axis < 3; axis++) centers[i * 3 + axis] = 0.5f * (bounds[i].min[axis] + bounds[i].max[axis]);
+    }
+    nodes.reserve(count / 2 + 1);
+    parentSlots.reserve(count / 2 + 1);
+    if (count > 0) buildNode(bounds, 0, (int)count, -1);
+    std::vector<float>().swap(centers);
+}
+
+int Bvh::buildNode(const Aabb* bounds, int first, int count, int parentSlot) {
+    int node = (int)nodes.size();
+    Node empty;
+    for (int i = 0; i < 4; i++) {
+        empty.minX[i] = empty.minY[i] = empty.minZ[i] = FLT_MAX;
+        empty.maxX[i] = empty.maxY[i] = empty.maxZ[i] = -FLT_MAX;
+        empty.child[i] = 0;
+        empty.first[i] = first;
+        empty.count[i] = 0;
+    }
+    nodes.push_back(empty);
+    parentSlots.push_back(parentSlot);
+
+    // Up to four ranges: two median splits along the longest axis of the centers
+    int rangeFirst[4], rangeCount[4], ranges = 0;
+    auto split = [&](int begin, int size, int* out) {
+        float lo[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, hi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+        for (int i = begin; i < begin + size; i++) {
+            for (int axis = 0; axis < 3; axis++) {
+                lo[axis] = std::min(lo[axis], centers[order[i] * 3 + axis]);
+                hi[axis] = std::max(hi[axis], centers[order[i] * 3 + axis]);
+            }
+        }
+        int axis = 0;
+        if (hi[1] - lo[1] > hi[axis] - lo[axis]) axis = 1;
+        if (hi[2] - lo[2] > hi[axis] - lo[axis]) axis = 2;
+        int middle = begin + size / 2;
+        const float* c = centers.data();
+        std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + begin + size,
+                         [c, axis](int a, int b) { return c[a * 3 + axis] < c[b * 3 + axis]; });
+        out[0] = middle - begin;
+        out[1] = size - out[0];
+    };
+    if (count <= 4) {
+        for (int i = 0; i < count; i++) {
+            rangeFirst[ranges] = first + i;
+            rangeCount[ranges++] = 1;
+        }
+    } else {
+        int halves[2], quarters[2];
+        split(first, count, halves);
+        int begin = first;
+        for (int h = 0; h < 2; h++) {
+            if (halves[h] == 1) {
+                rangeFirst[ranges] = begin;
+                rangeCount[ranges++] = 1;
+            } else {
+                split(begin, halves[h], quarters);
+                rangeFirst[ranges] = begin;
+                rangeCount[ranges++] = quarters[0];
+                rangeFirst[ranges] = begin + quarters[0];
+                rangeCount[ranges++] = quarters[1];
+            }
+            begin += halves[h];
+        }
+    }
+
+    // `nodes` may grow in the recursion, so it is only indexed afterwards
+    for (int i = 0; i < ranges; i++) {
+        int slot = node * 4 + i;
+        int child;
+        Aabb box;
+        if (rangeCount[i] == 1) {
+            int object = order[rangeFirst[i]];
+            child = ~object;
+            box = bounds[object];
+            objectSlots[object] = slot;
+        } else {
+            child = buildNode(bounds, rangeFirst[i], rangeCount[i], slot);
+            box = nodeBounds(child);
+        }
+        nodes[node].child[i] = child;
+        nodes[node].first[i] = rangeFirst[i];
+        nodes[node].count[i] = rangeCount[i];
+        setSlot(slot, box);
+    }
+    return node;
+}
+
+void Bvh::setSlot(int slot, const Aabb& box) {
+    Node& n = nodes[slot >> 2];
+    int i = slot & 3;
+    n.minX[i] = box.min[0];
+    n.minY[i] = box.min[1];
+    n.minZ[i] = box.min[2];
+    n.maxX[i] = box.max[0];
+    n.maxY[i] = box.max[1];
+    n.maxZ[i] = box.max[2];
+}
+
+Aabb Bvh::nodeBounds(int node) const {
+    const Node& n = nodes[node];
+    Aabb box = emptyAabb();
+    for (int i = 0; i < 4; i++) {
+        Aabb child = {{n.minX[i], n.minY[i], n.minZ[i]}, {n.maxX[i], n.maxY[i], n.maxZ[i]}};
+        growAabb(box, child);
+    }
+    return box;
+}
+
+void Bvh::update(int object, const Aabb& bounds) {
+    int slot = objectSlots[object];
+    setSlot(slot, bounds);
+    for (int node = slot >> 2; parentSlots[node] >= 0; node = slot >> 2) {
+        slot = parentSlots[node];
+        const Node& parent = nodes[slot >> 2];
+        int i = slot & 3;
+        Aabb old = {{parent.minX[i], parent.minY[i], parent.minZ[i]}, {parent.maxX[i], parent.maxY[i], parent.maxZ[i]}};
+        Aabb box = nodeBounds(node);
+        if (sameAabb(box, old)) break; // nothing above can change either
+        setSlot(slot, box);
+    }
+}
+
+void Bvh::emitRange(int first, int count, std::vector<int>& visible) const {
+    visible.insert(visible.end(), order.begin() + first, order.begin() + first + count);
+}
+
+void Bvh::cull(const Frustum& frustum, std::vector<int>& visible) {
+    lastStats.nodesVisited = 0;
+    lastStats.objectsVisible = 0;
+    if (nodes.empty()) return;
+    size_t visibleStart = visible.size();
+
+    int stack[CULL_STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node& n = nodes[stack[--top]];
+        lastStats.nodesVisited++;
+        int outside, inside;
+        testChildren(frustum, n.minX, n.minY, n.minZ, n.maxX, n.maxY, n.maxZ, outside, inside);
+        for (int i = 0; i < 4; i++) {
+            if (n.count[i] == 0 || (outside >> i & 1)) continue;
+            if (n.child[i] < 0) {
+                visible.push_back(~n.child[i]);
+            } else if (inside >> i & 1) {
+                emitRange(n.first[i], n.count[i], visible);
+            } else if (top < CULL_STACK_SIZE) {
+                stack[top++] = n.child[i];
+            } else {
+                emitRange(n.first[i], n.count[i], visible); // cannot happen with build()'s trees
+            }
+        }
+    }
+    lastStats.objectsVisible = visible.size() - visibleStart;
+}
@@ -0,0 +1,80 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <cstddef>
+#include <vector>
+
+// Axis-aligned box; an empty box has min > max
+struct Aabb {
+    float min[3], max[3];
+};
+
+Aabb emptyAabb();
+// Box around `local` after the row-major matrix (see matrix.h)
+void transformAabb(const float* matrix, const Aabb& local, Aabb& world);
+
+// Planes a x + b y + c z + d >= 0 of the points a view-projection keeps
+struct Frustum {
+    float planes[6][4];
+};
+
+// Left, right, bottom, top, near and far planes of a row-major clip matrix
+void frustumFromMatrix(const float* viewProjection, Frustum& frustum);
+// Conservative test: false only if the box is entirely outside one plane
+bool frustumIntersectsAabb(const Frustum& frustum, const Aabb& box);
+
+struct BvhCullStats {
+    size_t nodesVisited;
+    size_t objectsVisible;
+};
+
+// Bounding volume hierarchy over the boxes of objects 0..count-1 for view
+// frustum culling. Every node has four children stored side by side
+// (structure of arrays), so one node is tested against a plane with a single
+// 4-wide SSE comparison. A child is either another node or one object.
+//
+// The objects of any subtree are a contiguous range of one array, so a
+// subtree that is entirely inside the frustum is emitted without visiting
+// it. update() refits only the path from a changed object to the root and
+// stops as soon as a box does not change; the tree shape is kept, which
+// stays good as long as objects do not travel far.
+class Bvh {
+public:
+    Bvh();
+
+    // Builds the tree for bounds[0..count-1]
+    void build(const Aabb* bounds, size_t count);
+    void clear();
+    size_t objectCount() const { return objectSlots.size(); }
+
+    // New box for one object; refits its ancestors
+    void update(int object, const Aabb& bounds);
+
+    // Appends the objects whose boxes touch the frustum to `visible`
+    void cull(const Frustum& frustum, std::vector<int>& visible);
+    const BvhCullStats& stats() const { return lastStats; }
+
+private:
+    // Four children; `child` is a node index, or ~object for an object. Empty
+    // slots have an empty box and no objects.
+    struct Node {
+        float minX[4], minY[4], minZ[4];
+        float maxX[4], maxY[4], maxZ[4];
+        int child[4];
+        int first[4], count[4]; // range of `order` below each child
+    };
+
+    std::vector<Node> nodes;
+    std::vector<int> order;       // object ids, each subtree contiguous
+    std::vector<int> objectSlots; // node * 4 + child holding each object
+    std::vector<int> parentSlots; // node * 4 + child pointing to each node, -1 for the root
+    std::vector<float> centers;   // build scratch, x y z per object
+    BvhCullStats lastStats;
+
+    int buildNode(const Aabb* bounds, int first, int count, int parentSlot);
+    void setSlot(int slot, const Aabb& box);
+    Aabb nodeBounds(int node) const;
+    void emitRange(int first, int count, std::vector<int>& visible) const;
+};
+
+#endif
@@ -0,0 +1,398 @@
+#include "capture.h"
+#include "logger.h"
+#include <chrono>
+#include <cstring>
+
+static const uint8_t PNG_SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+static bool endsWith(const std::string& s, const char* suffix) {
+    size_t n = strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+static void putBigEndian32(std::vector<uint8_t>& out, uint32_t value) {
+    out.push_back((uint8_t)(value >> 24));
+    out.push_back((uint8_t)(value >> 16));
+    out.push_back((uint8_t)(value >> 8));
+    out.push_back((uint8_t)value);
+}
+
+static uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+    static uint32_t table[256];
+    static bool tableReady = false;
+    if (!tableReady) {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        tableReady = true;
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void putPngChunk(std::vector<uint8_t>& out, const char* type, const uint8_t* data, size_t size) {
+    putBigEndian32(out, (uint32_t)size);
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + size);
+    putBigEndian32(out, crc32(&out[start], size + 4));
+}
+
+FrameCapture::FrameCapture()
+    : nextSlot(0), usePbo(false), running(false), format(CAPTURE_RAW), fps(60), file(nullptr),
+      videoWidth(0), videoHeight(0), frameNumber(0), capturedFrames(0), droppedFrames(0),
+      skippedFrames(0), captureSeconds(0.0), stopping(false) {
+    for (Slot& slot : slots) {
+        slot.pbo = 0;
+        slot.capacity = 0;
+        slot.width = slot.height = 0;
+        slot.pending = false;
+    }
+}
+
+FrameCapture::~FrameCapture() {
+    // The GL objects need a context; only the encoder thread is cleaned up here
+    if (encoder.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        frameReady.notify_one();
+        encoder.join();
+    }
+    if (file) fclose(file);
+}
+
+bool FrameCapture::start(const char* outputPath, int framesPerSecond, bool fromGl) {
+    if (running) stop();
+    path = outputPath;
+    fps = framesPerSecond;
+    if (endsWith(path, ".y4m")) format = CAPTURE_Y4M;
+    else if (endsWith(path, ".png")) format = CAPTURE_PNG;
+    else format = CAPTURE_RAW;
+
+    if (format != CAPTURE_PNG) {
+        file = fopen(outputPath, "wb");
+        if (!file) {
+            logError("Cannot create capture file %s", outputPath);
+            return false;
+        }
+    }
+
+    usePbo = fromGl && (GLEW_VERSION_2_1 || GLEW_ARB_pixel_buffer_object);
+    if (usePbo) {
+        for (Slot& slot : slots) {
+            glGenBuffers(1, &slot.pbo);
+            slot.capacity = 0;
+            slot.pending = false;
+        }
+    } else if (fromGl) {
+        logWarning("Pixel buffer objects not supported, frame capture will stall the GPU");
+    }
+
+    nextSlot = 0;
+    videoWidth = videoHeight = 0;
+    frameNumber = 0;
+    capturedFrames = droppedFrames = skippedFrames = 0;
+    captureSeconds = 0.0;
+    stopping = false;
+    running = true;
+    encoder = std::thread(&FrameCapture::encoderLoop, this);
+    logInfo("Capturing frames to %s", outputPath);
+    return true;
+}
+
+void FrameCapture::stop() {
+    if (!running) return;
+
+    // Frames still in the ring are the last ones of the session
+    for (int i = 0; i < PBO_COUNT; i++) {
+        Slot& slot = slots[(nextSlot + i) % PBO_COUNT];
+        if (slot.pending) readBack(slot);
+    }
+    for (Slot& slot : slots) {
+        if (slot.pbo) glDeleteBuffers(1, &slot.pbo);
+        slot.pbo = 0;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    frameReady.notify_one();
+    encoder.join();
+    if (file) {
+        fclose(file);
+        file = nullptr;
+    }
+    running = false;
+
+    logInfo("Captured %u frames (%u dropped, %u skipped for size changes), %.3f ms per frame on the render thread",
+            capturedFrames, droppedFrames, skippedFrames,
+            capturedFrames ? captureSeconds * 1000.0 / capturedFrames : 0.0);
+    if (format == CAPTURE_RAW && videoWidth > 0) {
+        logInfo("Raw video: rgb24 %dx%d at %d fps", videoWidth, videoHeight, fps);
+    }
+}
+
+void FrameCapture::captureFrame(int width, int height) {
+    if (!running || width <= 0 || height <= 0) return;
+    auto begin = std::chrono::steady_clock::now();
+    size_t size = (size_t)width * height * 4;
+
+    glReadBuffer(GL_BACK);
+    if (usePbo) {
+        // The buffer filled PBO_COUNT frames ago is ready by now
+        Slot& slot = slots[nextSlot];
+        if (slot.pending) readBack(slot);
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        if (slot.capacity < size) {
+            glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+            slot.capacity = size;
+        }
+        // Asynchronous: returns as soon as the copy is queued
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot.width = width;
+        slot.height = height;
+        slot.pending = true;
+        nextSlot = (nextSlot + 1) % PBO_COUNT;
+    } else {
+        std::vector<uint8_t> pixels;
+        if (acquireBuffer(size, pixels)) {
+            glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+            submit(pixels, width, height);
+        }
+    }
+
+    captureSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+void FrameCapture::captureImage(const uint8_t* pixels, int width, int height, size_t rowPitch) {
+    if (!running || width <= 0 || height <= 0) return;
+    auto begin = std::chrono::steady_clock::now();
+    size_t rowBytes = (size_t)width * 4;
+    std::vector<uint8_t> frame;
+    if (acquireBuffer(rowBytes * height, frame)) {
+        for (int y = 0; y < height; y++) memcpy(frame.data() + y * rowBytes, pixels + y * rowPitch, rowBytes);
+        submit(frame, width, height);
+    }
+    captureSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+void FrameCapture::readBack(Slot& slot) {
+    slot.pending = false;
+    size_t size = (size_t)slot.width * slot.height * 4;
+    std::vector<uint8_t> pixels;
+    if (!acquireBuffer(size, pixels)) return;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    const void* mapped = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    if (mapped) {
+        memcpy(pixels.data(), mapped, size);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    if (mapped) submit(pixels, slot.width, slot.height);
+    else {
+        std::lock_guard<std::mutex> lock(mutex);
+        freeBuffers.push_back(std::move(pixels));
+        droppedFrames++;
+    }
+}
+
+// Takes a recycled pixel buffer; false (frame dropped) when the encoder is too far behind
+bool FrameCapture::acquireBuffer(size_t size, std::vector<uint8_t>& buffer) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (queue.size() >= MAX_QUEUED_FRAMES) {
+            droppedFrames++;
+            return false;
+        }
+        if (!freeBuffers.empty()) {
+            buffer.swap(freeBuffers.back());
+            freeBuffers.pop_back();
+        }
+    }
+    buffer.resize(size);
+    return true;
+}
+
+void FrameCapture::submit(std::vector<uint8_t>& pixels, int width, int height) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Frame frame;
+        frame.pixels.swap(pixels);
+        frame.width = width;
+        frame.height = height;
+        queue.push_back(std::move(frame));
+        capturedFrames++;
+    }
+    frameReady.notify_one();
+}
+
+void FrameCapture::encoderLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        frameReady.wait(lock, [this]() { return stopping || !queue.empty(); });
+        if (queue.empty()) break; // stopping and drained
+
+        Frame frame = std::move(queue.front());
+        queue.pop_front();
+        lock.unlock();
+        writeFrame(frame);
+        lock.lock();
+        freeBuffers.push_back(std::move(frame.pixels));
+    }
+}
+
+void FrameCapture::writeFrame(const Frame& frame) {
+    if (format != CAPTURE_PNG) {
+        // A video stream has one size; frames after a resize are skipped
+        if (videoWidth == 0) {
+            videoWidth = frame.width;
+            videoHeight = frame.height;
+            if (format == CAPTURE_Y4M) {
+                fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n", videoWidth, videoHeight, fps);
+            }
+        }
+        if (frame.width != videoWidth || frame.height != videoHeight) {
+            skippedFrames++;
+            return;
+        }
+    }
+
+    if (format == CAPTURE_Y4M) {
+        writeY4m(frame);
+        return;
+    }
+
+    // RGBA bottom-up -> RGB top-down
+    int w = frame.width, h = frame.height;
+    rgb.resize((size_t)w * h * 3);
+    for (int y = 0; y < h; y++) {
+        const uint8_t* src = &frame.pixels[(size_t)(h - 1 - y) * w * 4];
+        uint8_t* dst = &rgb[(size_t)y * w * 3];
+        for (int x = 0; x < w; x++) {
+            dst[x * 3 + 0] = src[x * 4 + 0];
+            dst[x * 3 + 1] = src[x * 4 + 1];
+            dst[x * 3 + 2] = src[x * 4 + 2];
+        }
+    }
+    if (format == CAPTURE_RAW) fwrite(rgb.data(), 1, rgb.size(), file);
+    else writePng(frame);
+}
+
+void FrameCapture::writeY4m(const Frame& frame) {
+    int w = frame.width, h = frame.height;
+    int cw = (w + 1) / 2, ch = (h + 1) / 2;
+    encoded.resize((size_t)w * h + 2 * (size_t)cw * ch);
+    uint8_t* yPlane = encoded.data();
+    uint8_t* uPlane = yPlane + (size_t)w * h;
+    uint8_t* vPlane = uPlane + (size_t)cw * ch;
+
+    // Limited-range BT.601, which Y4M readers assume when no range is given.
+    // Chroma is averaged over 2x2 blocks, so it sits between the luma samples
+    // as C420jpeg declares.
+    for (int y = 0; y < h; y++) {
+        const uint8_t* src = &frame.pixels[(size_t)(h - 1 - y) * w * 4];
+        for (int x = 0; x < w; x++) {
+            int r = src[x * 4], g = src[x * 4 + 1], b = src[x * 4 + 2];
+            yPlane[(size_t)y * w + x] = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        }
+    }
+    for (int cy = 0; cy < ch; cy++) {
+        for (int cx = 0; cx < cw; cx++) {
+            int r = 0, g = 0, b = 0, n = 0;
+            for (int dy = 0; dy < 2; dy++) {
+                int y = cy * 2 + dy;
+                if (y >= h) break;
+                const uint8_t* src = &frame.pixels[(size_t)(h - 1 - y) * w * 4];
+                for (int dx = 0; dx < 2; dx++) {
+                    int x = cx * 2 + dx;
+                    if (x >= w) break;
+                    r += src[x * 4]; g += src[x * 4 + 1]; b += src[x * 4 + 2];
+                    n++;
+                }
+            }
+            r /= n; g /= n; b /= n;
+            uPlane[(size_t)cy * cw + cx] = (uint8_t)((-38 * r - 74 * g + 112 * b + 32768 + 128) >> 8);
+            vPlane[(size_t)cy * cw + cx] = (uint8_t)((112 * r - 94 * g - 18 * b + 32768 + 128) >> 8);
+        }
+    }
+
+    fputs("FRAME\n", file);
+    fwrite(encoded.data(), 1, encoded.size(), file);
+}
+
+void FrameCapture::writePng(const Frame& frame) {
+    int w = frame.width, h = frame.height;
+    size_t rowSize = (size_t)w * 3 + 1; // filter byte + RGB
+
+    // Scanlines: filter type 0 followed by the RGB bytes
+    std::vector<uint8_t> raw(rowSize * h);
+    for (int y = 0; y < h; y++) {
+        raw[y * rowSize] = 0;
+        memcpy(&raw[y * rowSize + 1], &rgb[(size_t)y * w * 3], rowSize - 1);
+    }
+
+    // zlib stream of stored (uncompressed) deflate blocks: cheap to write and
+    // still readable by every PNG decoder
+    std::vector<uint8_t> zlib;
+    zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+    for (size_t pos = 0;;) {
+        size_t block = raw.size() - pos < 65535 ? raw.size() - pos : 65535;
+        bool last = pos + block == raw.size();
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back((uint8_t)block);
+        zlib.push_back((uint8_t)(block >> 8));
+        zlib.push_back((uint8_t)~block);
+        zlib.push_back((uint8_t)(~block >> 8));
+        zlib.insert(zlib.end(), raw.begin() + pos, raw.begin() + pos + block);
+        pos += block;
+        if (last) break;
+    }
+
+    // Adler-32; 5552 bytes is the most that can be summed before b overflows
+    uint32_t a = 1, b = 0;
+    for (size_t pos = 0; pos < raw.size(); ) {
+        size_t end = pos + 5552 < raw.size() ? pos + 5552 : raw.size();
+        for (; pos < end; pos++) {
+            a += raw[pos];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    putBigEndian32(zlib, (b << 16) | a);
+
+    encoded.clear();
+    encoded.insert(encoded.end(), PNG_SIGNATURE, PNG_SIGNATURE + 8);
+    std::vector<uint8_t> header;
+    putBigEndian32(header, (uint32_t)w);
+    putBigEndian32(header, (uint32_t)h);
+    const uint8_t rest[5] = {8, 2, 0, 0, 0}; // 8-bit RGB, deflate, no filter, no interlace
+    header.insert(header.end(), rest, rest + 5);
+    putPngChunk(encoded, "IHDR", header.data(), header.size());
+    putPngChunk(encoded, "IDAT", zlib.data(), zlib.size());
+    putPngChunk(encoded, "IEND", nullptr, 0);
+
+    std::string name = path.substr(0, path.size() - 4);
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "_%06u.png", ++frameNumber);
+    name += suffix;
+    FILE* out = fopen(name.c_str(), "wb");
+    if (!out) {
+        logError("Cannot write %s", name.c_str());
+        return;
+    }
+    fwrite(encoded.data(), 1, encoded.size(), out);
+    fclose(out);
+}
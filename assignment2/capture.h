@@ -0,0 +1,89 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <GL/glew.h>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum CaptureFormat {
+    CAPTURE_RAW, // headerless rgb24, top row first
+    CAPTURE_Y4M, // YUV4MPEG2, 4:2:0 limited range
+    CAPTURE_PNG  // numbered PNG files, uncompressed deflate
+};
+
+// Captures the frames of a window without stalling the render loop.
+// glReadPixels goes into one of a ring of pixel buffer objects; that buffer
+// is mapped PBO_COUNT frames later, when the copy has long finished, and its
+// pixels are handed to a background thread that converts and writes them.
+class FrameCapture {
+public:
+    FrameCapture();
+    ~FrameCapture();
+
+    // The format follows the extension: .y4m, .png (path_000001.png, ...) or raw.
+    // Needs the window's GL context to be current, unless every frame comes
+    // from captureImage() (fromGl false, e.g. software rendering without a window).
+    bool start(const char* path, int fps = 60, bool fromGl = true);
+    // Writes the frames still in flight; needs the GL context to be current
+    void stop();
+    bool active() const { return running; }
+
+    // Call after rendering and before swapping buffers
+    void captureFrame(int width, int height);
+    // Captures an image rendered on the CPU: RGBA, bottom row first, rowPitch bytes per row
+    void captureImage(const uint8_t* pixels, int width, int height, size_t rowPitch);
+
+private:
+    static const int PBO_COUNT = 3;
+    static const size_t MAX_QUEUED_FRAMES = 8;
+
+    struct Slot {
+        GLuint pbo;
+        size_t capacity;
+        int width, height;
+        bool pending;
+    };
+    struct Frame {
+        std::vector<uint8_t> pixels; // RGBA, bottom row first
+        int width, height;
+    };
+
+    Slot slots[PBO_COUNT];
+    int nextSlot;
+    bool usePbo;
+    bool running;
+
+    CaptureFormat format;
+    std::string path;
+    int fps;
+    FILE* file;
+    int videoWidth, videoHeight;
+    unsigned frameNumber;
+    std::vector<uint8_t> rgb, encoded;
+
+    unsigned capturedFrames, droppedFrames, skippedFrames;
+    double captureSeconds; // time spent in captureFrame()
+
+    std::thread encoder;
+    std::mutex mutex;
+    std::condition_variable frameReady;
+    std::deque<Frame> queue;
+    std::vector<std::vector<uint8_t>> freeBuffers;
+    bool stopping;
+
+    void readBack(Slot& slot);
+    bool acquireBuffer(size_t size, std::vector<uint8_t>& buffer);
+    void submit(std::vector<uint8_t>& pixels, int width, int height);
+    void encoderLoop();
+    void writeFrame(const Frame& frame);
+    void writeY4m(const Frame& frame);
+    void writePng(const Frame& frame);
+};
+
+#endif
@@ -0,0 +1,37 @@
+#include "circles.h"
+#include <cmath>
+
+static const float PI = 3.14159265358979323846f;
+
+void buildUnitCircle(float* points, int segments) {
+    for (int i = 0; i <= segments; i++) {
+        float angle = 2.0f * PI * i / segments;
+        points[2 * i] = cos(angle);
+        points[2 * i + 1] = sin(angle);
+    }
+}
+
+float* appendCircle(float* out, const float* unitCircle, int segments, const float* m, const float* color,
+                    float radius) {
+    // Rim offsets only need the upper 2x2 of the world matrix
+    float cx = m[3], cy = m[7];
+    float ax = radius * m[0], ay = radius * m[1];
+    float bx = radius * m[4], by = radius * m[5];
+    for (int i = 0; i < segments; i++) {
+        const float* p = unitCircle + 2 * i;
+        const float corners[3][2] = {
+            {cx, cy},
+            {cx + ax * p[0] + ay * p[1], cy + bx * p[0] + by * p[1]},
+            {cx + ax * p[2] + ay * p[3], cy + bx * p[2] + by * p[3]},
+        };
+        for (int v = 0; v < 3; v++) {
+            out[0] = corners[v][0];
+            out[1] = corners[v][1];
+            out[2] = color[0];
+            out[3] = color[1];
+            out[4] = color[2];
+            out += CIRCLE_VERTEX_FLOATS;
+        }
+    }
+    return out;
+}
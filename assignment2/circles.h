@@ -0,0 +1,20 @@
+#ifndef CIRCLES_H
+#define CIRCLES_H
+
+// Circle tessellation for vertex batches of (x, y, r, g, b)
+const int CIRCLE_VERTEX_FLOATS = 5;
+
+inline int circleBatchFloats(int segments) {
+    return segments * 3 * CIRCLE_VERTEX_FLOATS;
+}
+
+// Fills segments + 1 rim points (x, y) of the unit circle; the last repeats the first
+void buildUnitCircle(float* points, int segments);
+
+// Writes the circle as segments triangles around its center, transformed by
+// the world matrix m (row-major, see matrix.h). Returns the end of the
+// written vertices, circleBatchFloats(segments) floats after out.
+float* appendCircle(float* out, const float* unitCircle, int segments, const float* m, const float* color,
+                    float radius);
+
+#endif
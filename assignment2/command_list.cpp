@@ -0,0 +1,100 @@
+#include "command_list.h"
+
+enum CommandOp : uint32_t {
+    OP_BIND_PROGRAM,      // program
+    OP_BIND_VERTEX_ARRAY, // vertex array
+    OP_BIND_MATERIAL,     // material
+    OP_SET_TRANSFORM,     // 16 floats
+    OP_SET_COLOR,         // 3 floats
+    OP_DRAW,              // object
+    OP_DRAW_VERTICES      // float count, then the floats
+};
+
+void CommandList::clear() {
+    words.clear();
+    floats.clear();
+    commands = 0;
+}
+
+void CommandList::bindProgram(unsigned program) {
+    words.push_back(OP_BIND_PROGRAM);
+    words.push_back(program);
+    commands++;
+}
+
+void CommandList::bindVertexArray(unsigned vertexArray) {
+    words.push_back(OP_BIND_VERTEX_ARRAY);
+    words.push_back(vertexArray);
+    commands++;
+}
+
+void CommandList::bindMaterial(unsigned material) {
+    words.push_back(OP_BIND_MATERIAL);
+    words.push_back(material);
+    commands++;
+}
+
+void CommandList::setTransform(const float* matrix) {
+    words.push_back(OP_SET_TRANSFORM);
+    floats.insert(floats.end(), matrix, matrix + 16);
+    commands++;
+}
+
+void CommandList::setColor(const float* rgb) {
+    words.push_back(OP_SET_COLOR);
+    floats.insert(floats.end(), rgb, rgb + 3);
+    commands++;
+}
+
+void CommandList::draw(uint32_t object) {
+    words.push_back(OP_DRAW);
+    words.push_back(object);
+    commands++;
+}
+
+float* CommandList::drawVertices(size_t floatCount) {
+    words.push_back(OP_DRAW_VERTICES);
+    words.push_back((uint32_t)floatCount);
+    size_t offset = floats.size();
+    floats.resize(offset + floatCount);
+    commands++;
+    return floats.data() + offset;
+}
+
+void CommandList::execute(CommandExecutor& executor) const {
+    const uint32_t* word = words.data();
+    const uint32_t* end = word + words.size();
+    const float* data = floats.data();
+    while (word != end) {
+        switch (*word++) {
+            case OP_BIND_PROGRAM: executor.bindProgram(*word++); break;
+            case OP_BIND_VERTEX_ARRAY: executor.bindVertexArray(*word++); break;
+            case OP_BIND_MATERIAL: executor.bindMaterial(*word++); break;
+            case OP_SET_TRANSFORM:
+                executor.setTransform(data);
+                data += 16;
+                break;
+            case OP_SET_COLOR:
+                executor.setColor(data);
+                data += 3;
+                break;
+            case OP_DRAW: executor.draw(*word++); break;
+            case OP_DRAW_VERTICES: {
+                size_t count = *word++;
+                executor.drawVertices(data, count);
+                data += count;
+                break;
+            }
+        }
+    }
+}
+
+void CommandListSet::execute(CommandExecutor& executor) const {
+    for (size_t i = 0; i < used; i++) lists[i].execute(executor);
+}
+
+size_t CommandListSet::commandCount() const {
+    size_t count = 0;
+    for (size_t i = 0; i < used; i++) count += lists[i].commandCount();
+    return count;
+}
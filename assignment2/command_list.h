@@ -0,0 +1,94 @@
+#ifndef COMMAND_LIST_H
+#define COMMAND_LIST_H
+
+#include "jobs.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Receives the commands of a list. Like the render queue's fields, programs,
+// vertex arrays and materials are small ids chosen by the demo; what a
+// command means in GL (or on the software rasterizer) is up to the executor.
+class CommandExecutor {
+public:
+    virtual ~CommandExecutor() {}
+    virtual void bindProgram(unsigned program) = 0;
+    virtual void bindVertexArray(unsigned vertexArray) = 0;
+    virtual void bindMaterial(unsigned material) = 0;
+    virtual void setTransform(const float* matrix) = 0; // row-major 4x4
+    virtual void setColor(const float* rgb) = 0;
+    // Draws the bound vertex array; object is the draw item's id
+    virtual void draw(uint32_t object) = 0;
+    // Draws vertices stored in the list, in a layout the program defines
+    virtual void drawVertices(const float* vertices, size_t floatCount) = 0;
+};
+
+// Draw commands recorded for later execution, possibly on another thread:
+// a word stream of opcodes and integer arguments, and a float stream for
+// matrices, colors and vertices, so the floats are never reinterpreted.
+// clear() keeps the buffers, so lists reused every frame stop allocating
+// once they have grown to the largest frame.
+class CommandList {
+public:
+    void clear();
+    bool empty() const { return words.empty(); }
+    size_t commandCount() const { return commands; }
+
+    void bindProgram(unsigned program);
+    void bindVertexArray(unsigned vertexArray);
+    void bindMaterial(unsigned material);
+    void setTransform(const float* matrix);
+    void setColor(const float* rgb);
+    void draw(uint32_t object);
+    // Reserves floatCount floats for the vertices of a drawVertices command
+    // and returns them for the caller to fill before recording anything else
+    float* drawVertices(size_t floatCount);
+
+    void execute(CommandExecutor& executor) const;
+
+private:
+    std::vector<uint32_t> words;
+    std::vector<float> floats;
+    size_t commands = 0;
+};
+
+// The command lists of one frame, recorded over chunks of a range of items
+// by the job system's threads and executed in chunk order, so the result
+// does not depend on which thread recorded which chunk.
+class CommandListSet {
+public:
+    CommandListSet() : used(0) {}
+
+    // Calls record(list, begin, end) for chunks of [0, count) of at least
+    // minChunk items, each into its own list, and returns when all are done
+    template <typename Record> void record(JobSystem& jobs, size_t count, size_t minChunk, const Record& record);
+    void clear() { used = 0; }
+
+    void execute(CommandExecutor& executor) const;
+    size_t listCount() const { return used; }
+    size_t commandCount() const;
+
+private:
+    std::vector<CommandList> lists;
+    size_t used;
+};
+
+template <typename Record>
+void CommandListSet::record(JobSystem& jobs, size_t count, size_t minChunk, const Record& record) {
+    // About four chunks per thread, as in parallelFor; one list when there is no one to share with
+    unsigned threads = jobs.threadCount();
+    size_t chunk = std::max(std::max(minChunk, (size_t)1), (count + threads * 4 - 1) / (threads * 4));
+    if (threads == 1) chunk = std::max(count, (size_t)1);
+    used = (count + chunk - 1) / chunk;
+    if (lists.size() < used) lists.resize(used);
+    jobs.parallelFor(0, used, 1, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            CommandList& list = lists[i];
+            list.clear();
+            record(list, i * chunk, std::min(count, (i + 1) * chunk));
+        }
+    });
+}
+
+#endif
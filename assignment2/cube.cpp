@@ -2,440 +2,927 @@
 #include <GLFW/glfw3.h>
 #include <iostream>
 #include <cmath>
-
-// Transformation variables
-float scaleX = 1.0f, scaleY = 1.0f, scaleZ = 1.0f;
-float rotateX = 0.0f, rotateY = 0.0f, rotateZ = 0.0f;
-float translateX = 0.0f, translateY = 0.0f, translateZ = 0.0f;
+#include <algorithm>
+#include "allocators.h"
+#include "bvh.h"
+#include "capture.h"
+#include "command_list.h"
+#include "dynamic_resolution.h"
+#include "ecs.h"
+#include "gpu_culling.h"
+#include "input.h"
+#include "jobs.h"
+#include "latency.h"
+#include "logger.h"
+#include "matrix.h"
+#include "mesh_renderer.h"
+#include "meshes.h"
+#include "occlusion.h"
+#include "options.h"
+#include "pacing.h"
+#include "quaternion.h"
+#include "render_queue.h"
+#include "replay.h"
+#include "scene_graph.h"
+#include "snapshot.h"
+#include "soft_present.h"
+#include "soft_raster.h"
+#include <chrono>
+#include <mutex>
+
+// Scene: the cube entity, whose scene node holds the scale, rotation and
+// translation, plus the objects added with --objects. Renderable shapes are
+// MeshKinds. Everything is in world space and seen through the camera below.
+SceneGraph scene;
+EntityWorld world;
+Entity cubeEntity;
+int cubeNode = -1;
+
+// Worker threads for the per-frame updates
+JobSystem jobs;
+
+// This frame's draws, sorted by mesh and then front to back. Worker threads
+// turn chunks of the sorted queue into command lists, which the GL thread
+// (or the software renderer) then only has to execute.
+enum CubeProgram { PROGRAM_MESH };
+RenderQueue renderQueue;
+CommandListSet commandLists;
+std::mutex queueStatsMutex;
+const size_t ITEMS_PER_JOB = 1024;
+
+// Geometry of every MeshKind; on GL it is packed into meshRenderer
+MeshData meshes[MESH_KIND_COUNT];
+MeshRenderer meshRenderer;
+bool multiDrawIndirect = false; // one glMultiDrawElementsIndirect per frame instead of a call per object
+
+// Camera orbiting the origin: arrow keys turn it, Page Up/Down move it closer or farther
+float cameraYaw = 0.0f, cameraPitch = 0.0f; // degrees
+float cameraDistance = 2.5f;
+const float CAMERA_FOV = 45.0f; // vertical, degrees
+const float CAMERA_NEAR = 0.1f, CAMERA_FAR = 100.0f;
+const float CAMERA_STEP = 3.0f; // degrees per key trigger
+float viewProjection[16];
+
+// View frustum culling: a BVH over the world boxes of the renderable nodes,
+// with scene node handles as object ids. Only what it finds visible is queued.
+Bvh bvh;
+Aabb meshBounds[MESH_KIND_COUNT];
+std::vector<int> nodeShapes; // MeshKind of each node, -1 if it is not drawn
+std::vector<int> visibleNodes;
+
+// With --draw gpu, culling and the draw list are built by a compute shader
+// instead, and the CPU only uploads the transforms that changed
+GpuCulling gpuCulling;
+
+// With --occlusion, objects are drawn front to back one call each, and meshes
+// that cost more to draw than a box are first tested with a box occlusion query
+// and drawn under conditional rendering. Every mesh fits in the unit cube, so
+// the cube mesh with the object's transform is its box.
+bool occlusionCulling = false;
+OcclusionQueries occlusion;
+
+// With --frame-budget, the scene is rendered at a scale of the window chosen
+// to keep its GPU time within the budget and then scaled up to the window
+DynamicResolution resolution;
+
+// CPU time spent issuing the GL draws, and recording the command lists on
+// the workers beforehand, for the summary at exit
+double submitSeconds = 0.0, recordSeconds = 0.0;
+unsigned submitFrames = 0, recordFrames = 0;
 
 // Delta values for each transformation type
 float scaleDelta = 0.1f;
 float rotateDelta = 5.0f; // degrees
 float translateDelta = 0.1f;
 
+// Orientation is a quaternion; each rotate step eases from the shown
+// orientation to the new target instead of jumping
+Quat targetOrientation = {0.0f, 0.0f, 0.0f, 1.0f};
+OrientationAnimation cubeRotation = {};
+bool rotationAnimating = false;
+const double ROTATION_ANIMATION_TIME = 0.15; // seconds per rotate step
+const float DEG_TO_RAD = 3.14159265358979323846f / 180.0f;
+
+// Keyboard input (edge-triggered, timed repeat for the adjustment keys)
+InputSystem input;
+const double KEY_REPEAT_DELAY = 0.3; // seconds before a held key starts repeating
+const double KEY_REPEAT_RATE = 20.0; // repeats per second while held
+
+// Input recording / replay; frameTime is the clock all input and animation use
+ReplaySession session;
+double frameTime = 0.0;
+
+// Optional capture of the window (--capture)
+FrameCapture capture;
+
+// Counts heap allocations per frame; steady state should have none
+FrameAllocationStats allocationStats;
+
+// Frame rate limit (--fps) and frame time statistics
+FramePacer pacer;
+
+// With --low-latency, input is polled right before a frame is built instead
+// of after the previous swap, so the pacing sleep no longer sits between a key
+// press and the frame showing it, and fences stop the driver from queuing
+// frames ahead (--frames-in-flight). Key presses are timed to the present of
+// that frame in either mode.
+bool lowLatency = false;
+FrameFences frameFences;
+LatencyMeter latency;
+
+// CPU rendering (--renderer soft). With --headless as well there is no
+// window, GLFW or GL at all, and frames only go to the capture.
+bool softwareRendering = false;
+bool windowless = false;
+bool quitRequested = false; // Escape without a window
+SoftRasterizer softRenderer;
+SoftPresenter softPresenter;
+const int WINDOWLESS_WIDTH = 800, WINDOWLESS_HEIGHT = 600;
+
 // Current transformation mode
 enum TransformMode { SCALE, ROTATE, TRANSLATE };
 TransformMode currentMode = SCALE;
 
-// Cube vertices and indices
-float vertices[] = {
-    // positions          // colors
-    -0.5f, -0.5f, -0.5f,  1.0f, 0.0f, 0.0f,  // red
-     0.5f, -0.5f, -0.5f,  0.0f, 1.0f, 0.0f,  // green
-     0.5f,  0.5f, -0.5f,  0.0f, 0.0f, 1.0f,  // blue
-    -0.5f,  0.5f, -0.5f,  1.0f, 1.0f, 0.0f,  // yellow
-    -0.5f, -0.5f,  0.5f,  1.0f, 0.0f, 1.0f,  // magenta
-     0.5f, -0.5f,  0.5f,  0.0f, 1.0f, 1.0f,  // cyan
-     0.5f,  0.5f,  0.5f,  1.0f, 1.0f, 1.0f,  // white
-    -0.5f,  0.5f,  0.5f,  0.5f, 0.5f, 0.5f   // gray
-};
-
-unsigned int indices[] = {
-    // back face
-    0, 1, 2, 2, 3, 0,
-    // front face
-    4, 5, 6, 6, 7, 4,
-    // left face
-    4, 0, 3, 3, 7, 4,
-    // right face
-    1, 5, 6, 6, 2, 1,
-    // bottom face
-    4, 5, 1, 1, 0, 4,
-    // top face
-    3, 2, 6, 6, 7, 3
-};
-
-const char* vertexShaderSource = R"(
-#version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aColor;
-out vec3 ourColor;
-uniform mat4 transform;
-void main() {
-    gl_Position = transform * vec4(aPos, 1.0);
-    ourColor = aColor;
-}
-)";
-
-const char* fragmentShaderSource = R"(
-#version 330 core
-in vec3 ourColor;
-out vec4 FragColor;
-void main() {
-    FragColor = vec4(ourColor, 1.0);
-}
-)";
-
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     glViewport(0, 0, width, height);
 }
 
 void printMenu() {
-    std::cout << "\n=== CUBE TRANSFORMATION MENU ===" << std::endl;
-    std::cout << "Current Mode: ";
+    logInfo("\n=== CUBE TRANSFORMATION MENU ===");
+    const char* modeName = "";
     switch(currentMode) {
-        case SCALE: std::cout << "SCALE"; break;
-        case ROTATE: std::cout << "ROTATE"; break;
-        case TRANSLATE: std::cout << "TRANSLATE"; break;
-    }
-    std::cout << std::endl;
-
-    std::cout << "\nTransformation Values:" << std::endl;
-    std::cout << "Scale:     X=" << scaleX << " Y=" << scaleY << " Z=" << scaleZ << std::endl;
-    std::cout << "Rotation:  X=" << rotateX << "° Y=" << rotateY << "° Z=" << rotateZ << "°" << std::endl;
-    std::cout << "Translate: X=" << translateX << " Y=" << translateY << " Z=" << translateZ << std::endl;
-
-    std::cout << "\nDelta Values:" << std::endl;
-    std::cout << "Scale Delta: " << scaleDelta << std::endl;
-    std::cout << "Rotate Delta: " << rotateDelta << "°" << std::endl;
-    std::cout << "Translate Delta: " << translateDelta << std::endl;
-
-    std::cout << "\nCONTROLS:" << std::endl;
-    std::cout << "Mode Selection:" << std::endl;
-    std::cout << "  1 - SCALE mode" << std::endl;
-    std::cout << "  2 - ROTATE mode" << std::endl;
-    std::cout << "  3 - TRANSLATE mode" << std::endl;
-
-    std::cout << "\nAxis Controls:" << std::endl;
-    std::cout << "  X/x - Increase/Decrease X component" << std::endl;
-    std::cout << "  Y/y - Increase/Decrease Y component" << std::endl;
-    std::cout << "  Z/z - Increase/Decrease Z component" << std::endl;
-
-    std::cout << "\nDelta Controls:" << std::endl;
-    std::cout << "  + - Increase delta for current transformation" << std::endl;
-    std::cout << "  - - Decrease delta for current transformation" << std::endl;
-
-    std::cout << "\nOther Controls:" << std::endl;
-    std::cout << "  R - Reset all transformations" << std::endl;
-    std::cout << "  M - Show this menu" << std::endl;
-    std::cout << "  ESC - Exit" << std::endl;
-    std::cout << "=================================" << std::endl;
+        case SCALE: modeName = "SCALE"; break;
+        case ROTATE: modeName = "ROTATE"; break;
+        case TRANSLATE: modeName = "TRANSLATE"; break;
+    }
+    logInfo("Current Mode: %s", modeName);
+
+    logInfo("\nTransformation Values:");
+    const float* scale = scene.scale(cubeNode);
+    const float* translation = scene.translation(cubeNode);
+    float axis[3], angle;
+    quatToAxisAngle(targetOrientation, axis, &angle);
+    logInfo("Scale:     X=%g Y=%g Z=%g", scale[0], scale[1], scale[2]);
+    logInfo("Rotation:  %g° about (%.2f, %.2f, %.2f)", angle / DEG_TO_RAD, axis[0], axis[1], axis[2]);
+    logInfo("Translate: X=%g Y=%g Z=%g", translation[0], translation[1], translation[2]);
+
+    logInfo("\nDelta Values:");
+    logInfo("Scale Delta: %g", scaleDelta);
+    logInfo("Rotate Delta: %g°", rotateDelta);
+    logInfo("Translate Delta: %g", translateDelta);
+
+    logInfo("\nCONTROLS:");
+    logInfo("Mode Selection:");
+    logInfo("  1 - SCALE mode");
+    logInfo("  2 - ROTATE mode");
+    logInfo("  3 - TRANSLATE mode");
+
+    logInfo("\nAxis Controls:");
+    logInfo("  X/x - Increase/Decrease X component (rotate about the X axis)");
+    logInfo("  Y/y - Increase/Decrease Y component (rotate about the Y axis)");
+    logInfo("  Z/z - Increase/Decrease Z component (rotate about the Z axis)");
+
+    logInfo("\nDelta Controls:");
+    logInfo("  + - Increase delta for current transformation");
+    logInfo("  - - Decrease delta for current transformation");
+
+    logInfo("\nCamera:");
+    logInfo("  Arrow keys - Orbit around the cube");
+    logInfo("  Page Up/Page Down - Move closer/farther");
+
+    logInfo("\nOther Controls:");
+    logInfo("  R - Reset all transformations");
+    logInfo("  M - Show this menu");
+    logInfo("  ESC - Exit");
+    logInfo("=================================");
 }
 
-void processInput(GLFWwindow* window) {
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-        glfwSetWindowShouldClose(window, true);
+// Changes one component (0 = X, 1 = Y, 2 = Z) of the current transformation
+void adjustAxis(int axis, bool decrease) {
+    const char* axisName = axis == 0 ? "X" : axis == 1 ? "Y" : "Z";
+    float value[3];
+
+    if (currentMode == SCALE) {
+        const float* scale = scene.scale(cubeNode);
+        for (int i = 0; i < 3; i++) value[i] = scale[i];
+        if (decrease) value[axis] = std::max(0.1f, value[axis] - scaleDelta);
+        else value[axis] += scaleDelta;
+        scene.setScale(cubeNode, value[0], value[1], value[2]);
+        logInfo("Scale %s: %g", axisName, value[axis]);
+    }
+    else if (currentMode == ROTATE) {
+        // Rotate about the world axis on top of the current target, so steps
+        // compose without gimbal lock whatever the order
+        float worldAxis[3] = {0.0f, 0.0f, 0.0f};
+        worldAxis[axis] = 1.0f;
+        float delta = decrease ? -rotateDelta : rotateDelta;
+        Quat step = quatFromAxisAngle(worldAxis[0], worldAxis[1], worldAxis[2], delta * DEG_TO_RAD);
+        targetOrientation = quatNormalize(quatMultiply(step, targetOrientation));
+
+        // Start from whatever is on screen, even mid-animation
+        cubeRotation.begin(scene.rotation(cubeNode), targetOrientation, frameTime, ROTATION_ANIMATION_TIME);
+        rotationAnimating = true;
+        logInfo("Rotate %s: %+g°", axisName, delta);
+    }
+    else if (currentMode == TRANSLATE) {
+        const float* translation = scene.translation(cubeNode);
+        for (int i = 0; i < 3; i++) value[i] = translation[i];
+        if (decrease) value[axis] -= translateDelta;
+        else value[axis] += translateDelta;
+        scene.setTranslation(cubeNode, value[0], value[1], value[2]);
+        logInfo("Translate %s: %g", axisName, value[axis]);
+    }
+}
+
+// Applies one key trigger (a press or a timed repeat)
+void handleKey(GLFWwindow* window, int key, bool shiftPressed) {
+    if (key == GLFW_KEY_ESCAPE) {
+        if (window) glfwSetWindowShouldClose(window, true);
+        else quitRequested = true;
+    }
 
     // Mode selection
-    if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS) {
+    if (key == GLFW_KEY_1) {
         currentMode = SCALE;
-        std::cout << "Mode changed to: SCALE" << std::endl;
+        logInfo("Mode changed to: SCALE");
     }
-    if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS) {
+    if (key == GLFW_KEY_2) {
         currentMode = ROTATE;
-        std::cout << "Mode changed to: ROTATE" << std::endl;
+        logInfo("Mode changed to: ROTATE");
     }
-    if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS) {
+    if (key == GLFW_KEY_3) {
         currentMode = TRANSLATE;
-        std::cout << "Mode changed to: TRANSLATE" << std::endl;
+        logInfo("Mode changed to: TRANSLATE");
     }
 
     // Axis controls (with shift for decrease)
-    bool shiftPressed = (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS ||
-                        glfwGetKey(window, GLFW_KEY_RIGHT_SHIFT) == GLFW_PRESS);
-
-    // X axis
-    if (glfwGetKey(window, GLFW_KEY_X) == GLFW_PRESS) {
-        if (currentMode == SCALE) {
-            if (shiftPressed) scaleX = std::max(0.1f, scaleX - scaleDelta);
-            else scaleX += scaleDelta;
-            std::cout << "Scale X: " << scaleX << std::endl;
-        }
-        else if (currentMode == ROTATE) {
-            if (shiftPressed) rotateX -= rotateDelta;
-            else rotateX += rotateDelta;
-            // Keep rotation within 0-360 degrees
-            if (rotateX >= 360.0f) rotateX -= 360.0f;
-            if (rotateX < 0.0f) rotateX += 360.0f;
-            std::cout << "Rotate X: " << rotateX << "°" << std::endl;
-        }
-        else if (currentMode == TRANSLATE) {
-            if (shiftPressed) translateX -= translateDelta;
-            else translateX += translateDelta;
-            std::cout << "Translate X: " << translateX << std::endl;
-        }
-    }
-
-    // Y axis
-    if (glfwGetKey(window, GLFW_KEY_Y) == GLFW_PRESS) {
-        if (currentMode == SCALE) {
-            if (shiftPressed) scaleY = std::max(0.1f, scaleY - scaleDelta);
-            else scaleY += scaleDelta;
-            std::cout << "Scale Y: " << scaleY << std::endl;
-        }
-        else if (currentMode == ROTATE) {
-            if (shiftPressed) rotateY -= rotateDelta;
-            else rotateY += rotateDelta;
-            if (rotateY >= 360.0f) rotateY -= 360.0f;
-            if (rotateY < 0.0f) rotateY += 360.0f;
-            std::cout << "Rotate Y: " << rotateY << "°" << std::endl;
-        }
-        else if (currentMode == TRANSLATE) {
-            if (shiftPressed) translateY -= translateDelta;
-            else translateY += translateDelta;
-            std::cout << "Translate Y: " << translateY << std::endl;
-        }
-    }
-
-    // Z axis
-    if (glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS) {
-        if (currentMode == SCALE) {
-            if (shiftPressed) scaleZ = std::max(0.1f, scaleZ - scaleDelta);
-            else scaleZ += scaleDelta;
-            std::cout << "Scale Z: " << scaleZ << std::endl;
-        }
-        else if (currentMode == ROTATE) {
-            if (shiftPressed) rotateZ -= rotateDelta;
-            else rotateZ += rotateDelta;
-            if (rotateZ >= 360.0f) rotateZ -= 360.0f;
-            if (rotateZ < 0.0f) rotateZ += 360.0f;
-            std::cout << "Rotate Z: " << rotateZ << "°" << std::endl;
-        }
-        else if (currentMode == TRANSLATE) {
-            if (shiftPressed) translateZ -= translateDelta;
-            else translateZ += translateDelta;
-            std::cout << "Translate Z: " << translateZ << std::endl;
-        }
-    }
+    if (key == GLFW_KEY_X) adjustAxis(0, shiftPressed);
+    if (key == GLFW_KEY_Y) adjustAxis(1, shiftPressed);
+    if (key == GLFW_KEY_Z) adjustAxis(2, shiftPressed);
 
     // Delta controls
-    if (glfwGetKey(window, GLFW_KEY_EQUAL) == GLFW_PRESS ||
-        glfwGetKey(window, GLFW_KEY_KP_ADD) == GLFW_PRESS) {
+    if (key == GLFW_KEY_EQUAL || key == GLFW_KEY_KP_ADD) {
         if (currentMode == SCALE) {
             scaleDelta += 0.01f;
-            std::cout << "Scale Delta increased to: " << scaleDelta << std::endl;
+            logInfo("Scale Delta increased to: %g", scaleDelta);
         }
         else if (currentMode == ROTATE) {
             rotateDelta += 1.0f;
-            std::cout << "Rotate Delta increased to: " << rotateDelta << "°" << std::endl;
+            logInfo("Rotate Delta increased to: %g°", rotateDelta);
         }
         else if (currentMode == TRANSLATE) {
             translateDelta += 0.01f;
-            std::cout << "Translate Delta increased to: " << translateDelta << std::endl;
+            logInfo("Translate Delta increased to: %g", translateDelta);
         }
     }
 
-    if (glfwGetKey(window, GLFW_KEY_MINUS) == GLFW_PRESS ||
-        glfwGetKey(window, GLFW_KEY_KP_SUBTRACT) == GLFW_PRESS) {
+    if (key == GLFW_KEY_MINUS || key == GLFW_KEY_KP_SUBTRACT) {
         if (currentMode == SCALE) {
             scaleDelta = std::max(0.01f, scaleDelta - 0.01f);
-            std::cout << "Scale Delta decreased to: " << scaleDelta << std::endl;
+            logInfo("Scale Delta decreased to: %g", scaleDelta);
         }
         else if (currentMode == ROTATE) {
             rotateDelta = std::max(1.0f, rotateDelta - 1.0f);
-            std::cout << "Rotate Delta decreased to: " << rotateDelta << "°" << std::endl;
+            logInfo("Rotate Delta decreased to: %g°", rotateDelta);
         }
         else if (currentMode == TRANSLATE) {
             translateDelta = std::max(0.01f, translateDelta - 0.01f);
-            std::cout << "Translate Delta decreased to: " << translateDelta << std::endl;
+            logInfo("Translate Delta decreased to: %g", translateDelta);
         }
     }
 
+    // Camera
+    if (key == GLFW_KEY_LEFT) cameraYaw -= CAMERA_STEP;
+    if (key == GLFW_KEY_RIGHT) cameraYaw += CAMERA_STEP;
+    if (key == GLFW_KEY_UP) cameraPitch = std::min(cameraPitch + CAMERA_STEP, 89.0f);
+    if (key == GLFW_KEY_DOWN) cameraPitch = std::max(cameraPitch - CAMERA_STEP, -89.0f);
+    if (key == GLFW_KEY_PAGE_UP) cameraDistance = std::max(cameraDistance * 0.9f, 0.5f);
+    if (key == GLFW_KEY_PAGE_DOWN) cameraDistance = std::min(cameraDistance / 0.9f, 50.0f);
+
     // Reset all transformations
-    if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS) {
-        scaleX = scaleY = scaleZ = 1.0f;
-        rotateX = rotateY = rotateZ = 0.0f;
-        translateX = translateY = translateZ = 0.0f;
-        std::cout << "All transformations reset" << std::endl;
+    if (key == GLFW_KEY_R) {
+        scene.setScale(cubeNode, 1.0f, 1.0f, 1.0f);
+        targetOrientation = quatIdentity();
+        rotationAnimating = false;
+        scene.setRotation(cubeNode, targetOrientation);
+        scene.setTranslation(cubeNode, 0.0f, 0.0f, 0.0f);
+        logInfo("All transformations reset");
     }
 
     // Show menu
-    if (glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS) {
+    if (key == GLFW_KEY_M) {
         printMenu();
     }
 }
 
-// Matrix transformation functions
-void scaleMatrix(float* matrix, float sx, float sy, float sz) {
-    float temp[] = {
-        sx, 0.0f, 0.0f, 0.0f,
-        0.0f, sy, 0.0f, 0.0f,
-        0.0f, 0.0f, sz, 0.0f,
-        0.0f, 0.0f, 0.0f, 1.0f
-    };
-    for (int i = 0; i < 16; i++) matrix[i] = temp[i];
-}
-
-void rotateXMatrix(float* matrix, float angle) {
-    float cosA = cos(angle);
-    float sinA = sin(angle);
-    float temp[] = {
-        1.0f, 0.0f, 0.0f, 0.0f,
-        0.0f, cosA, -sinA, 0.0f,
-        0.0f, sinA, cosA, 0.0f,
-        0.0f, 0.0f, 0.0f, 1.0f
-    };
-    for (int i = 0; i < 16; i++) matrix[i] = temp[i];
-}
-
-void rotateYMatrix(float* matrix, float angle) {
-    float cosA = cos(angle);
-    float sinA = sin(angle);
-    float temp[] = {
-        cosA, 0.0f, sinA, 0.0f,
-        0.0f, 1.0f, 0.0f, 0.0f,
-        -sinA, 0.0f, cosA, 0.0f,
-        0.0f, 0.0f, 0.0f, 1.0f
-    };
-    for (int i = 0; i < 16; i++) matrix[i] = temp[i];
+// Advances the rotate-step animation; the node is only touched while it runs
+void updateOrientation(double now) {
+    if (!rotationAnimating) return;
+    scene.setRotation(cubeNode, cubeRotation.sample(now));
+    if (!cubeRotation.active(now)) rotationAnimating = false;
 }
 
-void rotateZMatrix(float* matrix, float angle) {
-    float cosA = cos(angle);
-    float sinA = sin(angle);
-    float temp[] = {
-        cosA, -sinA, 0.0f, 0.0f,
-        sinA, cosA, 0.0f, 0.0f,
-        0.0f, 0.0f, 1.0f, 0.0f,
-        0.0f, 0.0f, 0.0f, 1.0f
-    };
-    for (int i = 0; i < 16; i++) matrix[i] = temp[i];
+void processInput(GLFWwindow* window) {
+    input.update(frameTime);
+    for (const KeyTrigger& trigger : input.triggers()) {
+        handleKey(window, trigger.key, (trigger.mods & GLFW_MOD_SHIFT) != 0);
+    }
+    updateOrientation(frameTime);
 }
 
-void translateMatrix(float* matrix, float tx, float ty, float tz) {
-    float temp[] = {
-        1.0f, 0.0f, 0.0f, tx,
-        0.0f, 1.0f, 0.0f, ty,
-        0.0f, 0.0f, 1.0f, tz,
-        0.0f, 0.0f, 0.0f, 1.0f
-    };
-    for (int i = 0; i < 16; i++) matrix[i] = temp[i];
+// Key callback: events are stamped with the recorded time while recording
+void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    if (action == GLFW_REPEAT) return;
+    if (action == GLFW_PRESS) latency.inputDelivered();
+    double time = session.recordKey(0, key, action, mods, glfwGetTime());
+    input.pushEvent(key, action, mods, time);
 }
 
-void multiplyMatrix(float* result, const float* a, const float* b) {
-    for (int i = 0; i < 4; i++)
-        for (int j = 0; j < 4; j++) {
-            result[i * 4 + j] = 0;
-            for (int k = 0; k < 4; k++)
-                result[i * 4 + j] += a[i * 4 + k] * b[k * 4 + j];
-        }
+// Polls window events; during a replay the recorded keys of this frame are fed in instead
+void pollEvents() {
+    if (!windowless) glfwPollEvents();
+    ReplayEvent event;
+    while (session.nextEvent(event)) {
+        if (event.type == REPLAY_KEY) input.pushEvent(event.code, event.action, event.mods, event.time);
+    }
 }
 
-void identityMatrix(float* matrix) {
-    for (int i = 0; i < 16; i++) matrix[i] = 0.0f;
-    for (int i = 0; i < 4; i++) matrix[i * 4 + i] = 1.0f;
+// Seconds since startup; GLFW's clock when there is a window
+double currentTime() {
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (!windowless) return glfwGetTime();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 }
 
-int main() {
+GLFWwindow* createWindow(bool hidden) {
     // Initialize GLFW
     if (!glfwInit()) {
         std::cerr << "Failed to initialize GLFW" << std::endl;
-        return -1;
+        return nullptr;
     }
 
     // Configure GLFW
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    if (hidden) glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
     // Create window
     GLFWwindow* window = glfwCreateWindow(800, 600, "3D Cube Transformations", NULL, NULL);
     if (!window) {
         std::cerr << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
-        return -1;
+        return nullptr;
     }
     glfwMakeContextCurrent(window);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    return window;
+}
 
-    // Initialize GLEW
-    if (glewInit() != GLEW_OK) {
-        std::cerr << "Failed to initialize GLEW" << std::endl;
-        return -1;
-    }
+// MeshKind of every scene node, see nodeShapes
+void collectNodeShapes() {
+    nodeShapes.assign(scene.nodeCount(), -1);
+    world.forEach(MaskOf<Transform, Renderable>::value, [&](Archetype& a) {
+        for (size_t i = 0; i < a.size(); i++) nodeShapes[a.transforms[i].node] = a.renderables[i].shape;
+    });
+}
 
+bool createGlResources(bool allowMultiDraw, bool allowGpuCulling, bool allowOcclusion) {
     // Enable depth testing
     glEnable(GL_DEPTH_TEST);
 
-    // Print initial instructions
-    printMenu();
+    for (int kind = 0; kind < MESH_KIND_COUNT; kind++) meshRenderer.addMesh(meshes[kind]);
+    if (!meshRenderer.init()) return false;
+    occlusionCulling = allowOcclusion;
+    if (occlusionCulling) {
+        occlusion.init(scene.nodeCount());
+        return true;
+    }
+    multiDrawIndirect = allowMultiDraw && meshRenderer.multiDrawSupported();
 
-    // Compile shaders
-    unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-    glCompileShader(vertexShader);
-
-    unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-    glCompileShader(fragmentShader);
-
-    unsigned int shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
-
-    // Setup buffers
-    unsigned int VBO, VAO, EBO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
+    // Every node of this scene is drawn, so nodes are the GPU objects one to one
+    if (allowGpuCulling) {
+        collectNodeShapes();
+        gpuCulling.init(meshRenderer, nodeShapes.data(), nodeShapes.size(), meshBounds);
+    }
+    return true;
+}
 
-    // Main loop
-    while (!glfwWindowShouldClose(window)) {
-        processInput(window);
+// Extra objects for --objects: a square grid of small meshes of every kind on
+// a floor below the cube, one unit apart, so most of a large grid is out of view
+void createObjects(int count) {
+    if (count <= 0) return;
+    ComponentMask mask = MaskOf<Transform, Renderable>::value;
+    world.reserve(mask, count);
+    scene.reserve(count);
+    int side = (int)std::ceil(std::sqrt((double)count));
+    float offset = 0.5f * (side - 1);
+    for (int i = 0; i < count; i++) {
+        Entity object = world.create(mask);
+        int node = scene.createNode();
+        world.get<Transform>(object).node = node;
+        world.get<Renderable>(object).shape = i % MESH_KIND_COUNT;
+        scene.setTranslation(node, i % side - offset, -1.0f, i / side - offset);
+        scene.setScale(node, 0.4f, 0.4f, 0.4f);
+        scene.setRotationEuler(node, 37.0f * i, 23.0f * i, 0.0f);
+    }
+}
+
+void updateCamera(int width, int height) {
+    float projection[16], view[16];
+    perspectiveMatrix(projection, CAMERA_FOV * DEG_TO_RAD, (float)width / std::max(height, 1), CAMERA_NEAR,
+                      CAMERA_FAR);
+    float yaw = cameraYaw * DEG_TO_RAD, pitch = cameraPitch * DEG_TO_RAD;
+    float eye[3] = {cameraDistance * std::cos(pitch) * std::sin(yaw), cameraDistance * std::sin(pitch),
+                    cameraDistance * std::cos(pitch) * std::cos(yaw)};
+    const float target[3] = {0.0f, 0.0f, 0.0f}, up[3] = {0.0f, 1.0f, 0.0f};
+    lookAtMatrix(view, eye, target, up);
+    multiplyMatrix(viewProjection, projection, view);
+}
+
+// Keeps the BVH in step with the scene: a full build when nodes were added,
+// otherwise a refit for the nodes the last updateWorld() moved
+void updateBounds() {
+    if (bvh.objectCount() != (size_t)scene.nodeCount()) {
+        collectNodeShapes();
+        std::vector<Aabb> bounds(nodeShapes.size(), emptyAabb());
+        for (size_t node = 0; node < bounds.size(); node++) {
+            int shape = nodeShapes[node];
+            if (shape >= 0) transformAabb(scene.worldMatrix((int)node), meshBounds[shape], bounds[node]);
+        }
+        bvh.build(bounds.data(), bounds.size());
+        visibleNodes.reserve(bounds.size());
+        return;
+    }
+    for (int i = scene.changedBegin(); i < scene.changedEnd(); i++) {
+        if (!scene.worldChangedAt(i)) continue;
+        const SceneNode& n = scene.nodeAt(i);
+        if (nodeShapes[n.handle] < 0) continue;
+        Aabb box;
+        transformAabb(n.world, meshBounds[nodeShapes[n.handle]], box);
+        bvh.update(n.handle, box);
+    }
+}
+
+// Hands the nodes the last updateWorld() moved to the GPU culling pass
+void updateGpuObjects() {
+    for (int i = scene.changedBegin(); i < scene.changedEnd(); i++) {
+        if (scene.worldChangedAt(i)) gpuCulling.setTransform(scene.nodeAt(i).handle, scene.nodeAt(i).world);
+    }
+}
+
+// Queues the objects in the view frustum; the depth is the view distance of
+// their center. Occlusion culling needs the whole queue front to back, so the
+// mesh moves behind the depth in the key. The keys are computed in parallel,
+// each job filling its own part of the queue.
+void queueObjects() {
+    renderQueue.clear();
+    Frustum frustum;
+    frustumFromMatrix(viewProjection, frustum);
+    visibleNodes.clear();
+    bvh.cull(frustum, visibleNodes);
+    DrawItem* items = renderQueue.append(visibleNodes.size());
+    jobs.parallelFor(0, visibleNodes.size(), ITEMS_PER_JOB, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            int node = visibleNodes[i];
+            const float* m = scene.worldMatrix(node);
+            float distance = viewProjection[12] * m[3] + viewProjection[13] * m[7] + viewProjection[14] * m[11] +
+                             viewProjection[15];
+            uint32_t depth = depthSortBits(distance / CAMERA_FAR);
+            int shape = nodeShapes[node];
+            items[i].key = occlusionCulling ? makeSortKey(0, PROGRAM_MESH, 0, depth, shape)
+                                            : makeSortKey(0, PROGRAM_MESH, shape, depth, 0);
+            items[i].object = node;
+        }
+    });
+}
+
+// Records a part of the sorted queue: the state changes, and every object's
+// world matrix followed by its draw
+class MeshCommandRecorder : public RenderSubmitter {
+public:
+    explicit MeshCommandRecorder(CommandList& list) : list(list) {}
+
+    void bindProgram(unsigned program) override { list.bindProgram(program); }
+    void bindVertexArray(unsigned mesh) override { list.bindVertexArray(mesh); }
+    void bindMaterial(unsigned material) override { list.bindMaterial(material); }
+
+    void draw(const DrawItem* items, size_t count) override {
+        for (size_t i = 0; i < count; i++) {
+            list.setTransform(scene.worldMatrix(items[i].object));
+            list.draw(items[i].object);
+        }
+    }
+
+private:
+    CommandList& list;
+};
+
+// Sorts the queue and records it into command lists on the worker threads
+void recordCommands() {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    renderQueue.sort();
+    commandLists.record(jobs, renderQueue.size(), ITEMS_PER_JOB, [](CommandList& list, size_t begin, size_t end) {
+        MeshCommandRecorder recorder(list);
+        RenderQueueStats stats = {};
+        renderQueue.submitItems(begin, end, recorder, stats);
+        std::lock_guard<std::mutex> lock(queueStatsMutex);
+        renderQueue.addStats(stats);
+    });
+    recordSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    recordFrames++;
+}
+
+// One draw call per object; the program and vertex array are only bound once
+// per command list
+class DirectMeshExecutor : public CommandExecutor {
+public:
+    void bindProgram(unsigned) override { meshRenderer.beginDirect(); }
+    void bindVertexArray(unsigned mesh) override { currentMesh = mesh; }
+    void bindMaterial(unsigned) override {}
+    void setTransform(const float* matrix) override { transform = matrix; }
+    void setColor(const float*) override {}
+    void draw(uint32_t) override { meshRenderer.drawDirect(currentMesh, transform); }
+    void drawVertices(const float*, size_t) override {}
+
+private:
+    int currentMesh = 0;
+    const float* transform = nullptr;
+};
+
+// Collects indirect commands in queue order; the caller flushes them as one draw
+class IndirectMeshExecutor : public CommandExecutor {
+public:
+    void bindProgram(unsigned) override {}
+    void bindVertexArray(unsigned mesh) override { currentMesh = mesh; }
+    void bindMaterial(unsigned) override {}
+    void setTransform(const float* matrix) override { transform = matrix; }
+    void setColor(const float*) override {}
+    void draw(uint32_t) override { meshRenderer.addIndirect(currentMesh, transform); }
+    void drawVertices(const float*, size_t) override {}
+
+private:
+    int currentMesh = 0;
+    const float* transform = nullptr;
+};
+
+// One draw call per object in front-to-back order (the mesh is the material);
+// meshes dearer than their box get a box query and a conditional draw
+class OcclusionMeshExecutor : public CommandExecutor {
+public:
+    void bindProgram(unsigned) override { meshRenderer.beginDirect(); }
+    void bindVertexArray(unsigned) override {}
+    void bindMaterial(unsigned mesh) override {
+        currentMesh = mesh;
+        tested = meshRenderer.meshCommand(mesh, 0, 0).count > meshRenderer.meshCommand(MESH_CUBE, 0, 0).count;
+    }
+    void setTransform(const float* matrix) override { transform = matrix; }
+    void setColor(const float*) override {}
+    void drawVertices(const float*, size_t) override {}
+
+    void draw(uint32_t object) override {
+        if (!tested) {
+            meshRenderer.drawDirect(currentMesh, transform);
+            return;
+        }
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+        GLuint query = occlusion.begin(object);
+        meshRenderer.drawDirect(MESH_CUBE, transform);
+        occlusion.end();
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthMask(GL_TRUE);
+
+        // The GPU waits for the box here, the CPU does not: with NO_WAIT the result is rarely
+        // ready this soon on a real GPU and the mesh would nearly always be drawn anyway
+        glBeginConditionalRender(query, GL_QUERY_WAIT);
+        meshRenderer.drawDirect(currentMesh, transform);
+        glEndConditionalRender();
+    }
 
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+private:
+    int currentMesh = 0;
+    bool tested = false;
+    const float* transform = nullptr;
+};
 
-        glUseProgram(shaderProgram);
+class SoftMeshExecutor : public CommandExecutor {
+public:
+    void bindProgram(unsigned) override {}
+    void bindVertexArray(unsigned mesh) override { currentMesh = mesh; }
+    void bindMaterial(unsigned) override {}
+    void setColor(const float*) override {}
+    void drawVertices(const float*, size_t) override {}
 
-        // Create transformation matrix in order: scale -> rotation -> translation
+    void setTransform(const float* matrix) override {
         float transform[16];
-        float scaleMat[16], rotateXMat[16], rotateYMat[16], rotateZMat[16], translateMat[16];
-        float temp1[16], temp2[16], temp3[16];
+        multiplyMatrix(transform, viewProjection, matrix);
+        softRenderer.setTransform(transform);
+    }
 
-        // Start with identity
-        identityMatrix(transform);
+    void draw(uint32_t) override {
+        const SoftVertexFormat format = {MESH_VERTEX_FLOATS, 3, 3}; // position, color
+        const MeshData& mesh = meshes[currentMesh];
+        softRenderer.drawIndexedTriangles(mesh.vertices.data(), format, mesh.indices.data(), mesh.indices.size());
+    }
 
-        // 1. Scale
-        scaleMatrix(scaleMat, scaleX, scaleY, scaleZ);
-        multiplyMatrix(temp1, scaleMat, transform);
+private:
+    int currentMesh = 0;
+};
 
-        // 2. Rotation (X -> Y -> Z)
-        rotateXMatrix(rotateXMat, rotateX * 3.14159f / 180.0f);
-        multiplyMatrix(temp2, rotateXMat, temp1);
+void drawCubesGl() {
+    glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    meshRenderer.setViewProjection(viewProjection);
+    if (gpuCulling.ready()) {
+        gpuCulling.draw(viewProjection);
+    } else if (occlusionCulling) {
+        OcclusionMeshExecutor executor;
+        occlusion.beginFrame();
+        commandLists.execute(executor);
+    } else if (multiDrawIndirect) {
+        IndirectMeshExecutor executor;
+        meshRenderer.beginIndirect();
+        commandLists.execute(executor);
+        meshRenderer.flushIndirect();
+    } else {
+        DirectMeshExecutor executor;
+        commandLists.execute(executor);
+    }
+    submitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    submitFrames++;
+}
 
-        rotateYMatrix(rotateYMat, rotateY * 3.14159f / 180.0f);
-        multiplyMatrix(temp3, rotateYMat, temp2);
+void drawCubesSoft(int width, int height) {
+    softRenderer.resize(width, height);
+    softRenderer.setDepthTest(true);
+    softRenderer.setClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+    softRenderer.clear(true, true);
 
-        rotateZMatrix(rotateZMat, rotateZ * 3.14159f / 180.0f);
-        multiplyMatrix(temp1, rotateZMat, temp3);
+    SoftMeshExecutor executor;
+    commandLists.execute(executor);
+    softRenderer.flush(&jobs);
+}
 
-        // 3. Translation
-        translateMatrix(translateMat, translateX, translateY, translateZ);
-        multiplyMatrix(transform, translateMat, temp1);
+// Snapshots (--load-snapshot, --save-snapshot), see snapshot.h: the cube's
+// transform, the deltas and mode, and the camera. The --objects scene is
+// rebuilt from its count, so it is not saved.
+const uint32_t CUBE_SNAPSHOT_KIND = 2;
+enum CubeSnapshotColumn : uint32_t {
+    CUBE_COLUMN_TRANSFORM, // one CubeSnapshotTransform
+    CUBE_COLUMN_CONTROLS,  // one CubeSnapshotControls
+    CUBE_COLUMN_CAMERA     // one CubeSnapshotCamera
+};
 
-        // Pass transformation to shader
-        int transformLoc = glGetUniformLocation(shaderProgram, "transform");
-        glUniformMatrix4fv(transformLoc, 1, GL_FALSE, transform);
+struct CubeSnapshotTransform {
+    Quat rotation; // where a running rotate step ends
+    float scale[3];
+    float translation[3];
+};
 
-        // Draw cube
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+struct CubeSnapshotControls {
+    float scaleDelta, rotateDelta, translateDelta;
+    uint32_t mode; // TransformMode
+};
+
+struct CubeSnapshotCamera {
+    float yaw, pitch, distance;
+};
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+bool saveCubeSnapshot(const char* path) {
+    CubeSnapshotTransform transform;
+    transform.rotation = targetOrientation;
+    for (int i = 0; i < 3; i++) {
+        transform.scale[i] = scene.scale(cubeNode)[i];
+        transform.translation[i] = scene.translation(cubeNode)[i];
     }
+    CubeSnapshotControls controls = {scaleDelta, rotateDelta, translateDelta, (uint32_t)currentMode};
+    CubeSnapshotCamera camera = {cameraYaw, cameraPitch, cameraDistance};
+
+    SnapshotWriter writer(CUBE_SNAPSHOT_KIND);
+    writer.addColumn(CUBE_COLUMN_TRANSFORM, &transform, 1);
+    writer.addColumn(CUBE_COLUMN_CONTROLS, &controls, 1);
+    writer.addColumn(CUBE_COLUMN_CAMERA, &camera, 1);
+    if (!writer.write(path)) return false;
+    logInfo("Saved snapshot %s", path);
+    return true;
+}
+
+bool loadCubeSnapshot(const char* path) {
+    SnapshotFile file;
+    if (!file.open(path, CUBE_SNAPSHOT_KIND)) return false;
+
+    size_t count;
+    const CubeSnapshotTransform* transform = file.column<CubeSnapshotTransform>(CUBE_COLUMN_TRANSFORM, count);
+    if (count == 1) {
+        targetOrientation = quatNormalize(transform->rotation);
+        rotationAnimating = false;
+        scene.setRotation(cubeNode, targetOrientation);
+        scene.setScale(cubeNode, transform->scale[0], transform->scale[1], transform->scale[2]);
+        scene.setTranslation(cubeNode, transform->translation[0], transform->translation[1], transform->translation[2]);
+    }
+    const CubeSnapshotControls* controls = file.column<CubeSnapshotControls>(CUBE_COLUMN_CONTROLS, count);
+    if (count == 1) {
+        scaleDelta = controls->scaleDelta;
+        rotateDelta = controls->rotateDelta;
+        translateDelta = controls->translateDelta;
+        if (controls->mode <= TRANSLATE) currentMode = (TransformMode)controls->mode;
+    }
+    const CubeSnapshotCamera* camera = file.column<CubeSnapshotCamera>(CUBE_COLUMN_CAMERA, count);
+    if (count == 1) {
+        cameraYaw = camera->yaw;
+        cameraPitch = std::max(-89.0f, std::min(camera->pitch, 89.0f));
+        cameraDistance = std::max(0.5f, std::min(camera->distance, 50.0f));
+    }
+    logInfo("Loaded snapshot %s", path);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    DemoOptions options;
+    if (!parseDemoOptions(argc, argv, options)) return -1;
+    logStart();
+    jobs.start();
+
+    softwareRendering = options.softwareRenderer;
+    windowless = softwareRendering && options.headless;
+    GLFWwindow* window = nullptr;
+    if (!windowless) {
+        window = createWindow(options.headless);
+        if (!window) return -1;
+    }
+
+    // While replaying, keys only come from the recording
+    if (options.replayPath) {
+        if (!session.startReplay(options.replayPath, !options.maxSpeed)) {
+            if (window) glfwTerminate();
+            return -1;
+        }
+    } else {
+        if (options.recordPath && !session.startRecording(options.recordPath, 0)) {
+            if (window) glfwTerminate();
+            return -1;
+        }
+        if (window) glfwSetKeyCallback(window, keyCallback);
+    }
+    if (window) applySwapInterval(options.swapMode);
+    pacer.setTargetFps(options.targetFps);
+
+    // Keyboard input; X/Y/Z, +/- and the camera keys keep adjusting while held
+    input.setRepeat(KEY_REPEAT_DELAY, KEY_REPEAT_RATE);
+    const int repeatKeys[] = {GLFW_KEY_X, GLFW_KEY_Y, GLFW_KEY_Z, GLFW_KEY_EQUAL, GLFW_KEY_KP_ADD,
+                              GLFW_KEY_MINUS, GLFW_KEY_KP_SUBTRACT, GLFW_KEY_LEFT, GLFW_KEY_RIGHT,
+                              GLFW_KEY_UP, GLFW_KEY_DOWN, GLFW_KEY_PAGE_UP, GLFW_KEY_PAGE_DOWN};
+    for (int key : repeatKeys) input.enableRepeat(key);
+
+    // Initialize GLEW
+    if (window && glewInit() != GLEW_OK) {
+        std::cerr << "Failed to initialize GLEW" << std::endl;
+        return -1;
+    }
+
+    // Software frames are captured straight from the CPU image
+    if (options.capturePath) capture.start(options.capturePath, 60, !softwareRendering);
+
+    cubeEntity = world.create(MaskOf<Transform, Renderable>::value);
+    cubeNode = scene.createNode();
+    world.get<Transform>(cubeEntity).node = cubeNode;
+    world.get<Renderable>(cubeEntity).shape = MESH_CUBE;
+    for (int kind = 0; kind < MESH_KIND_COUNT; kind++) {
+        buildMesh(kind, meshes[kind]);
+        meshBounds[kind] = emptyAabb();
+        for (size_t v = 0; v < meshes[kind].vertexCount(); v++) {
+            const float* position = &meshes[kind].vertices[v * MESH_VERTEX_FLOATS];
+            for (int axis = 0; axis < 3; axis++) {
+                meshBounds[kind].min[axis] = std::min(meshBounds[kind].min[axis], position[axis]);
+                meshBounds[kind].max[axis] = std::max(meshBounds[kind].max[axis], position[axis]);
+            }
+        }
+    }
+    createObjects(options.objectCount);
+    if (options.loadPath) loadCubeSnapshot(options.loadPath);
+
+    // Print initial instructions
+    printMenu();
+
+    if (!softwareRendering) {
+        if (!createGlResources(options.multiDraw, options.gpuCulling, options.occlusionCulling)) {
+            glfwTerminate();
+            return -1;
+        }
+        if (options.frameBudgetMs > 0.0 && !resolution.init(options.frameBudgetMs, options.sharpenUpscale)) {
+            logError("Dynamic resolution unavailable, rendering at full size");
+        }
+    } else if (window) {
+        softPresenter.init();
+    }
+    lowLatency = options.lowLatency;
+    if (window) {
+        if (!frameFences.init(options.framesInFlight)) logWarning("Fences not supported, frames in flight not limited");
+        latency.init(true);
+    }
+    logInfo("Renderer: %s", softwareRendering ? (window ? "software" : "software, no window")
+                                              : gpuCulling.ready() ? "OpenGL, GPU culling"
+                                              : occlusionCulling   ? "OpenGL, occlusion queries"
+                                              : (multiDrawIndirect ? "OpenGL, multi-draw indirect" : "OpenGL"));
+
+    // Main loop
+    while (window ? !glfwWindowShouldClose(window) : !quitRequested) {
+        // Events polled before beginFrame still belong to the previous frame of
+        // a recording, as they do when polled after the swap, so recordings
+        // replay the same in both modes
+        frameFences.waitForFrame();
+        if (lowLatency) pollEvents();
+        if (!session.beginFrame(currentTime(), &frameTime)) break; // replay finished
+        allocationStats.beginFrame();
+        processInput(window);
+
+        // Transformation matrices (scale -> rotation -> translation), recomputed only when changed
+        scene.updateWorld(&jobs);
+        if (gpuCulling.ready()) updateGpuObjects();
+        else updateBounds();
+
+        int fbWidth = WINDOWLESS_WIDTH, fbHeight = WINDOWLESS_HEIGHT;
+        if (window) glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+        updateCamera(fbWidth, fbHeight);
+        if (!gpuCulling.ready()) {
+            queueObjects();
+            recordCommands();
+        }
+        if (softwareRendering) {
+            drawCubesSoft(fbWidth, fbHeight);
+            capture.captureImage((const uint8_t*)softRenderer.pixels(), softRenderer.width(), softRenderer.height(),
+                                 (size_t)softRenderer.rowPitch() * 4);
+            if (window) softPresenter.present(softRenderer, fbWidth, fbHeight);
+        } else {
+            if (resolution.ready()) resolution.beginScene(fbWidth, fbHeight);
+            drawCubesGl();
+            if (resolution.ready()) {
+                resolution.endScene();
+                resolution.present(fbWidth, fbHeight);
+            }
+            capture.captureFrame(fbWidth, fbHeight);
+        }
+        if (window) glfwSwapBuffers(window);
+        frameFences.frameSubmitted();
+        latency.framePresented();
+        if (!lowLatency) pollEvents();
+        allocationStats.endFrame();
+        pacer.endFrame();
+    }
+    session.logSummary();
+    allocationStats.logSummary();
+    pacer.stats().logSummary();
+    frameFences.logSummary();
+    latency.logSummary("Key");
+    if (gpuCulling.ready()) {
+        logInfo("GPU culling, last frame: %zu of %zu objects visible", gpuCulling.readVisibleCount(),
+                nodeShapes.size());
+    } else {
+        const RenderQueueStats& drawStats = renderQueue.stats();
+        logInfo("Render queue, last frame: %zu draws, %zu program and %zu vertex array binds", drawStats.draws,
+                drawStats.programBinds, drawStats.vertexArrayBinds);
+        logInfo("Frustum culling, last frame: %zu of %zu objects visible, %zu BVH nodes tested",
+                bvh.stats().objectsVisible, bvh.objectCount(), bvh.stats().nodesVisited);
+    }
+    if (occlusionCulling) {
+        logInfo("Occlusion culling (%s queries): %.1f of %.1f tested mesh draws skipped per frame, %zu of %zu in "
+                "the last measured frame",
+                occlusion.conservative() ? "conservative" : "exact", occlusion.hiddenPerFrame(),
+                occlusion.testedPerFrame(), occlusion.lastHidden(), occlusion.lastTested());
+    }
+    resolution.logSummary();
+    if (submitFrames > 0) {
+        const char* path = gpuCulling.ready()  ? "GPU culling"
+                           : occlusionCulling  ? "occlusion queries"
+                           : multiDrawIndirect ? "multi-draw indirect"
+                                               : "per object";
+        logInfo("Draw submission (%s): %.3f ms CPU per frame", path, 1000.0 * submitSeconds / submitFrames);
+    }
+    if (recordFrames > 0) {
+        logInfo("Command recording: %.3f ms per frame, last frame %zu commands in %zu lists (%u threads)",
+                1000.0 * recordSeconds / recordFrames, commandLists.commandCount(), commandLists.listCount(),
+                jobs.threadCount());
+    }
+    if (options.savePath) saveCubeSnapshot(options.savePath);
+    session.close();
 
     // Cleanup
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
-    glDeleteBuffers(1, &EBO);
-    glDeleteProgram(shaderProgram);
+    capture.stop();
+    if (!softwareRendering) {
+        gpuCulling.destroy();
+        occlusion.destroy();
+        resolution.destroy();
+        meshRenderer.destroy();
+    }
+    softPresenter.destroy();
+    frameFences.destroy();
+    latency.destroy();
 
-    glfwTerminate();
+    if (window) glfwTerminate();
+    jobs.stop();
+    logStop();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,247 @@
+#include "dynamic_resolution.h"
+#include "logger.h"
+#include <algorithm>
+#include <cmath>
+
+// One triangle covering the viewport; uv runs over the rendered part of the target
+static const char* UPSCALE_VERTEX_SHADER = R"(
+#version 330 core
+out vec2 uv;
+uniform vec2 uvScale;
+void main() {
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    uv = corner * uvScale;
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+// Bilinear sample plus sharpness times its difference to the four neighbors'
+// average; samples stay half a texel inside the rendered part
+static const char* UPSCALE_FRAGMENT_SHADER = R"(
+#version 330 core
+in vec2 uv;
+out vec4 FragColor;
+uniform sampler2D image;
+uniform vec2 uvMax;
+uniform vec2 texel;
+uniform float sharpness;
+vec3 fetch(vec2 at) {
+    return texture(image, clamp(at, 0.5 * texel, uvMax)).rgb;
+}
+void main() {
+    vec3 center = fetch(uv);
+    vec3 neighbors = fetch(uv + vec2(texel.x, 0.0)) + fetch(uv - vec2(texel.x, 0.0)) +
+                     fetch(uv + vec2(0.0, texel.y)) + fetch(uv - vec2(0.0, texel.y));
+    FragColor = vec4(clamp(center + sharpness * (center - 0.25 * neighbors), 0.0, 1.0), 1.0);
+}
+)";
+
+const float MIN_SCALE = 0.25f;
+const float SHARPNESS = 0.4f;
+const double BUDGET_FRACTION = 0.9; // aim a little under the budget
+const double IGNORED_CHANGE = 0.05; // relative scale changes smaller than this are skipped
+const double ADJUST_RATE = 0.5;     // part of the way to the estimate taken per measurement
+const double MAX_GPU_MS = 1000.0;   // longer results are stalls or driver glitches, not fill cost
+
+static GLuint compileShader(GLenum type, const char* source) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+    GLint ok = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        char info[1024];
+        glGetShaderInfoLog(shader, sizeof(info), nullptr, info);
+        logError("Upscale shader compilation failed: %s", info);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+DynamicResolution::DynamicResolution()
+    : budgetMs(8.0), sharpen(true), currentScale(1.0f), framebuffer(0), colorTexture(0), depthBuffer(0),
+      emptyVertexArray(0), upscaleProgram(0), uvScaleLocation(-1), uvMaxLocation(-1), texelLocation(-1),
+      sharpnessLocation(-1), nextQuery(0), timing(false), gpuMsTotal(0.0), scaleTotal(0.0), lastGpuMs(0.0),
+      minScaleSeen(1.0f), maxScaleSeen(1.0f), measuredFrames(0), frames(0) {
+    targetSize[0] = targetSize[1] = 0;
+    sceneSize[0] = sceneSize[1] = 0;
+    for (int i = 0; i < QUERY_COUNT; i++) {
+        queries[i] = 0;
+        pending[i] = false;
+        queryScale[i] = 1.0f;
+    }
+}
+
+bool DynamicResolution::init(double budget, bool sharpenUpscale) {
+    budgetMs = budget;
+    sharpen = sharpenUpscale;
+    currentScale = 1.0f;
+
+    GLuint vertexShader = compileShader(GL_VERTEX_SHADER, UPSCALE_VERTEX_SHADER);
+    GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, UPSCALE_FRAGMENT_SHADER);
+    if (!vertexShader || !fragmentShader) {
+        if (vertexShader) glDeleteShader(vertexShader);
+        if (fragmentShader) glDeleteShader(fragmentShader);
+        return false;
+    }
+    upscaleProgram = glCreateProgram();
+    glAttachShader(upscaleProgram, vertexShader);
+    glAttachShader(upscaleProgram, fragmentShader);
+    glLinkProgram(upscaleProgram);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+    GLint ok = GL_FALSE;
+    glGetProgramiv(upscaleProgram, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        char info[1024];
+        glGetProgramInfoLog(upscaleProgram, sizeof(info), nullptr, info);
+        logError("Upscale program link failed: %s", info);
+        destroy();
+        return false;
+    }
+    uvScaleLocation = glGetUniformLocation(upscaleProgram, "uvScale");
+    uvMaxLocation = glGetUniformLocation(upscaleProgram, "uvMax");
+    texelLocation = glGetUniformLocation(upscaleProgram, "texel");
+    sharpnessLocation = glGetUniformLocation(upscaleProgram, "sharpness");
+    glUseProgram(upscaleProgram);
+    glUniform1i(glGetUniformLocation(upscaleProgram, "image"), 0);
+
+    // Core profiles draw nothing without a vertex array, even an empty one
+    glGenVertexArrays(1, &emptyVertexArray);
+    glGenFramebuffers(1, &framebuffer);
+    glGenTextures(1, &colorTexture);
+    glGenRenderbuffers(1, &depthBuffer);
+    glGenQueries(QUERY_COUNT, queries);
+    logInfo("Dynamic resolution: %.1f ms GPU budget, %s upscale", budgetMs, sharpen ? "sharpened" : "bilinear");
+    return true;
+}
+
+void DynamicResolution::destroy() {
+    if (upscaleProgram) glDeleteProgram(upscaleProgram);
+    if (emptyVertexArray) glDeleteVertexArrays(1, &emptyVertexArray);
+    if (framebuffer) glDeleteFramebuffers(1, &framebuffer);
+    if (colorTexture) glDeleteTextures(1, &colorTexture);
+    if (depthBuffer) glDeleteRenderbuffers(1, &depthBuffer);
+    if (queries[0]) glDeleteQueries(QUERY_COUNT, queries);
+    upscaleProgram = emptyVertexArray = framebuffer = colorTexture = depthBuffer = 0;
+    for (int i = 0; i < QUERY_COUNT; i++) {
+        queries[i] = 0;
+        pending[i] = false;
+    }
+    targetSize[0] = targetSize[1] = 0;
+}
+
+void DynamicResolution::resizeTarget(int width, int height) {
+    targetSize[0] = width;
+    targetSize[1] = height;
+    glBindTexture(GL_TEXTURE_2D, colorTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        logError("Dynamic resolution target incomplete");
+    }
+}
+
+// Takes every finished measurement, oldest first, and stops at the first one still running
+void DynamicResolution::readQueries() {
+    for (int n = 0; n < QUERY_COUNT; n++) {
+        int i = (nextQuery + n) % QUERY_COUNT;
+        if (!pending[i]) continue;
+        GLint available = 0;
+        glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) break;
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &nanoseconds);
+        pending[i] = false;
+        adjust(nanoseconds * 1e-6, queryScale[i]);
+    }
+}
+
+void DynamicResolution::adjust(double gpuMs, float measuredScale) {
+    if (gpuMs <= 0.0 || gpuMs > MAX_GPU_MS) return;
+    lastGpuMs = gpuMs;
+    gpuMsTotal += gpuMs;
+    measuredFrames++;
+
+    // Fill cost follows the pixel count, so the square of the scale. The
+    // measurement is a few frames old and may be of another scale.
+    double estimate = measuredScale * std::sqrt(BUDGET_FRACTION * budgetMs / gpuMs);
+    estimate = std::min(std::max(estimate, (double)MIN_SCALE), 1.0);
+    if (std::fabs(estimate - currentScale) < IGNORED_CHANGE * currentScale) return;
+    currentScale = (float)(currentScale + ADJUST_RATE * (estimate - currentScale));
+}
+
+void DynamicResolution::beginScene(int width, int height) {
+    width = std::max(width, 1);
+    height = std::max(height, 1);
+    readQueries();
+    if (width != targetSize[0] || height != targetSize[1]) resizeTarget(width, height);
+
+    sceneSize[0] = std::max(1, (int)(width * currentScale + 0.5f));
+    sceneSize[1] = std::max(1, (int)(height * currentScale + 0.5f));
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, sceneSize[0], sceneSize[1]);
+
+    // Only the rendered corner needs clearing
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(0, 0, sceneSize[0], sceneSize[1]);
+
+    // When the GPU is a whole ring of frames behind, this frame goes unmeasured
+    timing = !pending[nextQuery];
+    if (timing) {
+        queryScale[nextQuery] = currentScale;
+        glBeginQuery(GL_TIME_ELAPSED, queries[nextQuery]);
+    }
+
+    frames++;
+    scaleTotal += currentScale;
+    minScaleSeen = std::min(minScaleSeen, currentScale);
+    maxScaleSeen = std::max(maxScaleSeen, currentScale);
+}
+
+void DynamicResolution::endScene() {
+    glDisable(GL_SCISSOR_TEST);
+    if (!timing) return;
+    glEndQuery(GL_TIME_ELAPSED);
+    pending[nextQuery] = true;
+    nextQuery = (nextQuery + 1) % QUERY_COUNT;
+}
+
+void DynamicResolution::present(int width, int height) {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, width, height);
+    GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+    glDisable(GL_DEPTH_TEST);
+
+    glUseProgram(upscaleProgram);
+    glUniform2f(uvScaleLocation, (float)sceneSize[0] / targetSize[0], (float)sceneSize[1] / targetSize[1]);
+    glUniform2f(uvMaxLocation, (sceneSize[0] - 0.5f) / targetSize[0], (sceneSize[1] - 0.5f) / targetSize[1]);
+    glUniform2f(texelLocation, 1.0f / targetSize[0], 1.0f / targetSize[1]);
+    glUniform1f(sharpnessLocation, sharpen && currentScale < 1.0f ? SHARPNESS : 0.0f);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, colorTexture);
+    glBindVertexArray(emptyVertexArray);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    if (depthTest) glEnable(GL_DEPTH_TEST);
+}
+
+void DynamicResolution::logSummary() const {
+    if (frames == 0) return;
+    logInfo("Dynamic resolution over %u frames: scale %.2f mean (%.2f to %.2f), last %dx%d", frames,
+            scaleTotal / frames, minScaleSeen, maxScaleSeen, sceneSize[0], sceneSize[1]);
+    if (measuredFrames > 0) {
+        logInfo("Scene GPU time: %.2f ms mean, %.2f ms last, budget %.1f ms", gpuMsTotal / measuredFrames, lastGpuMs,
+                budgetMs);
+    }
+}
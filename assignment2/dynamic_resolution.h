@@ -0,0 +1,70 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <GL/glew.h>
+
+// Renders the scene into an offscreen target at a fraction of the window size
+// and scales it up to the window, choosing the fraction so the GPU time of the
+// scene stays within a budget.
+//
+// The GPU time comes from GL_TIME_ELAPSED queries in a small ring; results are
+// only read once available, a frame or two late, so the CPU never waits. Since
+// fill cost follows the pixel count, the scale moves by the square root of
+// budget / measured time, part way per measurement and only for changes of
+// more than a few percent, so noise does not make the image shimmer. The
+// target is allocated at the full window size and the scene is rendered into
+// its lower left corner, so changing the scale allocates nothing.
+//
+// The upscale is bilinear, optionally with a light sharpening (an unsharp
+// mask over the four neighbors) while the scale is below 1.
+class DynamicResolution {
+public:
+    DynamicResolution();
+
+    // budgetMs is the GPU time to aim for; needs GL 3.3 (timer queries)
+    bool init(double budgetMs, bool sharpen);
+    void destroy();
+    bool ready() const { return upscaleProgram != 0; }
+
+    // Binds the offscreen target at the current scale of a width x height
+    // window and sets the viewport to it
+    void beginScene(int width, int height);
+    void endScene();
+    // Draws the scene into the default framebuffer, filling the viewport
+    void present(int width, int height);
+
+    float scale() const { return currentScale; }
+    int sceneWidth() const { return sceneSize[0]; }
+    int sceneHeight() const { return sceneSize[1]; }
+    void logSummary() const;
+
+private:
+    static const int QUERY_COUNT = 4;
+
+    double budgetMs;
+    bool sharpen;
+    float currentScale;
+    int targetSize[2]; // allocated size of the offscreen target
+    int sceneSize[2];  // part of it the scene is rendered into
+
+    GLuint framebuffer, colorTexture, depthBuffer;
+    GLuint emptyVertexArray, upscaleProgram;
+    GLint uvScaleLocation, uvMaxLocation, texelLocation, sharpnessLocation;
+
+    GLuint queries[QUERY_COUNT];
+    bool pending[QUERY_COUNT];
+    float queryScale[QUERY_COUNT]; // scale of the frame each query measures
+    int nextQuery;
+    bool timing; // a query is running for this frame
+
+    // Statistics
+    double gpuMsTotal, scaleTotal, lastGpuMs;
+    float minScaleSeen, maxScaleSeen;
+    unsigned measuredFrames, frames;
+
+    void resizeTarget(int width, int height);
+    void readQueries();
+    void adjust(double gpuMs, float measuredScale);
+};
+
+#endif
@@ -0,0 +1,72 @@
+#include "ecs.h"
+
+int EntityWorld::findOrCreateArchetype(ComponentMask mask) {
+    for (size_t i = 0; i < archetypes.size(); i++) {
+        if (archetypes[i].mask == mask) return (int)i;
+    }
+    Archetype archetype;
+    archetype.mask = mask;
+    archetypes.push_back(archetype);
+    return (int)archetypes.size() - 1;
+}
+
+Entity EntityWorld::create(ComponentMask mask) {
+    int index = findOrCreateArchetype(mask);
+    Archetype& a = archetypes[index];
+
+    Entity entity;
+    if (!freeEntities.empty()) {
+        entity = freeEntities.back();
+        freeEntities.pop_back();
+    } else {
+        entity = (Entity)records.size();
+        records.push_back(Record());
+    }
+    records[entity].archetype = index;
+    records[entity].row = (uint32_t)a.size();
+
+    a.entities.push_back(entity);
+    if (mask & ComponentTraits<Transform>::mask) a.transforms.push_back(Transform());
+    if (mask & ComponentTraits<Color>::mask) a.colors.push_back(Color());
+    if (mask & ComponentTraits<Renderable>::mask) a.renderables.push_back(Renderable());
+    liveCount++;
+    return entity;
+}
+
+void EntityWorld::reserve(ComponentMask mask, size_t count) {
+    Archetype& a = archetypes[findOrCreateArchetype(mask)];
+    size_t capacity = a.size() + count;
+    a.entities.reserve(capacity);
+    if (mask & ComponentTraits<Transform>::mask) a.transforms.reserve(capacity);
+    if (mask & ComponentTraits<Color>::mask) a.colors.reserve(capacity);
+    if (mask & ComponentTraits<Renderable>::mask) a.renderables.reserve(capacity);
+    records.reserve(records.size() + count);
+}
+
+template <typename T> static void swapRemove(std::vector<T>& column, uint32_t row) {
+    if (column.empty()) return;
+    column[row] = column.back();
+    column.pop_back();
+}
+
+void EntityWorld::destroy(Entity entity) {
+    if (!alive(entity)) return;
+    Record& r = records[entity];
+    Archetype& a = archetypes[r.archetype];
+
+    // Move the last row into the hole to keep the columns packed
+    Entity moved = a.entities.back();
+    swapRemove(a.entities, r.row);
+    swapRemove(a.transforms, r.row);
+    swapRemove(a.colors, r.row);
+    swapRemove(a.renderables, r.row);
+    if (moved != entity) records[moved].row = r.row;
+
+    r.archetype = -1;
+    freeEntities.push_back(entity);
+    liveCount--;
+}
+
+bool EntityWorld::alive(Entity entity) const {
+    return entity < records.size() && records[entity].archetype >= 0;
+}
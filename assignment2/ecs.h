@@ -0,0 +1,103 @@
+#ifndef ECS_H
+#define ECS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+typedef uint32_t Entity;
+typedef uint32_t ComponentMask;
+
+// Components. Plain data, stored in contiguous arrays per archetype.
+struct Transform {
+    int node; // scene graph node holding position, rotation and scale
+};
+
+struct Color {
+    float rgb[3];
+};
+
+struct Renderable {
+    int shape; // demo-specific shape id
+    int layer; // demo-specific draw layer (window or region)
+};
+
+enum ComponentType { TRANSFORM, COLOR, RENDERABLE, COMPONENT_TYPE_COUNT };
+
+template <typename T> struct ComponentTraits;
+template <> struct ComponentTraits<Transform> { static const ComponentMask mask = 1u << TRANSFORM; };
+template <> struct ComponentTraits<Color> { static const ComponentMask mask = 1u << COLOR; };
+template <> struct ComponentTraits<Renderable> { static const ComponentMask mask = 1u << RENDERABLE; };
+
+template <typename... Ts> struct MaskOf;
+template <> struct MaskOf<> { static const ComponentMask value = 0; };
+template <typename T, typename... Ts> struct MaskOf<T, Ts...> {
+    static const ComponentMask value = ComponentTraits<T>::mask | MaskOf<Ts...>::value;
+};
+
+// All entities with exactly the same set of components. Row i of every
+// column belongs to entities[i]; columns not in the mask stay empty.
+struct Archetype {
+    ComponentMask mask;
+    std::vector<Entity> entities;
+    std::vector<Transform> transforms;
+    std::vector<Color> colors;
+    std::vector<Renderable> renderables;
+
+    size_t size() const { return entities.size(); }
+    template <typename T> std::vector<T>& column();
+    template <typename T> const std::vector<T>& column() const;
+};
+
+template <> inline std::vector<Transform>& Archetype::column<Transform>() { return transforms; }
+template <> inline std::vector<Color>& Archetype::column<Color>() { return colors; }
+template <> inline std::vector<Renderable>& Archetype::column<Renderable>() { return renderables; }
+template <> inline const std::vector<Transform>& Archetype::column<Transform>() const { return transforms; }
+template <> inline const std::vector<Color>& Archetype::column<Color>() const { return colors; }
+template <> inline const std::vector<Renderable>& Archetype::column<Renderable>() const { return renderables; }
+
+// Archetype-based entity storage. Systems iterate the archetypes that contain
+// the components they need and walk their packed columns directly.
+class EntityWorld {
+public:
+    // Creates an entity with default-initialized components for the mask
+    Entity create(ComponentMask mask);
+    // Makes room for `count` more entities with this mask, so creating them
+    // (e.g. from an input callback) does not reallocate the columns
+    void reserve(ComponentMask mask, size_t count);
+    void destroy(Entity entity);
+    bool alive(Entity entity) const;
+
+    template <typename T> T& get(Entity entity) {
+        const Record& r = records[entity];
+        return archetypes[r.archetype].column<T>()[r.row];
+    }
+    bool has(Entity entity, ComponentMask mask) const {
+        return (archetypes[records[entity].archetype].mask & mask) == mask;
+    }
+
+    // Calls f(Archetype&) for every non-empty archetype containing all of `required`
+    template <typename Func> void forEach(ComponentMask required, Func f) {
+        for (auto& archetype : archetypes) {
+            if ((archetype.mask & required) == required && archetype.size() > 0) f(archetype);
+        }
+    }
+
+    size_t entityCount() const { return liveCount; }
+    size_t archetypeCount() const { return archetypes.size(); }
+
+private:
+    struct Record {
+        int archetype; // -1 when the entity is free
+        uint32_t row;
+    };
+
+    std::vector<Archetype> archetypes;
+    std::vector<Record> records;
+    std::vector<Entity> freeEntities;
+    size_t liveCount = 0;
+
+    int findOrCreateArchetype(ComponentMask mask);
+};
+
+#endif
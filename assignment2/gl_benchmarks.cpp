@@ -0,0 +1,124 @@
+// GL submission benchmarks: the cube demo's objects drawn with one call per
+// object against one multi-draw indirect call. Each iteration draws `size`
+// objects into a small hidden window and waits with glFinish, so the cost of
+// issuing the draws dominates over filling pixels. Same flags and JSON
+// output as the benchmarks target.
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include "bench.h"
+#include "logger.h"
+#include "mesh_renderer.h"
+#include "meshes.h"
+#include "scene_graph.h"
+#include <algorithm>
+#include <vector>
+
+static MeshRenderer renderer;
+
+// Row-major transforms of a grid of small objects filling clip space
+static std::vector<float> makeTransforms(size_t count) {
+    SceneGraph scene;
+    scene.reserve(count);
+    int side = 1;
+    while ((size_t)side * side < count) side++;
+    float cell = 2.0f / side;
+    float size = std::min(0.5f * cell, 0.1f); // stays inside the depth range
+    std::vector<int> nodes(count);
+    for (size_t i = 0; i < count; i++) {
+        int node = nodes[i] = scene.createNode();
+        scene.setTranslation(node, -1.0f + cell * (i % side + 0.5f), -1.0f + cell * (i / side + 0.5f), 0.9f);
+        scene.setScale(node, size, size, size);
+        scene.setRotationEuler(node, 37.0f * i, 23.0f * i, 0.0f);
+    }
+    scene.updateWorld();
+
+    std::vector<float> transforms(count * 16);
+    for (size_t i = 0; i < count; i++) {
+        const float* world = scene.worldMatrix(nodes[i]);
+        for (int j = 0; j < 16; j++) transforms[i * 16 + j] = world[j];
+    }
+    return transforms;
+}
+
+static void benchDrawDirect(BenchState& state) {
+    size_t n = state.size();
+    std::vector<float> transforms = makeTransforms(n);
+    while (state.keepRunning()) {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        renderer.beginDirect();
+        for (size_t i = 0; i < n; i++) renderer.drawDirect(i % MESH_KIND_COUNT, &transforms[i * 16]);
+        glFinish();
+    }
+    state.setItemsPerIteration(n);
+}
+
+static void benchDrawMultiIndirect(BenchState& state) {
+    size_t n = state.size();
+    std::vector<float> transforms = makeTransforms(n);
+    while (state.keepRunning()) {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        renderer.beginIndirect();
+        for (size_t i = 0; i < n; i++) renderer.addIndirect(i % MESH_KIND_COUNT, &transforms[i * 16]);
+        renderer.flushIndirect();
+        glFinish();
+    }
+    state.setItemsPerIteration(n);
+}
+
+int main(int argc, char** argv) {
+    BenchRunner runner;
+    if (!runner.parseArguments(argc, argv)) return 1;
+    logStart(LogLevel::Warning);
+
+    if (!glfwInit()) {
+        logError("Failed to initialize GLFW");
+        logStop();
+        return 1;
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window = glfwCreateWindow(256, 256, "gl_benchmarks", nullptr, nullptr);
+    if (!window) {
+        logError("Failed to create a GL 3.3 core window");
+        glfwTerminate();
+        logStop();
+        return 1;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSwapInterval(0);
+    glewExperimental = GL_TRUE; // core profiles need it with older GLEW
+    if (glewInit() != GLEW_OK) {
+        logError("Failed to initialize GLEW");
+        glfwTerminate();
+        logStop();
+        return 1;
+    }
+
+    MeshData mesh;
+    for (int kind = 0; kind < MESH_KIND_COUNT; kind++) {
+        buildMesh(kind, mesh);
+        renderer.addMesh(mesh);
+    }
+    if (!renderer.init()) {
+        glfwTerminate();
+        logStop();
+        return 1;
+    }
+    glEnable(GL_DEPTH_TEST);
+
+    runner.add("drawDirect", benchDrawDirect, {100, 1000, 10000, 100000});
+    if (renderer.multiDrawSupported()) {
+        runner.add("drawMultiIndirect", benchDrawMultiIndirect, {100, 1000, 10000, 100000});
+    } else {
+        logWarning("Multi-draw indirect not supported, only the per-object path is measured");
+    }
+    int status = runner.runAll();
+
+    renderer.destroy();
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    logStop();
+    return status;
+}
@@ -0,0 +1,313 @@
+#include "gpu_circles.h"
+#include "logger.h"
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+static const float PI = 3.14159265359f;
+
+// Matches breatheAnimation() in animation_scheduler.cpp: grow until maxScale, shrink until minScale
+static const char* UPDATE_VERTEX_SHADER =
+    "#version 130\n"
+    "in vec4 state0;\n"
+    "in vec4 state1;\n"
+    "out vec4 outState0;\n"
+    "out vec4 outState1;\n"
+    "uniform float minScale;\n"
+    "uniform float maxScale;\n"
+    "void main() {\n"
+    "    vec4 s = state0;\n"
+    "    s.z += s.w * state1.w;\n"
+    "    if (s.w > 0.0 && s.z >= maxScale) s.w = -1.0;\n"
+    "    else if (s.w < 0.0 && s.z <= minScale) s.w = 1.0;\n"
+    "    outState0 = s;\n"
+    "    outState1 = state1;\n"
+    "    gl_Position = vec4(0.0);\n" // unused (rasterizer discard), but GLSL 1.30 linkers require it
+    "}\n";
+
+static const char* DRAW_VERTEX_SHADER =
+    "#version 130\n"
+    "in vec2 corner;\n"
+    "in vec4 state0;\n"
+    "in vec4 state1;\n"
+    "out vec3 color;\n"
+    "uniform float radius;\n"
+    "void main() {\n"
+    "    vec2 position = state0.xy + corner * radius * state0.z;\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * vec4(position, 0.0, 1.0);\n"
+    "    color = state1.rgb;\n"
+    "}\n";
+
+static const char* DRAW_FRAGMENT_SHADER =
+    "#version 130\n"
+    "in vec3 color;\n"
+    "out vec4 fragColor;\n"
+    "void main() {\n"
+    "    fragColor = vec4(color, 1.0);\n"
+    "}\n";
+
+// Attribute locations shared by both programs
+enum { ATTRIB_CORNER = 0, ATTRIB_STATE0 = 1, ATTRIB_STATE1 = 2 };
+
+static GLuint compileShader(GLenum type, const char* source) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+    GLint ok = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        char info[1024];
+        glGetShaderInfoLog(shader, sizeof(info), nullptr, info);
+        logError("Circle shader compilation failed: %s", info);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+// Core since 3.3, otherwise ARB_instanced_arrays
+static void setDivisor(GLuint attribute, GLuint divisor) {
+    if (GLEW_VERSION_3_3) glVertexAttribDivisor(attribute, divisor);
+    else glVertexAttribDivisorARB(attribute, divisor);
+}
+
+static bool linkProgram(GLuint program) {
+    glBindAttribLocation(program, ATTRIB_CORNER, "corner");
+    glBindAttribLocation(program, ATTRIB_STATE0, "state0");
+    glBindAttribLocation(program, ATTRIB_STATE1, "state1");
+    glLinkProgram(program);
+    GLint ok = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        char info[1024];
+        glGetProgramInfoLog(program, sizeof(info), nullptr, info);
+        logError("Circle program link failed: %s", info);
+    }
+    return ok == GL_TRUE;
+}
+
+GpuCircleSim::GpuCircleSim()
+    : circleBuffer(0), updateProgram(0), drawProgram(0), minScaleLocation(-1), maxScaleLocation(-1),
+      radiusLocation(-1), current(0), circles(0), capacity(0), fanVertices(0) {
+    state[0] = state[1] = 0;
+    updateArrays[0] = updateArrays[1] = 0;
+    drawArrays[0] = drawArrays[1] = 0;
+}
+
+GpuCircleSim::~GpuCircleSim() {
+    // GL objects need the context, see destroy()
+}
+
+bool GpuCircleSim::init(int segments) {
+    if (!GLEW_VERSION_3_1 || !(GLEW_VERSION_3_3 || GLEW_ARB_instanced_arrays)) {
+        logInfo("Transform feedback or instancing not supported, breathing circles animate on the CPU");
+        return false;
+    }
+
+    GLuint updateShader = compileShader(GL_VERTEX_SHADER, UPDATE_VERTEX_SHADER);
+    GLuint drawShader = compileShader(GL_VERTEX_SHADER, DRAW_VERTEX_SHADER);
+    GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, DRAW_FRAGMENT_SHADER);
+    bool ok = updateShader && drawShader && fragmentShader;
+
+    GLuint update = glCreateProgram();
+    GLuint draw = glCreateProgram();
+    if (ok) {
+        glAttachShader(update, updateShader);
+        const char* varyings[] = {"outState0", "outState1"};
+        glTransformFeedbackVaryings(update, 2, varyings, GL_INTERLEAVED_ATTRIBS);
+        glAttachShader(draw, drawShader);
+        glAttachShader(draw, fragmentShader);
+        ok = linkProgram(update) && linkProgram(draw);
+    }
+    // Programs keep the shaders they were linked with
+    if (updateShader) glDeleteShader(updateShader);
+    if (drawShader) glDeleteShader(drawShader);
+    if (fragmentShader) glDeleteShader(fragmentShader);
+    if (!ok) {
+        glDeleteProgram(update);
+        glDeleteProgram(draw);
+        logWarning("Breathing circles animate on the CPU");
+        return false;
+    }
+    updateProgram = update;
+    drawProgram = draw;
+    minScaleLocation = glGetUniformLocation(updateProgram, "minScale");
+    maxScaleLocation = glGetUniformLocation(updateProgram, "maxScale");
+    radiusLocation = glGetUniformLocation(drawProgram, "radius");
+
+    // Center plus the closed rim
+    std::vector<float> fan;
+    fan.reserve(2 * (segments + 2));
+    fan.push_back(0.0f);
+    fan.push_back(0.0f);
+    for (int i = 0; i <= segments; i++) {
+        float angle = 2.0f * PI * i / segments;
+        fan.push_back(cos(angle));
+        fan.push_back(sin(angle));
+    }
+    fanVertices = segments + 2;
+    glGenBuffers(1, &circleBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, circleBuffer);
+    glBufferData(GL_ARRAY_BUFFER, fan.size() * sizeof(float), fan.data(), GL_STATIC_DRAW);
+
+    glGenBuffers(2, state);
+    glGenVertexArrays(2, updateArrays);
+    glGenVertexArrays(2, drawArrays);
+    current = 0;
+    circles = 0;
+    capacity = 0;
+    if (!grow(1024)) {
+        destroy();
+        return false;
+    }
+    logInfo("Breathing circles animate on the GPU");
+    return true;
+}
+
+void GpuCircleSim::destroy() {
+    if (updateProgram) glDeleteProgram(updateProgram);
+    if (drawProgram) glDeleteProgram(drawProgram);
+    if (circleBuffer) glDeleteBuffers(1, &circleBuffer);
+    if (state[0]) glDeleteBuffers(2, state);
+    if (updateArrays[0]) glDeleteVertexArrays(2, updateArrays);
+    if (drawArrays[0]) glDeleteVertexArrays(2, drawArrays);
+    updateProgram = drawProgram = circleBuffer = 0;
+    state[0] = state[1] = 0;
+    updateArrays[0] = updateArrays[1] = 0;
+    drawArrays[0] = drawArrays[1] = 0;
+    circles = capacity = 0;
+}
+
+void GpuCircleSim::setupArrays(int index) {
+    const GLsizei stride = STATE_FLOATS * sizeof(float);
+    const void* state1Offset = (const void*)(4 * sizeof(float));
+
+    glBindVertexArray(updateArrays[index]);
+    glBindBuffer(GL_ARRAY_BUFFER, state[index]);
+    glEnableVertexAttribArray(ATTRIB_STATE0);
+    glEnableVertexAttribArray(ATTRIB_STATE1);
+    glVertexAttribPointer(ATTRIB_STATE0, 4, GL_FLOAT, GL_FALSE, stride, nullptr);
+    glVertexAttribPointer(ATTRIB_STATE1, 4, GL_FLOAT, GL_FALSE, stride, state1Offset);
+
+    glBindVertexArray(drawArrays[index]);
+    glBindBuffer(GL_ARRAY_BUFFER, circleBuffer);
+    glEnableVertexAttribArray(ATTRIB_CORNER);
+    glVertexAttribPointer(ATTRIB_CORNER, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+    glBindBuffer(GL_ARRAY_BUFFER, state[index]);
+    glEnableVertexAttribArray(ATTRIB_STATE0);
+    glEnableVertexAttribArray(ATTRIB_STATE1);
+    glVertexAttribPointer(ATTRIB_STATE0, 4, GL_FLOAT, GL_FALSE, stride, nullptr);
+    glVertexAttribPointer(ATTRIB_STATE1, 4, GL_FLOAT, GL_FALSE, stride, state1Offset);
+    setDivisor(ATTRIB_STATE0, 1);
+    setDivisor(ATTRIB_STATE1, 1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Doubles both state buffers, keeping the circles of the current one. On
+// failure the old buffers stay in use.
+bool GpuCircleSim::grow(int minCapacity) {
+    int newCapacity = capacity ? capacity : 1024;
+    while (newCapacity < minCapacity) newCapacity *= 2;
+    const GLsizeiptr bytes = (GLsizeiptr)newCapacity * STATE_FLOATS * sizeof(float);
+
+    // Errors left over from earlier calls are not this allocation's
+    while (glGetError() != GL_NO_ERROR) {
+    }
+    GLuint buffers[2];
+    glGenBuffers(2, buffers);
+    for (int i = 0; i < 2; i++) {
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+        glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_DYNAMIC_COPY);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if (glGetError() != GL_NO_ERROR) {
+        glDeleteBuffers(2, buffers);
+        return false;
+    }
+
+    if (circles > 0) {
+        glBindBuffer(GL_COPY_READ_BUFFER, state[current]);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[current]);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                            (GLsizeiptr)circles * STATE_FLOATS * sizeof(float));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+    if (state[0]) glDeleteBuffers(2, state);
+    state[0] = buffers[0];
+    state[1] = buffers[1];
+    capacity = newCapacity;
+
+    setupArrays(0);
+    setupArrays(1);
+    return true;
+}
+
+void GpuCircleSim::addCircle(float x, float y, const float* color, float scale, float speed) {
+    if (!ready()) return;
+    if (circles == capacity && !grow(capacity * 2)) {
+        logError("Cannot grow the breathing circle buffers");
+        return;
+    }
+    const float circle[STATE_FLOATS] = {x, y, scale, 1.0f, color[0], color[1], color[2], speed};
+    glBindBuffer(GL_ARRAY_BUFFER, state[current]);
+    glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)circles * sizeof(circle), sizeof(circle), circle);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    circles++;
+}
+
+void GpuCircleSim::readCircles(float* out) const {
+    if (!ready() || circles == 0) return;
+    glBindBuffer(GL_ARRAY_BUFFER, state[current]);
+    glGetBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr)circles * STATE_FLOATS * sizeof(float), out);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+bool GpuCircleSim::setCircles(const float* circleStates, int count) {
+    if (!ready()) return false;
+    circles = 0; // nothing to keep when growing
+    if (count > capacity && !grow(count)) {
+        logError("Cannot grow the breathing circle buffers");
+        return false;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, state[current]);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr)count * STATE_FLOATS * sizeof(float), circleStates);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    circles = count;
+    return true;
+}
+
+void GpuCircleSim::update(float minScale, float maxScale) {
+    if (!ready() || circles == 0) return;
+    int next = current ^ 1;
+
+    glUseProgram(updateProgram);
+    glUniform1f(minScaleLocation, minScale);
+    glUniform1f(maxScaleLocation, maxScale);
+    glBindVertexArray(updateArrays[current]);
+    glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, state[next], 0,
+                      (GLsizeiptr)circles * STATE_FLOATS * sizeof(float));
+
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, circles);
+    glEndTransformFeedback();
+    glDisable(GL_RASTERIZER_DISCARD);
+
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindVertexArray(0);
+    glUseProgram(0);
+    current = next;
+}
+
+void GpuCircleSim::draw(float radius) {
+    if (!ready() || circles == 0) return;
+    glUseProgram(drawProgram);
+    glUniform1f(radiusLocation, radius);
+    glBindVertexArray(drawArrays[current]);
+    glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, fanVertices, circles);
+    glBindVertexArray(0);
+    glUseProgram(0);
+}
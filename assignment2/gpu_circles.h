@@ -0,0 +1,51 @@
+#ifndef GPU_CIRCLES_H
+#define GPU_CIRCLES_H
+
+#include <GL/glew.h>
+
+// Breathing circles simulated and drawn on the GPU. Every circle is 8 floats
+// in a vertex buffer: (x, y, scale, direction) and (r, g, b, speed). A
+// vertex-only program advances all of them per frame through transform
+// feedback into a second buffer, and the two buffers swap; the result is then
+// drawn as instances of one unit circle. Only new circles are uploaded.
+class GpuCircleSim {
+public:
+    static const int STATE_FLOATS = 8; // per circle, in the order above
+
+    GpuCircleSim();
+    ~GpuCircleSim();
+
+    // Needs GL 3.1 (transform feedback, instancing) and instanced attributes.
+    // Returns false when not supported; the caller keeps the CPU path.
+    bool init(int segments);
+    void destroy();
+    bool ready() const { return updateProgram != 0; }
+    int count() const { return circles; }
+
+    // Needs the context the simulation was initialized in, like all calls below
+    void addCircle(float x, float y, const float* color, float scale, float speed);
+    // Copies the state of all circles out (count() * STATE_FLOATS floats), or
+    // replaces all circles with `count` of them in one upload
+    void readCircles(float* out) const;
+    bool setCircles(const float* circleStates, int count);
+    // One animation step: scale moves by speed and turns around at the limits
+    void update(float minScale, float maxScale);
+    // Draws with the current modelview and projection matrices
+    void draw(float radius);
+
+private:
+    GLuint state[2];       // ping-pong state buffers
+    GLuint updateArrays[2]; // reads state[i]
+    GLuint drawArrays[2];   // instanced draw of state[i]
+    GLuint circleBuffer;    // unit circle fan
+    GLuint updateProgram, drawProgram;
+    GLint minScaleLocation, maxScaleLocation, radiusLocation;
+    int current;
+    int circles, capacity;
+    int fanVertices;
+
+    void setupArrays(int index);
+    bool grow(int minCapacity);
+};
+
+#endif
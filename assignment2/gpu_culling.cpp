@@ -0,0 +1,288 @@
+#include "gpu_culling.h"
+#include "logger.h"
+#include <algorithm>
+
+// One invocation per object. Visible objects take the next slot of their
+// mesh's instance range, counted in that mesh's indirect command.
+static const char* CULL_COMPUTE_SHADER = R"(
+#version 430 core
+layout (local_size_x = 64) in;
+struct Object {
+    vec4 rows[3];
+    vec3 center;
+    uint mesh;
+    vec3 extent;
+    float padding;
+};
+struct Command {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+layout (std430, binding = 0) readonly buffer Objects { Object objects[]; };
+layout (std430, binding = 1) writeonly buffer Instances { uint instances[]; };
+layout (std430, binding = 2) buffer Commands { Command commands[]; };
+uniform vec4 planes[6];
+uniform uint objectCount;
+void main() {
+    uint index = (gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x) * 64u + gl_LocalInvocationIndex;
+    if (index >= objectCount) return;
+    Object o = objects[index];
+
+    // World box: the center goes through the matrix, the extents through its absolute values
+    vec4 localCenter = vec4(o.center, 1.0);
+    vec3 center = vec3(dot(o.rows[0], localCenter), dot(o.rows[1], localCenter), dot(o.rows[2], localCenter));
+    vec3 extent = vec3(dot(abs(o.rows[0].xyz), o.extent), dot(abs(o.rows[1].xyz), o.extent),
+                       dot(abs(o.rows[2].xyz), o.extent));
+    for (int i = 0; i < 6; i++) {
+        if (dot(planes[i].xyz, center) + dot(abs(planes[i].xyz), extent) + planes[i].w < 0.0) return;
+    }
+
+    uint slot = atomicAdd(commands[o.mesh].instanceCount, 1u);
+    instances[commands[o.mesh].baseInstance + slot] = index;
+}
+)";
+
+static const char* DRAW_VERTEX_SHADER = R"(
+#version 430 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aColor;
+layout (location = 2) in uint objectIndex;
+struct Object {
+    vec4 rows[3];
+    vec3 center;
+    uint mesh;
+    vec3 extent;
+    float padding;
+};
+layout (std430, binding = 0) readonly buffer Objects { Object objects[]; };
+uniform mat4 viewProjection;
+out vec3 ourColor;
+void main() {
+    vec4 position = vec4(aPos, 1.0);
+    vec4 rows[3] = objects[objectIndex].rows;
+    gl_Position = viewProjection * vec4(dot(rows[0], position), dot(rows[1], position), dot(rows[2], position), 1.0);
+    ourColor = aColor;
+}
+)";
+
+static const char* DRAW_FRAGMENT_SHADER = R"(
+#version 430 core
+in vec3 ourColor;
+out vec4 FragColor;
+void main() {
+    FragColor = vec4(ourColor, 1.0);
+}
+)";
+
+const GLuint WORKGROUP_SIZE = 64;
+const GLuint MAX_WORKGROUPS_X = 65535; // the minimum every implementation supports
+const GLuint OBJECT_INDEX_ATTRIBUTE = 2;
+
+static GLuint compileShader(GLenum type, const char* source) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+    GLint ok = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        char info[1024];
+        glGetShaderInfoLog(shader, sizeof(info), nullptr, info);
+        logError("Culling shader compilation failed: %s", info);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+// Links the given shaders into a program and deletes them
+static GLuint linkProgram(GLuint first, GLuint second) {
+    if (!first) return 0;
+    GLuint program = glCreateProgram();
+    glAttachShader(program, first);
+    if (second) glAttachShader(program, second);
+    glLinkProgram(program);
+    glDeleteShader(first);
+    if (second) glDeleteShader(second);
+
+    GLint ok = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        char info[1024];
+        glGetProgramInfoLog(program, sizeof(info), nullptr, info);
+        logError("Culling program link failed: %s", info);
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+GpuCulling::GpuCulling()
+    : dirtyBegin(0), dirtyEnd(0), objectBuffer(0), instanceBuffer(0), commandBuffer(0), emptyCommandBuffer(0),
+      vertexArray(0), cullProgram(0), drawProgram(0), planesLocation(-1), objectCountLocation(-1),
+      viewProjectionLocation(-1) {
+}
+
+bool GpuCulling::supported() {
+    // Compute shaders, storage buffers and multi-draw indirect
+    return GLEW_VERSION_4_3;
+}
+
+bool GpuCulling::init(const MeshRenderer& renderer, const int* objectMeshes, size_t count, const Aabb* meshBounds) {
+    if (!supported()) {
+        logInfo("GPU culling needs GL 4.3, objects are culled on the CPU");
+        return false;
+    }
+
+    cullProgram = linkProgram(compileShader(GL_COMPUTE_SHADER, CULL_COMPUTE_SHADER), 0);
+    GLuint vertexShader = compileShader(GL_VERTEX_SHADER, DRAW_VERTEX_SHADER);
+    GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, DRAW_FRAGMENT_SHADER);
+    if (vertexShader && fragmentShader) {
+        drawProgram = linkProgram(vertexShader, fragmentShader);
+    } else {
+        if (vertexShader) glDeleteShader(vertexShader);
+        if (fragmentShader) glDeleteShader(fragmentShader);
+    }
+    if (!cullProgram || !drawProgram) {
+        destroy();
+        return false;
+    }
+    planesLocation = glGetUniformLocation(cullProgram, "planes");
+    objectCountLocation = glGetUniformLocation(cullProgram, "objectCount");
+    viewProjectionLocation = glGetUniformLocation(drawProgram, "viewProjection");
+
+    // Each mesh gets a range of the instance list as large as its object count
+    int meshCount = renderer.meshCount();
+    std::vector<GLuint> meshObjects(meshCount, 0);
+    for (size_t i = 0; i < count; i++) meshObjects[objectMeshes[i]]++;
+    emptyCommands.clear();
+    GLuint baseInstance = 0;
+    for (int mesh = 0; mesh < meshCount; mesh++) {
+        emptyCommands.push_back(renderer.meshCommand(mesh, 0, baseInstance));
+        baseInstance += meshObjects[mesh];
+    }
+
+    objects.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        GpuCullObject& o = objects[i];
+        const Aabb& box = meshBounds[objectMeshes[i]];
+        for (int j = 0; j < 12; j++) o.rows[j] = j % 5 == 0 ? 1.0f : 0.0f;
+        for (int axis = 0; axis < 3; axis++) {
+            o.center[axis] = 0.5f * (box.min[axis] + box.max[axis]);
+            o.extent[axis] = 0.5f * (box.max[axis] - box.min[axis]);
+        }
+        o.mesh = (uint32_t)objectMeshes[i];
+        o.padding = 0.0f;
+    }
+    dirtyBegin = dirtyEnd = 0;
+
+    glGenBuffers(1, &objectBuffer);
+    glGenBuffers(1, &instanceBuffer);
+    glGenBuffers(1, &commandBuffer);
+    glGenBuffers(1, &emptyCommandBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, objects.size() * sizeof(GpuCullObject), objects.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max(count, (size_t)1) * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, emptyCommands.size() * sizeof(DrawElementsIndirectCommand), nullptr,
+                 GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, emptyCommandBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, emptyCommands.size() * sizeof(DrawElementsIndirectCommand),
+                 emptyCommands.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // The meshes' vertices and indices plus one object index per instance
+    glGenVertexArrays(1, &vertexArray);
+    glBindVertexArray(vertexArray);
+    glBindBuffer(GL_ARRAY_BUFFER, renderer.sharedVertexBuffer());
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer.sharedIndexBuffer());
+    const GLsizei stride = MESH_VERTEX_FLOATS * sizeof(float);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    glVertexAttribIPointer(OBJECT_INDEX_ATTRIBUTE, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+    glVertexAttribDivisor(OBJECT_INDEX_ATTRIBUTE, 1);
+    glEnableVertexAttribArray(OBJECT_INDEX_ATTRIBUTE);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    logInfo("Objects are culled on the GPU");
+    return true;
+}
+
+void GpuCulling::destroy() {
+    if (vertexArray) glDeleteVertexArrays(1, &vertexArray);
+    GLuint buffers[] = {objectBuffer, instanceBuffer, commandBuffer, emptyCommandBuffer};
+    for (GLuint buffer : buffers) {
+        if (buffer) glDeleteBuffers(1, &buffer);
+    }
+    if (cullProgram) glDeleteProgram(cullProgram);
+    if (drawProgram) glDeleteProgram(drawProgram);
+    vertexArray = objectBuffer = instanceBuffer = commandBuffer = emptyCommandBuffer = 0;
+    cullProgram = drawProgram = 0;
+}
+
+void GpuCulling::setTransform(int object, const float* world) {
+    for (int j = 0; j < 12; j++) objects[object].rows[j] = world[j];
+    if (dirtyBegin == dirtyEnd) {
+        dirtyBegin = object;
+        dirtyEnd = object + 1;
+    } else {
+        dirtyBegin = std::min(dirtyBegin, object);
+        dirtyEnd = std::max(dirtyEnd, object + 1);
+    }
+}
+
+void GpuCulling::draw(const float* viewProjection) {
+    if (objects.empty()) return;
+    if (dirtyBegin != dirtyEnd) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, dirtyBegin * sizeof(GpuCullObject),
+                        (dirtyEnd - dirtyBegin) * sizeof(GpuCullObject), &objects[dirtyBegin]);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        dirtyBegin = dirtyEnd = 0;
+    }
+
+    // Counts start from zero every frame
+    glBindBuffer(GL_COPY_READ_BUFFER, emptyCommandBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, commandBuffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                        emptyCommands.size() * sizeof(DrawElementsIndirectCommand));
+
+    Frustum frustum;
+    frustumFromMatrix(viewProjection, frustum);
+    glUseProgram(cullProgram);
+    glUniform4fv(planesLocation, 6, &frustum.planes[0][0]);
+    glUniform1ui(objectCountLocation, (GLuint)objects.size());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, objectBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, instanceBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, commandBuffer);
+    GLuint groups = (GLuint)((objects.size() + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE);
+    GLuint groupsX = std::min(groups, MAX_WORKGROUPS_X);
+    glDispatchCompute(groupsX, (groups + groupsX - 1) / groupsX, 1);
+
+    // The draw reads the counts as commands and the instance list as an attribute
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    glUseProgram(drawProgram);
+    glUniformMatrix4fv(viewProjectionLocation, 1, GL_TRUE, viewProjection);
+    glBindVertexArray(vertexArray);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, (GLsizei)emptyCommands.size(), 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+size_t GpuCulling::readVisibleCount() {
+    if (!commandBuffer) return 0;
+    std::vector<DrawElementsIndirectCommand> commands(emptyCommands.size());
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_COPY_READ_BUFFER, commandBuffer);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+    size_t visible = 0;
+    for (const DrawElementsIndirectCommand& command : commands) visible += command.instanceCount;
+    return visible;
+}
@@ -0,0 +1,60 @@
+#ifndef GPU_CULLING_H
+#define GPU_CULLING_H
+
+#include <GL/glew.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "bvh.h"
+#include "mesh_renderer.h"
+
+// Per-object record in the object buffer (std430): the top three rows of the
+// row-major world matrix, then the mesh's local box as center and half extents
+struct GpuCullObject {
+    float rows[12];
+    float center[3];
+    uint32_t mesh;
+    float extent[3];
+    float padding;
+};
+
+// GPU-driven drawing of many objects made of MeshRenderer's meshes. Objects
+// live in a shader storage buffer. Every frame a compute shader tests each
+// object's world box against the frustum and appends the visible ones to a
+// per-mesh range of an instance list, counting them in the instanceCount of
+// that mesh's indirect command; one glMultiDrawElementsIndirect with a
+// command per mesh then draws them. The vertex shader reads the object index
+// as an instanced attribute, so baseInstance selects the mesh's range.
+//
+// The CPU work per frame is constant: resetting the commands, the dispatch
+// and the draw, plus uploading the objects that moved. Needs GL 4.3.
+class GpuCulling {
+public:
+    GpuCulling();
+
+    static bool supported();
+    // Objects are 0..count-1 with the given meshes; boxes are per mesh.
+    // Transforms start as identity, set them with setTransform().
+    bool init(const MeshRenderer& renderer, const int* objectMeshes, size_t count, const Aabb* meshBounds);
+    void destroy();
+    bool ready() const { return cullProgram != 0; }
+
+    // Row-major world matrix of an object; uploaded with the next draw()
+    void setTransform(int object, const float* world);
+    void draw(const float* viewProjection);
+
+    // Objects drawn by the last draw(); reads back from the GPU, so it waits for it
+    size_t readVisibleCount();
+
+private:
+    std::vector<GpuCullObject> objects;
+    std::vector<DrawElementsIndirectCommand> emptyCommands; // instanceCount 0
+    int dirtyBegin, dirtyEnd; // objects to upload
+
+    GLuint objectBuffer, instanceBuffer, commandBuffer, emptyCommandBuffer;
+    GLuint vertexArray;
+    GLuint cullProgram, drawProgram;
+    GLint planesLocation, objectCountLocation, viewProjectionLocation;
+};
+
+#endif
@@ -0,0 +1,77 @@
+#include "input.h"
+#include <algorithm>
+
+InputSystem::InputSystem()
+    : repeatDelay(0.3), repeatInterval(1.0 / 20.0), currentMods(0) {
+    queue.reserve(64);
+    frameTriggers.reserve(64);
+}
+
+void InputSystem::setRepeat(double initialDelay, double rate) {
+    repeatDelay = initialDelay;
+    repeatInterval = rate > 0.0 ? 1.0 / rate : 0.0;
+}
+
+void InputSystem::enableRepeat(int key, bool enabled) {
+    if (key < 0 || key > GLFW_KEY_LAST) return;
+    keys[key].repeats = enabled;
+}
+
+void InputSystem::pushEvent(int key, int action, int mods, double time) {
+    if (key < 0 || key > GLFW_KEY_LAST || action == GLFW_REPEAT) return;
+    InputEvent event = {key, action, mods, time};
+    queue.push_back(event);
+}
+
+// Fires the repeats of a held key that are due up to the given time
+void InputSystem::emitRepeats(int key, double until) {
+    KeyState& state = keys[key];
+    if (repeatInterval <= 0.0) return;
+    while (state.nextRepeat <= until) {
+        KeyTrigger trigger = {key, currentMods, state.nextRepeat, true};
+        frameTriggers.push_back(trigger);
+        state.nextRepeat += repeatInterval;
+    }
+}
+
+void InputSystem::update(double now) {
+    frameTriggers.clear();
+
+    size_t processed = 0;
+    for (; processed < queue.size() && queue[processed].time <= now; processed++) {
+        const InputEvent& event = queue[processed];
+        KeyState& state = keys[event.key];
+
+        if (event.action == GLFW_PRESS && !state.down) {
+            currentMods = event.mods;
+            state.down = true;
+            KeyTrigger trigger = {event.key, currentMods, event.time, false};
+            frameTriggers.push_back(trigger);
+
+            if (state.repeats) {
+                state.nextRepeat = event.time + repeatDelay;
+                heldRepeatKeys.push_back(event.key);
+            }
+        } else if (event.action == GLFW_RELEASE && state.down) {
+            // Repeats that were due before the key went up still count
+            if (state.repeats) {
+                emitRepeats(event.key, event.time);
+                heldRepeatKeys.erase(std::remove(heldRepeatKeys.begin(), heldRepeatKeys.end(), event.key),
+                                     heldRepeatKeys.end());
+            }
+            currentMods = event.mods;
+            state.down = false;
+        } else {
+            currentMods = event.mods;
+        }
+
+        // Release events may still report the modifier that went up
+        if (event.key == GLFW_KEY_LEFT_SHIFT || event.key == GLFW_KEY_RIGHT_SHIFT) {
+            if (keys[GLFW_KEY_LEFT_SHIFT].down || keys[GLFW_KEY_RIGHT_SHIFT].down) currentMods |= GLFW_MOD_SHIFT;
+            else currentMods &= ~GLFW_MOD_SHIFT;
+        }
+    }
+    queue.erase(queue.begin(), queue.begin() + processed);
+
+    for (int key : heldRepeatKeys) emitRepeats(key, now);
+}
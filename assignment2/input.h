@@ -0,0 +1,60 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <GLFW/glfw3.h>
+#include <vector>
+
+// Key event as delivered by the GLFW key callback, stamped with glfwGetTime()
+struct InputEvent {
+    int key;
+    int action; // GLFW_PRESS or GLFW_RELEASE (OS key repeat is ignored)
+    int mods;
+    double time;
+};
+
+// One logical key activation: the initial press or a timed repeat
+struct KeyTrigger {
+    int key;
+    int mods; // modifier state when the trigger fired
+    double time;
+    bool repeat;
+};
+
+// Event-driven keyboard input. Key callbacks are queued with timestamps and
+// turned into triggers once per frame by update(). Keys with repeat enabled
+// fire again after an initial delay and then at a fixed rate, based on the
+// event timestamps, so the number of triggers per second does not depend on
+// the frame rate.
+class InputSystem {
+public:
+    InputSystem();
+
+    void setRepeat(double initialDelay, double rate);
+    void enableRepeat(int key, bool enabled = true);
+
+    // Called from the window's key callback, or with recorded events during a replay
+    void pushEvent(int key, int action, int mods, double time);
+
+    // Processes events queued up to `now` and collects this frame's triggers
+    void update(double now);
+
+    const std::vector<KeyTrigger>& triggers() const { return frameTriggers; }
+
+private:
+    struct KeyState {
+        bool down = false;
+        bool repeats = false;
+        double nextRepeat = 0.0;
+    };
+
+    KeyState keys[GLFW_KEY_LAST + 1];
+    std::vector<int> heldRepeatKeys;
+    std::vector<InputEvent> queue;
+    std::vector<KeyTrigger> frameTriggers;
+    double repeatDelay, repeatInterval;
+    int currentMods;
+
+    void emitRepeats(int key, double until);
+};
+
+#endif
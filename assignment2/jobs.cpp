@@ -0,0 +1,224 @@
+#include "jobs.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#define CPU_RELAX() _mm_pause()
+#else
+#define CPU_RELAX() std::this_thread::yield()
+#endif
+
+// Rounds of looking for work before an idle thread sleeps; frames submit
+// bursts of jobs, so the next one usually comes within these
+const int SPIN_ROUNDS = 64;
+
+// The queue owned by the current thread, if it belongs to a pool
+static thread_local const JobSystem* workerSystem = nullptr;
+static thread_local int workerQueue = -1;
+
+void JobDeque::Slot::store(const Job& job) {
+    func.store(job.func, std::memory_order_relaxed);
+    data.store(job.data, std::memory_order_relaxed);
+    begin.store(job.begin, std::memory_order_relaxed);
+    end.store(job.end, std::memory_order_relaxed);
+    counter.store(job.counter, std::memory_order_relaxed);
+}
+
+Job JobDeque::Slot::load() const {
+    Job job = {func.load(std::memory_order_relaxed), data.load(std::memory_order_relaxed),
+               begin.load(std::memory_order_relaxed), end.load(std::memory_order_relaxed),
+               counter.load(std::memory_order_relaxed)};
+    return job;
+}
+
+JobDeque::JobDeque(size_t capacity) : top(0), bottom(0) {
+    int64_t size = 1;
+    while (size < (int64_t)capacity) size *= 2;
+    rings.emplace_back(makeRing(size));
+    ring.store(rings.back().get(), std::memory_order_relaxed);
+}
+
+JobDeque::Ring* JobDeque::makeRing(int64_t capacity) {
+    Ring* r = new Ring();
+    r->mask = capacity - 1;
+    r->slots.reset(new Slot[capacity]);
+    return r;
+}
+
+void JobDeque::push(const Job& job) {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    Ring* r = ring.load(std::memory_order_relaxed);
+    if (b - t > r->mask) {
+        // Full: copy the queued jobs into a ring twice the size
+        Ring* bigger = makeRing(2 * (r->mask + 1));
+        for (int64_t i = t; i < b; i++) bigger->at(i).store(r->at(i).load());
+        rings.emplace_back(bigger);
+        ring.store(bigger, std::memory_order_release);
+        r = bigger;
+    }
+    r->at(b).store(job);
+    // Publishes the slot to thieves that see the new bottom
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+}
+
+bool JobDeque::take(Job& job) {
+    // Claim the bottom job first, then see whether a thief got there too
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    Ring* r = ring.load(std::memory_order_relaxed);
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+    if (t > b) {
+        bottom.store(b + 1, std::memory_order_relaxed); // was empty
+        return false;
+    }
+    job = r->at(b).load();
+    if (t < b) return true;
+
+    // The last job: race the thieves for it through top
+    bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return won;
+}
+
+bool JobDeque::steal(Job& job) {
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b) return false;
+    Ring* r = ring.load(std::memory_order_acquire);
+    Job stolen = r->at(t).load();
+    // The slot may have been reused once top moved on; then this fails and the read is dropped
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return false;
+    job = stolen;
+    return true;
+}
+
+JobSystem::JobSystem() : queuedJobs(0), sleepingWorkers(0), finishedGroups(0), quit(false) {
+}
+
+JobSystem::~JobSystem() {
+    stop();
+}
+
+void JobSystem::start(unsigned threadCount) {
+    stop();
+    if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    quit = false;
+    queuedJobs = 0;
+    for (unsigned i = 0; i < threadCount; i++) queues.emplace_back(new JobDeque());
+    workerSystem = this;
+    workerQueue = 0;
+    for (unsigned i = 1; i < threadCount; i++) workers.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+void JobSystem::stop() {
+    if (queues.empty()) return;
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        quit = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) worker.join();
+    workers.clear();
+    queues.clear();
+    if (workerSystem == this) {
+        workerSystem = nullptr;
+        workerQueue = -1;
+    }
+}
+
+int JobSystem::currentQueue() const {
+    return workerSystem == this ? workerQueue : -1;
+}
+
+void JobSystem::push(unsigned self, const Job& job) {
+    job.counter->pending.fetch_add(1);
+    queues[self]->push(job);
+    queuedJobs.fetch_add(1);
+}
+
+void JobSystem::wakeWorkers(bool all) {
+    // Taking the lock orders this with a worker that is about to sleep
+    if (sleepingWorkers.load() == 0) return;
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    if (all) wake.notify_all();
+    else wake.notify_one();
+}
+
+void JobSystem::run(const Job& job) {
+    int self = currentQueue();
+    if (self < 0) {
+        // Not started, or a thread without a deque: run inline
+        job.func(job.data, job.begin, job.end);
+        return;
+    }
+    push((unsigned)self, job);
+    wakeWorkers(false);
+}
+
+bool JobSystem::runOne(int self) {
+    Job job = {};
+    // Own work first, newest job (its data is likely still in cache)
+    bool found = self >= 0 && queues[self]->take(job);
+
+    // Otherwise steal the oldest job of another thread
+    size_t count = queues.size();
+    size_t first = self >= 0 ? (size_t)self + 1 : 0;
+    for (size_t i = 0; !found && i < count; i++) {
+        size_t victim = (first + i) % count;
+        if ((int)victim != self) found = queues[victim]->steal(job);
+    }
+    if (!found) return false;
+
+    queuedJobs.fetch_sub(1);
+    job.func(job.data, job.begin, job.end);
+    if (job.counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        // The counter may be gone once its waiter sees zero, so wake waiters through the pool
+        finishedGroups.fetch_add(1);
+        finishedGroups.notify_all();
+    }
+    return true;
+}
+
+void JobSystem::wait(JobCounter& counter) {
+    if (queues.empty()) return;
+    int self = currentQueue();
+    int idleRounds = 0;
+    for (;;) {
+        uint32_t finished = finishedGroups.load();
+        if (counter.pending.load(std::memory_order_acquire) == 0) return;
+        if (runOne(self)) {
+            idleRounds = 0;
+        } else if (++idleRounds < SPIN_ROUNDS) {
+            CPU_RELAX();
+        } else {
+            // Every job left is running on another thread; sleep until a group finishes
+            finishedGroups.wait(finished);
+            idleRounds = 0;
+        }
+    }
+}
+
+void JobSystem::workerLoop(unsigned index) {
+    workerSystem = this;
+    workerQueue = (int)index;
+    int idleRounds = 0;
+    while (!quit.load()) {
+        if (runOne((int)index)) {
+            idleRounds = 0;
+            continue;
+        }
+        if (++idleRounds < SPIN_ROUNDS) {
+            CPU_RELAX();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleepingWorkers.fetch_add(1);
+        wake.wait(lock, [this]() { return quit.load() || queuedJobs.load() > 0; });
+        sleepingWorkers.fetch_sub(1);
+        idleRounds = 0;
+    }
+}
@@ -0,0 +1,138 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Number of unfinished jobs in a group. run() increments it, the job
+// decrements it when done; wait() returns once it is back to zero, so later
+// work can depend on everything counted here.
+struct JobCounter {
+    std::atomic<int> pending{0};
+};
+
+// A job processes the index range [begin, end) of some data
+struct Job {
+    void (*func)(void* data, size_t begin, size_t end);
+    void* data;
+    size_t begin, end;
+    JobCounter* counter;
+};
+
+// Chase-Lev work-stealing deque, with the C11 memory orderings of Le et al.,
+// "Correct and Efficient Work-Stealing for Weak Memory Models" (PPoPP 2013).
+// One owner thread pushes and takes jobs at the bottom without locks; other
+// threads steal from the top with one compare-and-swap, which only contends
+// with the owner over the last job. The ring doubles when full; outgrown rings
+// are kept until the deque is destroyed, since a thief may still read one.
+class JobDeque {
+public:
+    explicit JobDeque(size_t capacity = 1024);
+    JobDeque(const JobDeque&) = delete;
+    JobDeque& operator=(const JobDeque&) = delete;
+
+    void push(const Job& job); // owner only
+    bool take(Job& job);       // owner only, newest job first
+    bool steal(Job& job);      // any thread, oldest job first; false when empty or lost to another thread
+
+private:
+    // A job in fields that may be read while being overwritten; such reads lose the race and are dropped
+    struct Slot {
+        std::atomic<void (*)(void*, size_t, size_t)> func;
+        std::atomic<void*> data;
+        std::atomic<size_t> begin, end;
+        std::atomic<JobCounter*> counter;
+
+        void store(const Job& job);
+        Job load() const;
+    };
+    struct Ring {
+        int64_t mask; // capacity - 1, a power of two minus one
+        std::unique_ptr<Slot[]> slots;
+        Slot& at(int64_t i) { return slots[i & mask]; }
+    };
+
+    alignas(64) std::atomic<int64_t> top; // stolen from here
+    alignas(64) std::atomic<int64_t> bottom; // pushed and taken here
+    std::atomic<Ring*> ring;
+    std::vector<std::unique_ptr<Ring>> rings; // the current one last; owner only
+
+    static Ring* makeRing(int64_t capacity);
+};
+
+// Work-stealing thread pool. Every thread (workers and the thread that calls
+// start()) owns a JobDeque: it pushes and takes its own jobs at the bottom,
+// idle threads steal from the top of the others. Threads waiting on a counter
+// run jobs instead of blocking, so waiting inside a job cannot deadlock; with
+// nothing left to run they sleep until a job group finishes. Threads outside
+// the pool own no deque and run the jobs they submit inline.
+class JobSystem {
+public:
+    JobSystem();
+    ~JobSystem();
+
+    // threadCount includes the calling thread; 0 uses every hardware thread
+    void start(unsigned threadCount = 0);
+    void stop();
+    unsigned threadCount() const { return queues.empty() ? 1 : (unsigned)queues.size(); }
+
+    void run(const Job& job);
+    void wait(JobCounter& counter);
+
+    // Calls f(begin, end) on chunks of [begin, end) of at least minChunk
+    // indices, in parallel, and returns when all chunks are done
+    template <typename Func> void parallelFor(size_t begin, size_t end, size_t minChunk, const Func& f);
+
+private:
+    // The rings start large enough for a frame's jobs, so pushing and taking
+    // them does not allocate once a deque has grown to the busiest frame
+    std::vector<std::unique_ptr<JobDeque>> queues; // 0 belongs to the thread that called start()
+    std::vector<std::thread> workers;
+    std::atomic<int> queuedJobs;
+    std::atomic<int> sleepingWorkers;
+    std::atomic<uint32_t> finishedGroups; // bumped when a counter reaches zero, for wait() to sleep on
+    std::atomic<bool> quit;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+
+    void push(unsigned self, const Job& job);
+    void wakeWorkers(bool all);
+    bool runOne(int self);
+    int currentQueue() const; // -1 outside the pool
+    void workerLoop(unsigned index);
+
+    template <typename Func> static void invokeRange(void* data, size_t begin, size_t end) {
+        (*(const Func*)data)(begin, end);
+    }
+};
+
+template <typename Func>
+void JobSystem::parallelFor(size_t begin, size_t end, size_t minChunk, const Func& f) {
+    if (begin >= end) return;
+    size_t count = end - begin;
+    unsigned threads = threadCount();
+    // About four chunks per thread, so stealing can even out uneven chunks
+    size_t chunk = std::max(std::max(minChunk, (size_t)1), (count + threads * 4 - 1) / (threads * 4));
+    int self = currentQueue();
+    if (threads == 1 || count <= chunk || self < 0) {
+        f(begin, end);
+        return;
+    }
+
+    JobCounter counter;
+    for (size_t b = begin; b < end; b += chunk) {
+        Job job = {&invokeRange<Func>, (void*)&f, b, std::min(end, b + chunk), &counter};
+        push((unsigned)self, job);
+    }
+    wakeWorkers(true);
+    wait(counter);
+}
+
+#endif
@@ -0,0 +1,150 @@
+#include "latency.h"
+#include "logger.h"
+#include <algorithm>
+
+const GLuint64 FENCE_TIMEOUT_NS = 100000000; // 100 ms per try; a lost context must not hang the loop forever
+const int FENCE_TRIES = 20;
+const double MAX_LATENCY = 2.0; // seconds; longer results are stalls (menus, window moves) or driver glitches
+
+FrameFences::FrameFences() : maxFrames(0), oldest(0), count(0), waitSeconds(0.0), frames(0) {
+    for (int i = 0; i < MAX_FRAMES; i++) fences[i] = nullptr;
+}
+
+bool FrameFences::init(int frameCount) {
+    maxFrames = 0;
+    if (frameCount <= 0) return true;
+    if (!GLEW_VERSION_3_2 && !GLEW_ARB_sync) return false;
+    maxFrames = std::min(frameCount, (int)MAX_FRAMES); // a copy, as std::min takes references
+    return true;
+}
+
+void FrameFences::destroy() {
+    for (int i = 0; i < count; i++) glDeleteSync(fences[(oldest + i) % MAX_FRAMES]);
+    oldest = count = 0;
+    maxFrames = 0;
+}
+
+void FrameFences::waitForFrame() {
+    if (!maxFrames) return;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while (count >= maxFrames) {
+        GLsync fence = fences[oldest];
+        GLenum result = GL_TIMEOUT_EXPIRED;
+        for (int i = 0; i < FENCE_TRIES && result == GL_TIMEOUT_EXPIRED; i++) {
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+        }
+        if (result == GL_TIMEOUT_EXPIRED || result == GL_WAIT_FAILED) logWarning("Frame fence wait failed");
+        glDeleteSync(fence);
+        oldest = (oldest + 1) % MAX_FRAMES;
+        count--;
+    }
+    waitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    frames++;
+}
+
+void FrameFences::frameSubmitted() {
+    if (!maxFrames) return;
+    fences[(oldest + count) % MAX_FRAMES] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    count++;
+}
+
+void FrameFences::logSummary() const {
+    if (!maxFrames || !frames) return;
+    logInfo("Frame fences: at most %d frame%s queued, %.3f ms waited per frame", maxFrames, maxFrames == 1 ? "" : "s",
+            1000.0 * waitedPerFrame());
+}
+
+LatencyMeter::LatencyMeter() : useQueries(false), nextSlot(0), waitingCount(0), dropped(0) {
+    for (int i = 0; i < SLOTS; i++) {
+        slots[i].query = 0;
+        slots[i].pending = false;
+        slots[i].eventCount = 0;
+    }
+}
+
+void LatencyMeter::init(bool gpuTimestamps) {
+    useQueries = gpuTimestamps && (GLEW_VERSION_3_3 || GLEW_ARB_timer_query);
+    if (!useQueries) return;
+    for (int i = 0; i < SLOTS; i++) glGenQueries(1, &slots[i].query);
+}
+
+void LatencyMeter::destroy() {
+    for (int i = 0; i < SLOTS; i++) {
+        if (slots[i].query) glDeleteQueries(1, &slots[i].query);
+        slots[i].query = 0;
+        slots[i].pending = false;
+    }
+    useQueries = false;
+}
+
+void LatencyMeter::inputDelivered() {
+    if (waitingCount == MAX_EVENTS) {
+        dropped++;
+        return;
+    }
+    waiting[waitingCount++] = Clock::now();
+}
+
+void LatencyMeter::addLatency(Clock::time_point delivered, Clock::time_point presented) {
+    double seconds = std::chrono::duration<double>(presented - delivered).count();
+    if (seconds < 0.0 || seconds > MAX_LATENCY) {
+        dropped++;
+        return;
+    }
+    latencies.addFrame(seconds);
+}
+
+// Takes every finished present time, oldest first, and stops at the first one still running
+void LatencyMeter::readQueries() {
+    for (int n = 0; n < SLOTS; n++) {
+        Slot& slot = slots[(nextSlot + n) % SLOTS];
+        if (!slot.pending) continue;
+        GLint available = 0;
+        glGetQueryObjectiv(slot.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) break;
+        GLuint64 gpuTime = 0;
+        glGetQueryObjectui64v(slot.query, GL_QUERY_RESULT, &gpuTime);
+        Clock::time_point presented =
+            slot.cpuBase + std::chrono::duration_cast<Clock::duration>(
+                               std::chrono::nanoseconds((GLint64)gpuTime - slot.gpuBase));
+        for (int i = 0; i < slot.eventCount; i++) addLatency(slot.delivered[i], presented);
+        slot.pending = false;
+    }
+}
+
+void LatencyMeter::framePresented() {
+    if (!useQueries) {
+        Clock::time_point now = Clock::now();
+        for (int i = 0; i < waitingCount; i++) addLatency(waiting[i], now);
+        waitingCount = 0;
+        return;
+    }
+
+    readQueries();
+    if (waitingCount == 0) return;
+    Slot& slot = slots[nextSlot];
+    if (slot.pending) {
+        // The GPU is a whole ring of frames behind; these events go unmeasured
+        dropped += waitingCount;
+        waitingCount = 0;
+        return;
+    }
+    glQueryCounter(slot.query, GL_TIMESTAMP);
+    glGetInteger64v(GL_TIMESTAMP, &slot.gpuBase);
+    slot.cpuBase = Clock::now();
+    std::copy(waiting, waiting + waitingCount, slot.delivered);
+    slot.eventCount = waitingCount;
+    slot.pending = true;
+    waitingCount = 0;
+    nextSlot = (nextSlot + 1) % SLOTS;
+}
+
+void LatencyMeter::logSummary(const char* name) const {
+    if (latencies.count() == 0) return;
+    logInfo("%s input to present latency over %u events: mean %.1f ms, min %.1f ms, median %.1f ms, 99th "
+            "percentile %.1f ms, max %.1f ms%s",
+            name, latencies.count(), 1000.0 * latencies.meanSeconds(), 1000.0 * latencies.minSeconds(),
+            1000.0 * latencies.percentile(0.5), 1000.0 * latencies.percentile(0.99), 1000.0 * latencies.maxSeconds(),
+            useQueries ? " (GPU timestamps)" : "");
+    if (dropped) logInfo("%u input events not measured", dropped);
+}
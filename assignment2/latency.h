@@ -0,0 +1,90 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "pacing.h"
+#include <GL/glew.h>
+#include <chrono>
+
+// Limits how many frames the driver may queue ahead of the GPU. A fence goes
+// into the command stream after each swap, and before building a new frame
+// the CPU waits until fewer than maxFrames of them are unsignaled. Input
+// sampled after the wait then reaches the screen after at most that many
+// frames of GPU work instead of the driver's own queue depth (often 2-3).
+class FrameFences {
+public:
+    FrameFences();
+
+    // 0 leaves queuing to the driver; needs GL 3.2 or ARB_sync in the current context
+    bool init(int maxFrames);
+    void destroy();
+    bool ready() const { return maxFrames > 0; }
+
+    // Before building a frame
+    void waitForFrame();
+    // Right after the swap
+    void frameSubmitted();
+
+    double waitedPerFrame() const { return frames ? waitSeconds / frames : 0.0; } // seconds
+    void logSummary() const;
+
+private:
+    static const int MAX_FRAMES = 4;
+
+    int maxFrames;
+    GLsync fences[MAX_FRAMES]; // ring, oldest first
+    int oldest, count;
+    double waitSeconds;
+    unsigned frames;
+};
+
+// Input-to-present latency of single input events. Events are stamped when
+// the window system delivers them (glfwPollEvents), and the frame presented
+// next is the first one to show them. Its present time is a GL timestamp
+// query issued right after the swap, so it counts when the GPU has finished
+// the frame and the swap rather than when the CPU returned from it; the
+// result is read a few frames later without waiting and moved to the CPU
+// clock with a GL_TIMESTAMP / steady_clock pair taken when it was issued.
+// Without timer queries (or a GL context) the CPU time after the swap is used.
+class LatencyMeter {
+public:
+    LatencyMeter();
+
+    // gpuTimestamps: use timer queries of the current context (GL 3.3 or ARB_timer_query)
+    void init(bool gpuTimestamps);
+    void destroy();
+
+    // Call from the input callbacks for events that change the image
+    void inputDelivered();
+    // Right after the swap; assigns the events delivered since the last present to this frame
+    void framePresented();
+
+    const FrameTimeStats& stats() const { return latencies; }
+    void logSummary(const char* name) const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+    static const int SLOTS = 8;      // frames with events whose present time is still unknown
+    static const int MAX_EVENTS = 32; // per frame; more are counted as dropped
+
+    struct Slot {
+        GLuint query;
+        bool pending;
+        GLint64 gpuBase;          // GL_TIMESTAMP when the query was issued
+        Clock::time_point cpuBase; // and the CPU time then
+        int eventCount;
+        Clock::time_point delivered[MAX_EVENTS];
+    };
+
+    bool useQueries;
+    Slot slots[SLOTS];
+    int nextSlot;
+    Clock::time_point waiting[MAX_EVENTS]; // delivered since the last present
+    int waitingCount;
+    unsigned dropped;
+    FrameTimeStats latencies;
+
+    void readQueries();
+    void addLatency(Clock::time_point delivered, Clock::time_point presented);
+};
+
+#endif
@@ -0,0 +1,273 @@
+#include "logger.h"
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+namespace {
+
+const size_t QUEUE_SIZE = 1024; // power of two
+const size_t MESSAGE_SIZE = 240;
+const int RATE_SLOTS = 64;
+const int RATE_PROBES = 8; // slots searched from a call site's hash
+
+// Bounded multi-producer / single-consumer queue (Vyukov). Each slot carries
+// a sequence number telling whether it is free for the producer at position
+// pos (sequence == pos) or holds a message for the consumer (sequence == pos + 1).
+struct Slot {
+    std::atomic<size_t> sequence;
+    LogLevel level;
+    char text[MESSAGE_SIZE];
+};
+
+// Fixed one-second window counter for one call site, owned by its format
+// string until the site has been quiet for a window
+struct RateSlot {
+    std::atomic<const char*> format;
+    std::atomic<int64_t> windowStart;
+    std::atomic<int> count;
+};
+
+Slot queue[QUEUE_SIZE];
+std::atomic<size_t> enqueuePos(0);
+size_t dequeuePos = 0;
+std::atomic<size_t> writtenCount(0);
+
+RateSlot rateSlots[RATE_SLOTS];
+std::atomic<int> maxPerSecond(20);
+std::atomic<int> minLevel((int)LogLevel::Info);
+std::atomic<unsigned> droppedCount(0);    // queue full
+std::atomic<unsigned> suppressedCount(0); // rate limited
+
+std::thread writerThread;
+std::atomic<bool> running(false);
+std::atomic<bool> stopRequested(false);
+std::atomic<int> activeProducers(0); // inside vlogMessage's enqueue path
+
+int64_t nowMilliseconds() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Call sites are identified by their format string literal. A site uses the
+// first slot it owns among RATE_PROBES after its hash, or else claims one that
+// is free or idle; null when all of them are busy with other sites.
+RateSlot* findRateSlot(const char* format, int64_t now) {
+    size_t first = ((uintptr_t)format >> 4) % RATE_SLOTS;
+    for (int i = 0; i < RATE_PROBES; i++) {
+        RateSlot& slot = rateSlots[(first + i) % RATE_SLOTS];
+        if (slot.format.load(std::memory_order_acquire) == format) return &slot;
+    }
+    for (int i = 0; i < RATE_PROBES; i++) {
+        RateSlot& slot = rateSlots[(first + i) % RATE_SLOTS];
+        const char* owner = slot.format.load(std::memory_order_acquire);
+        bool idle = !owner || now - slot.windowStart.load(std::memory_order_relaxed) >= 1000;
+        if (idle && slot.format.compare_exchange_strong(owner, format, std::memory_order_acq_rel)) {
+            slot.windowStart.store(now, std::memory_order_relaxed);
+            slot.count.store(0, std::memory_order_relaxed);
+            return &slot;
+        }
+        if (owner == format) return &slot; // claimed by another thread of this site
+    }
+    return nullptr;
+}
+
+bool rateAllowed(const char* format) {
+    int limit = maxPerSecond.load(std::memory_order_relaxed);
+    if (limit <= 0) return true;
+
+    int64_t now = nowMilliseconds();
+    RateSlot* slot = findRateSlot(format, now);
+    if (!slot) return true; // too many busy call sites to track this one
+    int64_t start = slot->windowStart.load(std::memory_order_relaxed);
+    if (now - start >= 1000 && slot->windowStart.compare_exchange_strong(start, now, std::memory_order_relaxed)) {
+        slot->count.store(0, std::memory_order_relaxed);
+    }
+    return slot->count.fetch_add(1, std::memory_order_relaxed) < limit;
+}
+
+void writeLine(std::string& out, LogLevel level, const char* text) {
+    if (level == LogLevel::Warning) out += "[warning] ";
+    else if (level == LogLevel::Error) out += "[error] ";
+    out += text;
+    out += '\n';
+}
+
+// Moves everything queued to stdout; returns the number of messages written
+size_t drain() {
+    std::string out;
+    size_t written = 0;
+    for (;;) {
+        Slot& slot = queue[dequeuePos & (QUEUE_SIZE - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != dequeuePos + 1) break;
+        writeLine(out, slot.level, slot.text);
+        slot.sequence.store(dequeuePos + QUEUE_SIZE, std::memory_order_release);
+        dequeuePos++;
+        written++;
+    }
+
+    unsigned dropped = droppedCount.exchange(0, std::memory_order_relaxed);
+    unsigned suppressed = suppressedCount.exchange(0, std::memory_order_relaxed);
+    char note[64];
+    if (dropped) {
+        snprintf(note, sizeof(note), "[log] %u messages dropped (queue full)", dropped);
+        writeLine(out, LogLevel::Info, note);
+    }
+    if (suppressed) {
+        snprintf(note, sizeof(note), "[log] %u messages rate limited", suppressed);
+        writeLine(out, LogLevel::Info, note);
+    }
+
+    if (!out.empty()) {
+        fwrite(out.data(), 1, out.size(), stdout);
+        fflush(stdout);
+    }
+    writtenCount.fetch_add(written, std::memory_order_release);
+    return written;
+}
+
+void writerLoop() {
+    while (!stopRequested.load()) {
+        if (drain() == 0) std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    // Producers that got in before the stop may still be filling their slots
+    while (activeProducers.load() > 0) std::this_thread::yield();
+    drain();
+}
+
+void initQueue() {
+    for (size_t i = 0; i < QUEUE_SIZE; i++) queue[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+struct QueueInit {
+    QueueInit() { initQueue(); }
+} queueInit;
+
+// Stops the writer on any exit path so the joinable thread is never destroyed
+struct WriterShutdown {
+    ~WriterShutdown();
+} writerShutdown;
+
+void enqueueMessage(LogLevel level, const char* format, va_list args) {
+    if (level != LogLevel::Error && !rateAllowed(format)) {
+        suppressedCount.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // Claim a slot
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+        slot = &queue[pos & (QUEUE_SIZE - 1)];
+        size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+        if (diff == 0) {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (diff < 0) {
+            droppedCount.fetch_add(1, std::memory_order_relaxed); // full
+            return;
+        } else {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->level = level;
+    vsnprintf(slot->text, MESSAGE_SIZE, format, args);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+}
+
+void vlogMessage(LogLevel level, const char* format, va_list args) {
+    if ((int)level < minLevel.load(std::memory_order_relaxed)) return;
+
+    // Announced before looking at stopRequested, so the writer either sees
+    // this producer and waits for it, or the producer sees the stop
+    activeProducers.fetch_add(1);
+    if (running.load(std::memory_order_acquire) && !stopRequested.load()) {
+        enqueueMessage(level, format, args);
+        activeProducers.fetch_sub(1, std::memory_order_release);
+        return;
+    }
+    activeProducers.fetch_sub(1, std::memory_order_relaxed);
+
+    // No writer thread (not started, stopping or stopped): write directly
+    char text[MESSAGE_SIZE];
+    vsnprintf(text, sizeof(text), format, args);
+    std::string out;
+    writeLine(out, level, text);
+    fwrite(out.data(), 1, out.size(), stdout);
+}
+
+} // namespace
+
+WriterShutdown::~WriterShutdown() {
+    logStop();
+}
+
+void logStart(LogLevel level, int perSecond) {
+    if (running.load()) return;
+    minLevel.store((int)level);
+    maxPerSecond.store(perSecond);
+    stopRequested.store(false);
+    running.store(true, std::memory_order_release);
+    writerThread = std::thread(writerLoop);
+}
+
+void logStop() {
+    if (!running.load()) return;
+    stopRequested.store(true);
+    writerThread.join();
+    running.store(false, std::memory_order_release);
+}
+
+void logFlush() {
+    if (!running.load(std::memory_order_acquire)) {
+        fflush(stdout);
+        return;
+    }
+    size_t target = enqueuePos.load(std::memory_order_acquire);
+    while (writtenCount.load(std::memory_order_acquire) < target) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void logSetLevel(LogLevel level) {
+    minLevel.store((int)level);
+}
+
+void logMessage(LogLevel level, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vlogMessage(level, format, args);
+    va_end(args);
+}
+
+void logDebug(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vlogMessage(LogLevel::Debug, format, args);
+    va_end(args);
+}
+
+void logInfo(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vlogMessage(LogLevel::Info, format, args);
+    va_end(args);
+}
+
+void logWarning(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vlogMessage(LogLevel::Warning, format, args);
+    va_end(args);
+}
+
+void logError(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vlogMessage(LogLevel::Error, format, args);
+    va_end(args);
+}
@@ -0,0 +1,31 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+// Asynchronous console logger. Messages are formatted into a lock-free ring
+// buffer and written by a background thread, so callers never block on
+// terminal I/O. Each call site (format string) is rate limited separately.
+
+#if defined(__GNUC__)
+#define LOG_PRINTF_FORMAT(fmt, args) __attribute__((format(printf, fmt, args)))
+#else
+#define LOG_PRINTF_FORMAT(fmt, args)
+#endif
+
+enum class LogLevel { Debug, Info, Warning, Error };
+
+// Starts the writer thread. maxPerSecond limits messages per call site
+// (errors are never limited).
+void logStart(LogLevel minLevel = LogLevel::Info, int maxPerSecond = 20);
+// Writes everything still queued and stops the writer thread
+void logStop();
+// Blocks until all messages queued so far are written (e.g. before reading std::cin)
+void logFlush();
+void logSetLevel(LogLevel level);
+
+void logMessage(LogLevel level, const char* format, ...) LOG_PRINTF_FORMAT(2, 3);
+void logDebug(const char* format, ...) LOG_PRINTF_FORMAT(1, 2);
+void logInfo(const char* format, ...) LOG_PRINTF_FORMAT(1, 2);
+void logWarning(const char* format, ...) LOG_PRINTF_FORMAT(1, 2);
+void logError(const char* format, ...) LOG_PRINTF_FORMAT(1, 2);
+
+#endif
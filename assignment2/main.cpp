@@ -1,10 +1,33 @@
 #define _USE_MATH_DEFINES
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include <chrono>
+#include <climits>
 #include <iostream>
 #include <vector>
 #include <cmath>
+#include <mutex>
 #include <random>
+#include "allocators.h"
+#include "animation_scheduler.h"
+#include "capture.h"
+#include "command_list.h"
+#include "circles.h"
+#include "ecs.h"
+#include "gpu_circles.h"
+#include "jobs.h"
+#include "latency.h"
+#include "logger.h"
+#include "options.h"
+#include "matrix.h"
+#include "pacing.h"
+#include "region.h"
+#include "render_queue.h"
+#include "replay.h"
+#include "scene_graph.h"
+#include "snapshot.h"
+#include "soft_present.h"
+#include "soft_raster.h"
 
 // Global variables
 GLFWwindow* mainWindow = nullptr;
@@ -14,36 +37,175 @@ GLFWwindow* secondWindow = nullptr;
 bool animationEnabled = true;
 
 // Colors
-float squareColor[3] = {1.0f, 1.0f, 1.0f}; // White
 float subWindowBgColor[3] = {0.2f, 0.2f, 0.5f}; // Blue-gray
-float circleTriangleColor[3] = {1.0f, 0.0f, 0.0f}; // Red
 
-// Animation parameters
-float squareRotation = 0.0f;
-float triangleRotation = 0.0f;
-float circleScale = 1.0f;
-bool circleGrowing = true;
+// Shapes and where they are drawn (Renderable component values)
+enum Shape { SHAPE_SQUARE, SHAPE_ELLIPSE, SHAPE_CIRCLE, SHAPE_TRIANGLE, SHAPE_BREATHING_CIRCLE };
+enum Layer { LAYER_MAIN_WINDOW, LAYER_SUBWINDOW, LAYER_SECOND_WINDOW, LAYER_COUNT };
+// How a shape is drawn: the program field of its sort key. Breathing circles
+// sort after the other shapes, so they stay on top of the square.
+enum ShapeProgram { PROGRAM_SHAPES, PROGRAM_CIRCLE_BATCH };
 
-// Breathing circles
-struct BreathingCircle {
-    float x, y;
-    float color[3];
-    float scale;
-    bool growing;
-};
-std::vector<BreathingCircle> breathingCircles;
+// Every shape is an entity; its transform lives in a scene graph node
+SceneGraph scene;
+EntityWorld world;
+AnimationScheduler animations(scene); // spinning and breathing, as coroutines
+Entity squareEntity;   // main window: rotating black & white square
+Entity ellipseEntity;  // subwindow: ellipse
+Entity circleEntity;   // second window: breathing circle
+Entity triangleEntity; // second window: rotating triangle
+int mainWindowNode = -1;
+int subWindowNode = -1;
+int secondWindowNode = -1;
 
 const float PI = 3.14159265358979323846f;
 
-// Subwindow position and size in normalized coordinates
-float subWindowX = 0.6f;
-float subWindowY = 0.6f;
-float subWindowSize = 0.3f;
+// Breathing circles are drawn as triangle batches, built each frame in the
+// command lists (x, y, r, g, b per vertex)
+const int CIRCLE_SEGMENTS = 50;
+const size_t CIRCLES_PER_BATCH = 4096; // per draw; drivers fail on multi-gigabyte vertex arrays
+const int BREATHING_CIRCLE_RESERVE = 1024; // circles added by clicks before anything reallocates
+const float BREATHING_MIN_SCALE = 0.5f, BREATHING_MAX_SCALE = 2.0f;
+const float BREATHING_START_SCALE = 0.5f, BREATHING_SPEED = 0.02f; // scale units per frame
+float unitCircle[2 * (CIRCLE_SEGMENTS + 1)];
+FrameAllocationStats allocationStats;
+
+// Worker threads for the per-frame updates
+JobSystem jobs;
+
+// Every shape entity's draw for this frame, sorted by layer, program and shape.
+// Worker threads record each layer's part into command lists, including the
+// circle batches, and the windows' contexts only execute them.
+RenderQueue renderQueue;
+CommandListSet layerCommands[LAYER_COUNT];
+std::mutex queueStatsMutex;
+const size_t SHAPES_PER_JOB = 256;
+
+// Regions of the main window; the subwindow is a child of the root region
+RegionTree mainRegions;
+int subWindowRegion = -1;
 
 // Flag to force window refresh
 bool needsRefresh = false;
 
-void drawBlackWhiteSquare() {
+// Input recording / replay; the breathing circle colors come from the recorded seed
+enum ReplayWindow { REPLAY_MAIN_WINDOW, REPLAY_SECOND_WINDOW };
+enum ReplayMenu { MENU_MAIN, MENU_SUBWINDOW };
+ReplaySession session;
+std::mt19937 randomGenerator;
+
+// Optional capture of the main window (--capture)
+FrameCapture capture;
+
+// Frame rate limit (--fps) and frame time statistics
+FramePacer pacer;
+
+// With --low-latency, events are polled right before a frame is built instead
+// of after the previous swaps, and fences stop each window's driver queue from
+// running ahead (--frames-in-flight). Clicks and key presses are timed to the
+// present of the window showing them in either mode.
+bool lowLatency = false;
+FrameFences mainFences, secondFences;
+LatencyMeter mainLatency, secondLatency;
+
+// Breathing circles live here instead of the ECS when the GPU supports it (see --cpu-circles)
+GpuCircleSim gpuCircles;
+
+// CPU rendering (--renderer soft): one rasterizer per window, shown through GL.
+// While a window is drawn, softTarget points at its rasterizer and
+// softProjection holds the projection glOrtho would have loaded.
+bool softwareRendering = false;
+SoftRasterizer mainSoft, secondSoft;
+SoftPresenter mainPresenter, secondPresenter;
+SoftRasterizer* softTarget = nullptr;
+float softProjection[16];
+const SoftVertexFormat SOFT_XY_RGB = {CIRCLE_VERTEX_FLOATS, 2, 2}; // x, y, r, g, b
+
+Entity createShape(int shape, int layer, int parentNode, const float* color) {
+    ComponentMask mask = MaskOf<Transform, Color, Renderable>::value;
+    Entity entity = world.create(mask);
+    world.get<Transform>(entity).node = scene.createNode(parentNode);
+    Color& c = world.get<Color>(entity);
+    c.rgb[0] = color[0]; c.rgb[1] = color[1]; c.rgb[2] = color[2];
+    world.get<Renderable>(entity).shape = shape;
+    world.get<Renderable>(entity).layer = layer;
+    return entity;
+}
+
+void setEntityColor(Entity entity, float r, float g, float b) {
+    Color& c = world.get<Color>(entity);
+    c.rgb[0] = r; c.rgb[1] = g; c.rgb[2] = b;
+}
+
+void setCircleTriangleColor(float r, float g, float b) {
+    setEntityColor(circleEntity, r, g, b);
+    setEntityColor(triangleEntity, r, g, b);
+}
+
+void setupScene() {
+    const float white[3] = {1.0f, 1.0f, 1.0f};
+    const float red[3] = {1.0f, 0.0f, 0.0f};
+    const float yellow[3] = {0.8f, 0.8f, 0.2f};
+
+    // One top-level node per window. The main window comes last so that new
+    // breathing circles are appended at the end of the node array.
+    secondWindowNode = scene.createNode();
+    subWindowNode = scene.createNode();
+    mainWindowNode = scene.createNode();
+
+    // Room for breathing circles, so clicks do not reallocate the ECS columns, nodes or animations
+    world.reserve(MaskOf<Transform, Color, Renderable>::value, BREATHING_CIRCLE_RESERVE);
+    scene.reserve(BREATHING_CIRCLE_RESERVE);
+    animations.reserve(BREATHING_CIRCLE_RESERVE, BREATHING_CIRCLE_RESERVE);
+    buildUnitCircle(unitCircle, CIRCLE_SEGMENTS);
+
+    // Square rotation (counter-clockwise)
+    squareEntity = createShape(SHAPE_SQUARE, LAYER_MAIN_WINDOW, mainWindowNode, white);
+
+    ellipseEntity = createShape(SHAPE_ELLIPSE, LAYER_SUBWINDOW, subWindowNode, yellow);
+
+    // Circle breathing, on the left side
+    circleEntity = createShape(SHAPE_CIRCLE, LAYER_SECOND_WINDOW, secondWindowNode, red);
+    scene.setTranslation(world.get<Transform>(circleEntity).node, -0.5f, 0.0f, 0.0f);
+
+    // Triangle rotation (clockwise), on the right side
+    triangleEntity = createShape(SHAPE_TRIANGLE, LAYER_SECOND_WINDOW, secondWindowNode, red);
+    scene.setTranslation(world.get<Transform>(triangleEntity).node, 0.5f, 0.0f, 0.0f);
+}
+
+// Where an animated shape is in its animation: rotation in degrees or scale,
+// and for breathing whether it grows (1) or shrinks (-1)
+struct ShapeMotion {
+    float value;
+    float direction;
+};
+const int ANIMATED_SHAPE_COUNT = 3; // square, circle, triangle
+const ShapeMotion START_MOTION[ANIMATED_SHAPE_COUNT] = {{0.0f, 1.0f}, {1.0f, 1.0f}, {0.0f, 1.0f}};
+
+// Starts the square and triangle spinning and the circle breathing, from `motion`
+void startShapeAnimations(const ShapeMotion* motion) {
+    animations.spawn(spinAnimation(animations, world.get<Transform>(squareEntity).node, 1.5f, motion[0].value));
+
+    int circleNode = world.get<Transform>(circleEntity).node;
+    scene.setScale(circleNode, motion[1].value, motion[1].value, 1.0f);
+    animations.spawn(breatheAnimation(animations, circleNode, 0.01f, 0.5f, 1.5f, motion[1].direction > 0.0f));
+
+    animations.spawn(spinAnimation(animations, world.get<Transform>(triangleEntity).node, -1.0f, motion[2].value));
+}
+
+// Replaces the modelview matrix with a world matrix
+void loadWorldMatrix(const float* world) {
+    float matrix[16];
+    transposeMatrix(matrix, world);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadMatrixf(matrix);
+}
+
+void loadNodeMatrix(int node) {
+    loadWorldMatrix(scene.worldMatrix(node));
+}
+
+void drawBlackWhiteSquare(const float* color) {
     glBegin(GL_QUADS);
     // Black half (left) - всегда черная
     glColor3f(0.0f, 0.0f, 0.0f);
@@ -53,7 +215,7 @@ void drawBlackWhiteSquare() {
     glVertex2f(-0.5f, 0.5f);
 
     // White half (right) - использует выбранный цвет
-    glColor3f(squareColor[0], squareColor[1], squareColor[2]);
+    glColor3f(color[0], color[1], color[2]);
     glVertex2f(0.0f, -0.5f);
     glVertex2f(0.5f, -0.5f);
     glVertex2f(0.5f, 0.5f);
@@ -61,8 +223,8 @@ void drawBlackWhiteSquare() {
     glEnd();
 }
 
-void drawEllipse() {
-    glColor3f(0.8f, 0.8f, 0.2f); // Yellow color
+void drawEllipse(const float* color) {
+    glColor3f(color[0], color[1], color[2]);
     glBegin(GL_POLYGON);
     int segments = 50;
     for (int i = 0; i < segments; i++) {
@@ -72,82 +234,229 @@ void drawEllipse() {
     glEnd();
 }
 
-void drawCircle(float x, float y) {
-    glColor3f(circleTriangleColor[0], circleTriangleColor[1], circleTriangleColor[2]);
+void drawCircle(const float* color, float radius) {
+    glColor3f(color[0], color[1], color[2]);
     glBegin(GL_POLYGON);
     int segments = 50;
     for (int i = 0; i < segments; i++) {
         float angle = 2.0f * PI * i / segments;
-        glVertex2f(x + 0.2f * circleScale * cos(angle), y + 0.2f * circleScale * sin(angle));
+        glVertex2f(radius * cos(angle), radius * sin(angle));
     }
     glEnd();
 }
 
-void drawTriangle(float x, float y) {
-    glColor3f(circleTriangleColor[0], circleTriangleColor[1], circleTriangleColor[2]);
+void drawTriangle(const float* color) {
+    glColor3f(color[0], color[1], color[2]);
     glBegin(GL_TRIANGLES);
-    glVertex2f(x - 0.2f, y - 0.2f);
-    glVertex2f(x + 0.2f, y - 0.2f);
-    glVertex2f(x, y + 0.2f);
+    glVertex2f(-0.2f, -0.2f);
+    glVertex2f(0.2f, -0.2f);
+    glVertex2f(0.0f, 0.2f);
     glEnd();
 }
 
-void updateAnimations() {
-    if (!animationEnabled) return;
+void drawBatch(const float* batch, size_t floats) {
+    if (softTarget) {
+        softTarget->setTransform(softProjection);
+        softTarget->drawTriangles(batch, SOFT_XY_RGB, floats / CIRCLE_VERTEX_FLOATS);
+        return;
+    }
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(2, GL_FLOAT, CIRCLE_VERTEX_FLOATS * sizeof(float), batch);
+    glColorPointer(3, GL_FLOAT, CIRCLE_VERTEX_FLOATS * sizeof(float), batch + 2);
+    glDrawArrays(GL_TRIANGLES, 0, (GLsizei)(floats / CIRCLE_VERTEX_FLOATS));
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
 
-    // Square rotation (counter-clockwise)
-    squareRotation += 1.5f;
-    // squareRotation -= 1.0f;
-    if (squareRotation > 360.0f) squareRotation -= 360.0f;
-    // if (squareRotation < -360.0f) squareRotation += 360.0f;
-    // Triangle rotation (clockwise)
-    triangleRotation -= 1.0f;
-    // triangleRotation += 1.5f;
-    if (triangleRotation <  -360.0f) triangleRotation += 360.0f;
-    // if (triangleRotation > 360.0f) triangleRotation -= 360.0f;
-    // Circle breathing
-    if (circleGrowing) {
-        circleScale += 0.01f;
-        if (circleScale >= 1.5f) circleGrowing = false;
-    } else {
-        circleScale -= 0.01f;
-        if (circleScale <= 0.5f) circleGrowing = true;
-    }
-
-    // Update breathing circles
-    for (auto& circle : breathingCircles) {
-        if (circle.growing) {
-            circle.scale += 0.02f;
-            if (circle.scale >= 2.0f) circle.growing = false;
-        } else {
-            circle.scale -= 0.02f;
-            if (circle.scale <= 0.5f) circle.growing = true;
+// Convex polygon of count (x, y) points in one color, into softTarget
+void drawPolygonSoft(const float* points, int count, const float* color) {
+    float vertices[CIRCLE_SEGMENTS * CIRCLE_VERTEX_FLOATS];
+    for (int i = 0; i < count; i++) {
+        float* v = vertices + i * CIRCLE_VERTEX_FLOATS;
+        v[0] = points[2 * i];
+        v[1] = points[2 * i + 1];
+        v[2] = color[0];
+        v[3] = color[1];
+        v[4] = color[2];
+    }
+    softTarget->drawTriangleFan(vertices, SOFT_XY_RGB, count);
+}
+
+void drawEllipseSoft(float rx, float ry, const float* color) {
+    float points[2 * CIRCLE_SEGMENTS];
+    for (int i = 0; i < CIRCLE_SEGMENTS; i++) {
+        float angle = 2.0f * PI * i / CIRCLE_SEGMENTS;
+        points[2 * i] = rx * cos(angle);
+        points[2 * i + 1] = ry * sin(angle);
+    }
+    drawPolygonSoft(points, CIRCLE_SEGMENTS, color);
+}
+
+// The same shapes as the immediate-mode functions above, on the software rasterizer
+void drawShapeSoft(const float* world, int shape, const float* color) {
+    float transform[16];
+    multiplyMatrix(transform, softProjection, world);
+    softTarget->setTransform(transform);
+
+    switch (shape) {
+        case SHAPE_SQUARE: {
+            const float black[3] = {0.0f, 0.0f, 0.0f};
+            const float left[8] = {-0.5f, -0.5f, 0.0f, -0.5f, 0.0f, 0.5f, -0.5f, 0.5f};
+            const float right[8] = {0.0f, -0.5f, 0.5f, -0.5f, 0.5f, 0.5f, 0.0f, 0.5f};
+            drawPolygonSoft(left, 4, black);
+            drawPolygonSoft(right, 4, color);
+            break;
+        }
+        case SHAPE_ELLIPSE: drawEllipseSoft(0.4f, 0.2f, color); break;
+        case SHAPE_CIRCLE: drawEllipseSoft(0.2f, 0.2f, color); break;
+        case SHAPE_TRIANGLE: {
+            const float corners[6] = {-0.2f, -0.2f, 0.2f, -0.2f, 0.0f, 0.2f};
+            drawPolygonSoft(corners, 3, color);
+            break;
+        }
+    }
+}
+
+void drawShape(const float* world, int shape, const float* color) {
+    if (softTarget) {
+        drawShapeSoft(world, shape, color);
+        return;
+    }
+    loadWorldMatrix(world);
+    switch (shape) {
+        case SHAPE_SQUARE: drawBlackWhiteSquare(color); break;
+        case SHAPE_ELLIPSE: drawEllipse(color); break;
+        case SHAPE_CIRCLE: drawCircle(color, 0.2f); break;
+        case SHAPE_TRIANGLE: drawTriangle(color); break;
+    }
+}
+
+// Render system: queues a draw for every shape entity, once per frame after the world update
+void queueShapes() {
+    renderQueue.clear();
+    world.forEach(MaskOf<Transform, Color, Renderable>::value, [&](Archetype& a) {
+        for (size_t i = 0; i < a.size(); i++) {
+            const Renderable& renderable = a.renderables[i];
+            int program = renderable.shape == SHAPE_BREATHING_CIRCLE ? PROGRAM_CIRCLE_BATCH : PROGRAM_SHAPES;
+            renderQueue.push(makeSortKey(renderable.layer, program, renderable.shape, 0, 0), a.entities[i]);
+        }
+    });
+}
+
+// Records sorted runs of shapes; each run of breathing circles becomes one batch
+class ShapeCommandRecorder : public RenderSubmitter {
+public:
+    explicit ShapeCommandRecorder(CommandList& list) : list(list) {}
+
+    void bindProgram(unsigned program) override {
+        currentProgram = program;
+        list.bindProgram(program);
+    }
+    void bindVertexArray(unsigned shape) override { list.bindVertexArray(shape); }
+    void bindMaterial(unsigned) override {}
+
+    void draw(const DrawItem* items, size_t count) override {
+        if (currentProgram == PROGRAM_CIRCLE_BATCH) {
+            for (size_t first = 0; first < count; first += CIRCLES_PER_BATCH) {
+                size_t last = std::min(count, first + CIRCLES_PER_BATCH);
+                float* batch = list.drawVertices((last - first) * circleBatchFloats(CIRCLE_SEGMENTS));
+                for (size_t i = first; i < last; i++) {
+                    Entity e = items[i].object;
+                    const float* m = scene.worldMatrix(world.get<Transform>(e).node);
+                    batch = appendCircle(batch, unitCircle, CIRCLE_SEGMENTS, m, world.get<Color>(e).rgb, 0.1f);
+                }
+            }
+            return;
         }
+        for (size_t i = 0; i < count; i++) {
+            Entity e = items[i].object;
+            list.setTransform(scene.worldMatrix(world.get<Transform>(e).node));
+            list.setColor(world.get<Color>(e).rgb);
+            list.draw(e);
+        }
+    }
+
+private:
+    CommandList& list;
+    unsigned currentProgram = 0;
+};
+
+// Sorts the queue and records every layer's draws on the worker threads
+void recordShapeCommands() {
+    for (int layer = 0; layer < LAYER_COUNT; layer++) {
+        size_t first, last;
+        renderQueue.layerRange(layer, &first, &last);
+        layerCommands[layer].record(jobs, last - first, SHAPES_PER_JOB,
+                                    [first](CommandList& list, size_t begin, size_t end) {
+            ShapeCommandRecorder recorder(list);
+            RenderQueueStats stats = {};
+            renderQueue.submitItems(first + begin, first + end, recorder, stats);
+            std::lock_guard<std::mutex> lock(queueStatsMutex);
+            renderQueue.addStats(stats);
+        });
     }
 }
 
+// Draws recorded shapes with immediate mode or on softTarget
+class ShapeExecutor : public CommandExecutor {
+public:
+    void bindProgram(unsigned) override {}
+    void bindVertexArray(unsigned shape) override { currentShape = shape; }
+    void bindMaterial(unsigned) override {}
+    void setTransform(const float* matrix) override { transform = matrix; }
+    void setColor(const float* rgb) override { color = rgb; }
+    void draw(uint32_t) override { drawShape(transform, currentShape, color); }
+    void drawVertices(const float* vertices, size_t floatCount) override { drawBatch(vertices, floatCount); }
+
+private:
+    unsigned currentShape = 0;
+    const float* transform = nullptr;
+    const float* color = nullptr;
+};
+
+// Draws one layer's recorded commands
+void drawLayer(int layer) {
+    ShapeExecutor executor;
+    layerCommands[layer].execute(executor);
+
+    if (layer == LAYER_MAIN_WINDOW && gpuCircles.ready()) {
+        loadNodeMatrix(mainWindowNode);
+        gpuCircles.draw(0.1f);
+    }
+}
+
+void updateAnimations() {
+    if (!animationEnabled) return;
+
+    // Square and triangle rotation, circle and breathing circles scale; one tick per frame
+    animations.advance(1, &jobs);
+}
+
 // Menu callbacks
 void mainMenuCallback(int option) {
     switch (option) {
         case 0: // Stop Animation
             animationEnabled = false;
-            std::cout << "Animation Stopped" << std::endl;
+            logInfo("Animation Stopped");
             break;
         case 1: // Start Animation
             animationEnabled = true;
-            std::cout << "Animation Started" << std::endl;
+            logInfo("Animation Started");
             break;
         case 2: // White
-            squareColor[0] = squareColor[1] = squareColor[2] = 1.0f;
-            std::cout << "Square Color: White" << std::endl;
+            setEntityColor(squareEntity, 1.0f, 1.0f, 1.0f);
+            logInfo("Square Color: White");
             break;
         case 3: // Red
-            squareColor[0] = 1.0f; squareColor[1] = 0.0f; squareColor[2] = 0.0f;
-            std::cout << "Square Color: Red" << std::endl;
+            setEntityColor(squareEntity, 1.0f, 0.0f, 0.0f);
+            logInfo("Square Color: Red");
             break;
         case 4: // Green
-            squareColor[0] = 0.0f; squareColor[1] = 1.0f; squareColor[2] = 0.0f;
-            std::cout << "Square Color: Green" << std::endl;
+            setEntityColor(squareEntity, 0.0f, 1.0f, 0.0f);
+            logInfo("Square Color: Green");
             break;
     }
     needsRefresh = true;
@@ -157,96 +466,95 @@ void subWindowMenuCallback(int option) {
     switch (option) {
         case 0: // Red
             subWindowBgColor[0] = 1.0f; subWindowBgColor[1] = 0.0f; subWindowBgColor[2] = 0.0f;
-            std::cout << "SubWindow Background: Red" << std::endl;
+            logInfo("SubWindow Background: Red");
             break;
         case 1: // Green
             subWindowBgColor[0] = 0.0f; subWindowBgColor[1] = 1.0f; subWindowBgColor[2] = 0.0f;
-            std::cout << "SubWindow Background: Green" << std::endl;
+            logInfo("SubWindow Background: Green");
             break;
         case 2: // Blue
             subWindowBgColor[0] = 0.0f; subWindowBgColor[1] = 0.0f; subWindowBgColor[2] = 1.0f;
-            std::cout << "SubWindow Background: Blue" << std::endl;
+            logInfo("SubWindow Background: Blue");
             break;
         case 3: // Yellow
             subWindowBgColor[0] = 1.0f; subWindowBgColor[1] = 1.0f; subWindowBgColor[2] = 0.0f;
-            std::cout << "SubWindow Background: Yellow" << std::endl;
+            logInfo("SubWindow Background: Yellow");
             break;
     }
+    mainRegions.setClearColor(subWindowRegion, subWindowBgColor[0], subWindowBgColor[1], subWindowBgColor[2]);
     needsRefresh = true;
 }
 
-// Check if mouse click is in subwindow area
-bool isInSubWindow(double x, double y, int windowWidth, int windowHeight) {
-    // Convert to normalized coordinates
-    float normX = (float)((x / windowWidth) * 2.0 - 1.0);
-    float normY = (float)(1.0 - (y / windowHeight) * 2.0);
-
-    // Subwindow bounds in normalized coordinates
-    float subWindowLeft = subWindowX - subWindowSize;
-    float subWindowRight = subWindowX + subWindowSize;
-    float subWindowBottom = subWindowY - subWindowSize;
-    float subWindowTop = subWindowY + subWindowSize;
+// RegionTree::render() on the software rasterizer: the same viewports,
+// scissors, clears and draw lists, without the render-to-texture cache
+void renderRegionSoft(int id) {
+    const Region& r = mainRegions.region(id);
+    if (r.viewport[2] <= 0 || r.viewport[3] <= 0) return;
+    mainSoft.setViewport(r.viewport[0], r.viewport[1], r.viewport[2], r.viewport[3]);
+    mainSoft.setScissor(r.viewport[0], r.viewport[1], r.viewport[2], r.viewport[3]);
+    if (r.clear) {
+        mainSoft.setClearColor(r.clearColor[0], r.clearColor[1], r.clearColor[2], r.clearColor[3]);
+        mainSoft.clear(true, false);
+    }
+    orthoMatrix(softProjection, r.projection[0], r.projection[1], r.projection[2], r.projection[3], -1, 1);
 
-    return (normX >= subWindowLeft && normX <= subWindowRight &&
-            normY >= subWindowBottom && normY <= subWindowTop);
+    for (const auto& draw : r.drawList) draw();
+    for (int child : r.children) renderRegionSoft(child);
 }
 
 // Main window display (with black & white square)
 void mainWindowDisplay() {
-    glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
-
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    glOrtho(-1, 1, -1, 1, -1, 1);
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-
-    // Draw single black & white square with rotation
-    glPushMatrix();
-    glRotatef(squareRotation, 0.0f, 0.0f, 1.0f);
-    drawBlackWhiteSquare();
-    glPopMatrix();
+    int fbWidth, fbHeight;
+    glfwGetFramebufferSize(mainWindow, &fbWidth, &fbHeight);
 
-    // Draw subwindow area (fixed position in main window)
-    glPushMatrix();
-    glTranslatef(subWindowX, subWindowY, 0.0f);
-    glScalef(subWindowSize, subWindowSize, 1.0f);
+    // GPU breathing circles advance here, where the main window's context is current
+    if (animationEnabled) gpuCircles.update(BREATHING_MIN_SCALE, BREATHING_MAX_SCALE);
 
-    // Subwindow background
-    glBegin(GL_QUADS);
-    glColor3f(subWindowBgColor[0], subWindowBgColor[1], subWindowBgColor[2]);
-    glVertex2f(-1.0f, -1.0f);
-    glVertex2f(1.0f, -1.0f);
-    glVertex2f(1.0f, 1.0f);
-    glVertex2f(-1.0f, 1.0f);
-    glEnd();
+    mainRegions.layout(fbWidth, fbHeight);
+    if (softwareRendering) {
+        mainSoft.resize(fbWidth, fbHeight);
+        softTarget = &mainSoft;
+        renderRegionSoft(mainRegions.root());
+        mainSoft.disableScissor();
+        mainSoft.flush(&jobs);
+        softTarget = nullptr;
 
-    // Ellipse in subwindow
-    drawEllipse();
-    glPopMatrix();
-
-    // Breathing circles
-    for (const auto& circle : breathingCircles) {
-        glPushMatrix();
-        glTranslatef(circle.x, circle.y, 0.0f);
-        glScalef(circle.scale, circle.scale, 1.0f);
-        glColor3f(circle.color[0], circle.color[1], circle.color[2]);
-        glBegin(GL_POLYGON);
-        int segments = 50;
-        for (int i = 0; i < segments; i++) {
-            float angle = 2.0f * PI * i / segments;
-            glVertex2f(0.1f * cos(angle), 0.1f * sin(angle));
-        }
-        glEnd();
-        glPopMatrix();
+        capture.captureImage((const uint8_t*)mainSoft.pixels(), mainSoft.width(), mainSoft.height(),
+                             (size_t)mainSoft.rowPitch() * 4);
+        mainPresenter.present(mainSoft, fbWidth, fbHeight);
+    } else {
+        mainRegions.render();
+        capture.captureFrame(fbWidth, fbHeight);
     }
-
     glfwSwapBuffers(mainWindow);
+    mainFences.frameSubmitted();
+    mainLatency.framePresented();
 }
 
 // Second window display (circle and triangle)
 void secondWindowDisplay() {
+    int fbWidth, fbHeight;
+    glfwGetFramebufferSize(secondWindow, &fbWidth, &fbHeight);
+    if (softwareRendering) {
+        secondSoft.resize(fbWidth, fbHeight);
+        secondSoft.setClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        secondSoft.clear(true, false);
+        orthoMatrix(softProjection, -1, 1, -1, 1, -1, 1);
+
+        softTarget = &secondSoft;
+        drawLayer(LAYER_SECOND_WINDOW);
+        secondSoft.flush(&jobs);
+        softTarget = nullptr;
+
+        secondPresenter.present(secondSoft, fbWidth, fbHeight);
+        glfwSwapBuffers(secondWindow);
+        secondFences.frameSubmitted();
+        secondLatency.framePresented();
+        return;
+    }
+
+    // Follow resizes; the main window's regions set their own viewports
+    glViewport(0, 0, fbWidth, fbHeight);
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 
@@ -256,162 +564,352 @@ void secondWindowDisplay() {
     glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();
 
-    // Draw circle on the left side
-    drawCircle(-0.5f, 0.0f);
-
-    // Draw triangle on the right side with rotation
-    glPushMatrix();
-    glTranslatef(0.5f, 0.0f, 0.0f);
-    glRotatef(triangleRotation, 0.0f, 0.0f, 1.0f);
-    drawTriangle(0.0f, 0.0f);
-    glPopMatrix();
+    // Circle on the left side, rotating triangle on the right side
+    drawLayer(LAYER_SECOND_WINDOW);
 
     glfwSwapBuffers(secondWindow);
+    secondFences.frameSubmitted();
+    secondLatency.framePresented();
+}
+
+// Color changes for circle and triangle (only in second window)
+void secondWindowKey(int key) {
+    switch (key) {
+        case GLFW_KEY_R:
+            setCircleTriangleColor(1.0f, 0.0f, 0.0f);
+            logInfo("Circle/Triangle Color: Red");
+            needsRefresh = true;
+            break;
+        case GLFW_KEY_G:
+            setCircleTriangleColor(0.0f, 1.0f, 0.0f);
+            logInfo("Circle/Triangle Color: Green");
+            needsRefresh = true;
+            break;
+        case GLFW_KEY_B:
+            setCircleTriangleColor(0.0f, 0.0f, 1.0f);
+            logInfo("Circle/Triangle Color: Blue");
+            needsRefresh = true;
+            break;
+        case GLFW_KEY_Y:
+            setCircleTriangleColor(1.0f, 1.0f, 0.0f);
+            logInfo("Circle/Triangle Color: Yellow");
+            needsRefresh = true;
+            break;
+        case GLFW_KEY_O:
+            setCircleTriangleColor(1.0f, 0.5f, 0.0f);
+            logInfo("Circle/Triangle Color: Orange");
+            needsRefresh = true;
+            break;
+        case GLFW_KEY_P:
+            setCircleTriangleColor(1.0f, 0.0f, 1.0f);
+            logInfo("Circle/Triangle Color: Purple");
+            needsRefresh = true;
+            break;
+        case GLFW_KEY_W:
+            setCircleTriangleColor(1.0f, 1.0f, 1.0f);
+            logInfo("Circle/Triangle Color: White");
+            needsRefresh = true;
+            break;
+    }
 }
 
 void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
-    if (action == GLFW_PRESS) {
-        // Color changes for circle and triangle (only in second window)
-        if (window == secondWindow) {
-            switch (key) {
-                case GLFW_KEY_R:
-                    circleTriangleColor[0] = 1.0f; circleTriangleColor[1] = 0.0f; circleTriangleColor[2] = 0.0f;
-                    std::cout << "Circle/Triangle Color: Red" << std::endl;
-                    needsRefresh = true;
-                    break;
-                case GLFW_KEY_G:
-                    circleTriangleColor[0] = 0.0f; circleTriangleColor[1] = 1.0f; circleTriangleColor[2] = 0.0f;
-                    std::cout << "Circle/Triangle Color: Green" << std::endl;
-                    needsRefresh = true;
-                    break;
-                case GLFW_KEY_B:
-                    circleTriangleColor[0] = 0.0f; circleTriangleColor[1] = 0.0f; circleTriangleColor[2] = 1.0f;
-                    std::cout << "Circle/Triangle Color: Blue" << std::endl;
-                    needsRefresh = true;
-                    break;
-                case GLFW_KEY_Y:
-                    circleTriangleColor[0] = 1.0f; circleTriangleColor[1] = 1.0f; circleTriangleColor[2] = 0.0f;
-                    std::cout << "Circle/Triangle Color: Yellow" << std::endl;
-                    needsRefresh = true;
-                    break;
-                case GLFW_KEY_O:
-                    circleTriangleColor[0] = 1.0f; circleTriangleColor[1] = 0.5f; circleTriangleColor[2] = 0.0f;
-                    std::cout << "Circle/Triangle Color: Orange" << std::endl;
-                    needsRefresh = true;
-                    break;
-                case GLFW_KEY_P:
-                    circleTriangleColor[0] = 1.0f; circleTriangleColor[1] = 0.0f; circleTriangleColor[2] = 1.0f;
-                    std::cout << "Circle/Triangle Color: Purple" << std::endl;
-                    needsRefresh = true;
-                    break;
-                case GLFW_KEY_W:
-                    circleTriangleColor[0] = 1.0f; circleTriangleColor[1] = 1.0f; circleTriangleColor[2] = 1.0f;
-                    std::cout << "Circle/Triangle Color: White" << std::endl;
-                    needsRefresh = true;
-                    break;
-            }
-        }
+    if (action != GLFW_PRESS || window != secondWindow) return;
+    secondLatency.inputDelivered();
+    session.recordKey(REPLAY_SECOND_WINDOW, key, action, mods, glfwGetTime());
+    secondWindowKey(key);
+}
+
+// A breathing circle of the CPU path: an entity plus its animation
+void createBreathingCircle(float x, float y, const float* color, float scale, bool growing, float speed) {
+    Entity circle = createShape(SHAPE_BREATHING_CIRCLE, LAYER_MAIN_WINDOW, mainWindowNode, color);
+    int node = world.get<Transform>(circle).node;
+    scene.setTranslation(node, x, y, 0.0f);
+    scene.setScale(node, scale, scale, 1.0f);
+    animations.spawn(breatheAnimation(animations, node, speed, BREATHING_MIN_SCALE, BREATHING_MAX_SCALE, growing));
+}
+
+void addBreathingCircle(float x, float y) {
+    // Random color
+    std::uniform_real_distribution<float> dis(0.0f, 1.0f);
+    float color[3];
+    color[0] = dis(randomGenerator);
+    color[1] = dis(randomGenerator);
+    color[2] = dis(randomGenerator);
+
+    if (gpuCircles.ready()) {
+        // Clicks arrive while the second window's context is current, and the
+        // circle buffers belong to the main window's
+        GLFWwindow* previous = glfwGetCurrentContext();
+        glfwMakeContextCurrent(mainWindow);
+        gpuCircles.addCircle(x, y, color, BREATHING_START_SCALE, BREATHING_SPEED);
+        glfwMakeContextCurrent(previous);
+    } else {
+        createBreathingCircle(x, y, color, BREATHING_START_SCALE, true, BREATHING_SPEED);
     }
+
+    logInfo("Added breathing circle at (%g, %g)", x, y);
+    needsRefresh = true;
 }
 
-void mouseCallback(GLFWwindow* window, int button, int action, int mods) {
-    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
-        if (window == mainWindow) {
-            // Add breathing circle at mouse position
-            double x, y;
-            glfwGetCursorPos(window, &x, &y);
-
-            int width, height;
-            glfwGetWindowSize(window, &width, &height);
-
-            // Check if click is in subwindow area (avoid creating circles in subwindow)
-            if (isInSubWindow(x, y, width, height)) {
-                return; // Click in subwindow area, don't create circle
-            }
+// Snapshots (--load-snapshot, --save-snapshot), see snapshot.h. Breathing
+// circles are stored in the GPU simulation's layout, so with GPU circles a
+// snapshot loads with one upload straight from the mapped file.
+const uint32_t MAIN_SNAPSHOT_KIND = 1;
+enum MainSnapshotColumn : uint32_t {
+    MAIN_COLUMN_SETTINGS,     // one MainSnapshotSettings
+    MAIN_COLUMN_SHAPE_COLORS, // Color of the square, ellipse, circle and triangle
+    MAIN_COLUMN_SHAPE_MOTION, // ShapeMotion of the square, circle and triangle
+    MAIN_COLUMN_CIRCLES       // BreathingCircleState per breathing circle
+};
 
-            // Convert to normalized coordinates
-            float normX = (float)((x / width) * 2.0 - 1.0);
-            float normY = (float)(1.0 - (y / height) * 2.0);
+struct MainSnapshotSettings {
+    float subWindowBgColor[3];
+    uint32_t animationEnabled;
+};
 
-            BreathingCircle circle;
-            circle.x = normX;
-            circle.y = normY;
-            circle.scale = 0.5f;
-            circle.growing = true;
+struct BreathingCircleState {
+    float x, y, scale, direction;
+    float rgb[3];
+    float speed;
+};
+static_assert(sizeof(BreathingCircleState) == GpuCircleSim::STATE_FLOATS * sizeof(float),
+              "breathing circles are saved in the GPU simulation's layout");
 
-            // Random color
-            static std::random_device rd;
-            static std::mt19937 gen(rd());
-            std::uniform_real_distribution<float> dis(0.0f, 1.0f);
+// Needs the main window's context for GPU circles
+bool saveMainSnapshot(const char* path) {
+    MainSnapshotSettings settings;
+    for (int i = 0; i < 3; i++) settings.subWindowBgColor[i] = subWindowBgColor[i];
+    settings.animationEnabled = animationEnabled;
 
-            circle.color[0] = dis(gen);
-            circle.color[1] = dis(gen);
-            circle.color[2] = dis(gen);
+    const Entity shapes[4] = {squareEntity, ellipseEntity, circleEntity, triangleEntity};
+    Color colors[4];
+    for (int i = 0; i < 4; i++) colors[i] = world.get<Color>(shapes[i]);
 
-            breathingCircles.push_back(circle);
-            std::cout << "Added breathing circle at (" << normX << ", " << normY << ")" << std::endl;
-            needsRefresh = true;
+    // The running tween of each animated node tells where it is, which way it goes and how fast
+    std::vector<float> value(scene.nodeCount(), 0.0f), direction(scene.nodeCount(), 1.0f);
+    std::vector<float> speed(scene.nodeCount(), BREATHING_SPEED);
+    animations.forEachTween([&](int node, TweenKind, float now, float step) {
+        value[node] = now;
+        direction[node] = step >= 0.0f ? 1.0f : -1.0f;
+        speed[node] = std::fabs(step);
+    });
+    int circleNode = world.get<Transform>(circleEntity).node;
+    ShapeMotion motion[ANIMATED_SHAPE_COUNT] = {
+        {value[world.get<Transform>(squareEntity).node], 1.0f},
+        {scene.scale(circleNode)[0], direction[circleNode]},
+        {value[world.get<Transform>(triangleEntity).node], 1.0f}};
+
+    std::vector<BreathingCircleState> circles;
+    if (gpuCircles.ready()) {
+        circles.resize(gpuCircles.count());
+        if (!circles.empty()) gpuCircles.readCircles(&circles[0].x);
+    } else {
+        world.forEach(MaskOf<Transform, Color, Renderable>::value, [&](Archetype& a) {
+            for (size_t i = 0; i < a.size(); i++) {
+                if (a.renderables[i].shape != SHAPE_BREATHING_CIRCLE) continue;
+                int node = a.transforms[i].node;
+                const float* rgb = a.colors[i].rgb;
+                BreathingCircleState circle = {scene.translation(node)[0], scene.translation(node)[1],
+                                               scene.scale(node)[0], direction[node], {rgb[0], rgb[1], rgb[2]},
+                                               speed[node]};
+                circles.push_back(circle);
+            }
+        });
+    }
+
+    SnapshotWriter writer(MAIN_SNAPSHOT_KIND);
+    writer.addColumn(MAIN_COLUMN_SETTINGS, &settings, 1);
+    writer.addColumn(MAIN_COLUMN_SHAPE_COLORS, colors, 4);
+    writer.addColumn(MAIN_COLUMN_SHAPE_MOTION, motion, ANIMATED_SHAPE_COUNT);
+    writer.addColumn(MAIN_COLUMN_CIRCLES, circles.data(), circles.size());
+    if (!writer.write(path)) return false;
+    logInfo("Saved snapshot %s: %zu breathing circles", path, circles.size());
+    return true;
+}
+
+// Restores a snapshot into the scene made by setupScene() and starts the
+// shape animations from it; needs the main window's context for GPU circles
+bool loadMainSnapshot(const char* path) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    SnapshotFile file;
+    if (!file.open(path, MAIN_SNAPSHOT_KIND)) return false;
+    size_t circleCount;
+    const BreathingCircleState* circles = file.column<BreathingCircleState>(MAIN_COLUMN_CIRCLES, circleCount);
+    if (circleCount > INT_MAX) { // GL draw counts and the GPU simulation are int-sized
+        logError("Snapshot %s holds more breathing circles than the demo can draw", path);
+        return false;
+    }
+
+    size_t count;
+    const MainSnapshotSettings* settings = file.column<MainSnapshotSettings>(MAIN_COLUMN_SETTINGS, count);
+    if (count == 1) {
+        for (int i = 0; i < 3; i++) subWindowBgColor[i] = settings->subWindowBgColor[i];
+        animationEnabled = settings->animationEnabled != 0;
+    }
+    const Color* colors = file.column<Color>(MAIN_COLUMN_SHAPE_COLORS, count);
+    if (count == 4) {
+        const Entity shapes[4] = {squareEntity, ellipseEntity, circleEntity, triangleEntity};
+        for (int i = 0; i < 4; i++) world.get<Color>(shapes[i]) = colors[i];
+    }
+    const ShapeMotion* motion = file.column<ShapeMotion>(MAIN_COLUMN_SHAPE_MOTION, count);
+    startShapeAnimations(count == ANIMATED_SHAPE_COUNT ? motion : START_MOTION);
+
+    if (gpuCircles.ready()) {
+        // The column is the simulation's buffer layout: one upload
+        if (circleCount > 0 && !gpuCircles.setCircles(&circles[0].x, (int)circleCount)) circleCount = 0;
+    } else {
+        // Every circle is an entity, a scene node and a breathing coroutine, built one by one: about
+        // 0.5 s for 1M circles (0.05 s on the GPU path), mostly nodes, coroutine frames and first tweens
+        size_t room = circleCount + BREATHING_CIRCLE_RESERVE; // the usual room for clicks on top
+        world.reserve(MaskOf<Transform, Color, Renderable>::value, room);
+        scene.reserve(room);
+        animations.reserve(room, room);
+        for (size_t i = 0; i < circleCount; i++) {
+            const BreathingCircleState& c = circles[i];
+            createBreathingCircle(c.x, c.y, c.rgb, c.scale, c.direction > 0.0f, c.speed);
         }
     }
-    else if (button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_PRESS) {
-        if (window == mainWindow) {
-            double x, y;
-            glfwGetCursorPos(window, &x, &y);
-            int width, height;
-            glfwGetWindowSize(window, &width, &height);
-
-            if (isInSubWindow(x, y, width, height)) {
-                // Right click in subwindow - show subwindow menu
-                std::cout << "\n=== SubWindow Menu ===" << std::endl;
-                std::cout << "1. Red Background" << std::endl;
-                std::cout << "2. Green Background" << std::endl;
-                std::cout << "3. Blue Background" << std::endl;
-                std::cout << "4. Yellow Background" << std::endl;
-                std::cout << "Choose an option (1-4): ";
-
-                int option;
-                std::cin >> option;
-                if (option >= 1 && option <= 4) {
-                    subWindowMenuCallback(option - 1);
-                    needsRefresh = true; // Добавьте эту строку
-                }
-            } else {
-                // Right click in main window - show main menu
-                std::cout << "\n=== Main Window Menu ===" << std::endl;
-                std::cout << "1. Stop Animation" << std::endl;
-                std::cout << "2. Start Animation" << std::endl;
-                std::cout << "3. Square Color: White" << std::endl;
-                std::cout << "4. Square Color: Red" << std::endl;
-                std::cout << "5. Square Color: Green" << std::endl;
-                std::cout << "Choose an option (1-5): ";
-
-                int option;
-                std::cin >> option;
-                if (option >= 1 && option <= 5) {
-                    mainMenuCallback(option - 1);
-                    needsRefresh = true; // И эту строку тоже
-                }
-            }
+    double ms = 1000.0 * std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    logInfo("Loaded snapshot %s: %zu breathing circles in %.2f ms", path, circleCount, ms);
+    return true;
+}
+
+// Reads a menu option from the console, or from the recording during a replay
+int readMenuOption(int menu) {
+    int option = 0;
+    if (session.replaying()) {
+        session.nextMenuChoice(menu, option);
+        std::cout << option << std::endl;
+        return option;
+    }
+    std::cin >> option;
+    session.recordMenuChoice(menu, option);
+    return option;
+}
+
+void showMainMenu() {
+    logInfo("\n=== Main Window Menu ===");
+    logInfo("1. Stop Animation");
+    logInfo("2. Start Animation");
+    logInfo("3. Square Color: White");
+    logInfo("4. Square Color: Red");
+    logInfo("5. Square Color: Green");
+    // The prompt must follow the queued menu lines
+    logFlush();
+    std::cout << "Choose an option (1-5): ";
+
+    int option = readMenuOption(MENU_MAIN);
+    if (option >= 1 && option <= 5) {
+        mainMenuCallback(option - 1);
+        needsRefresh = true;
+    }
+}
+
+void showSubWindowMenu() {
+    logInfo("\n=== SubWindow Menu ===");
+    logInfo("1. Red Background");
+    logInfo("2. Green Background");
+    logInfo("3. Blue Background");
+    logInfo("4. Yellow Background");
+    // The prompt must follow the queued menu lines
+    logFlush();
+    std::cout << "Choose an option (1-4): ";
+
+    int option = readMenuOption(MENU_SUBWINDOW);
+    if (option >= 1 && option <= 4) {
+        subWindowMenuCallback(option - 1);
+        needsRefresh = true;
+    }
+}
+
+void setupMainRegions() {
+    Region& root = mainRegions.region(mainRegions.root());
+    root.clearColor[0] = root.clearColor[1] = root.clearColor[2] = 0.1f;
+    // Rotating square and breathing circles
+    root.drawList.push_back([]() { drawLayer(LAYER_MAIN_WINDOW); });
+    root.onMouseButton = [](int button, float x, float y) {
+        if (button == GLFW_MOUSE_BUTTON_LEFT) addBreathingCircle(x, y); // Add breathing circle at mouse position
+        else if (button == GLFW_MOUSE_BUTTON_RIGHT) showMainMenu();
+        else return false;
+        return true;
+    };
+
+    // Subwindow (fixed position in main window); static, so its contents are cached
+    RegionRect rect = {0.3f, 0.3f, 0.9f, 0.9f};
+    subWindowRegion = mainRegions.addRegion(mainRegions.root(), rect);
+    Region& sub = mainRegions.region(subWindowRegion);
+    sub.cached = true;
+    sub.drawList.push_back([]() { drawLayer(LAYER_SUBWINDOW); });
+    sub.onMouseButton = [](int button, float x, float y) {
+        // Left clicks are swallowed so no circles are created in the subwindow
+        if (button == GLFW_MOUSE_BUTTON_RIGHT) showSubWindowMenu();
+        return button == GLFW_MOUSE_BUTTON_LEFT || button == GLFW_MOUSE_BUTTON_RIGHT;
+    };
+    mainRegions.setClearColor(subWindowRegion, subWindowBgColor[0], subWindowBgColor[1], subWindowBgColor[2]);
+}
+
+void mouseCallback(GLFWwindow* window, int button, int action, int mods) {
+    if (action != GLFW_PRESS || window != mainWindow) return;
+    if (button == GLFW_MOUSE_BUTTON_LEFT) mainLatency.inputDelivered(); // menus wait on the console
+
+    double x, y;
+    glfwGetCursorPos(window, &x, &y);
+    int width, height;
+    glfwGetWindowSize(window, &width, &height);
+    int fbWidth, fbHeight;
+    glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+    if (width <= 0 || height <= 0) return;
+
+    // Cursor positions are in screen coordinates from the top-left,
+    // regions use framebuffer pixels from the bottom-left
+    double pixelX = x * fbWidth / width;
+    double pixelY = fbHeight - y * fbHeight / height;
+    session.recordMouseButton(REPLAY_MAIN_WINDOW, button, action, (float)pixelX, (float)pixelY, glfwGetTime());
+    mainRegions.dispatchMouseButton(pixelX, pixelY, button);
+}
+
+// Waits on each window's fences in its own context
+void waitForFrames() {
+    glfwMakeContextCurrent(mainWindow);
+    mainFences.waitForFrame();
+    glfwMakeContextCurrent(secondWindow);
+    secondFences.waitForFrame();
+}
+
+// Polls window events; during a replay the recorded input of this frame is dispatched instead
+void pollEvents() {
+    glfwPollEvents();
+    ReplayEvent event;
+    while (session.nextEvent(event)) {
+        if (event.type == REPLAY_MOUSE_BUTTON && event.window == REPLAY_MAIN_WINDOW) {
+            mainRegions.dispatchMouseButton(event.x, event.y, event.code);
+        } else if (event.type == REPLAY_KEY && event.window == REPLAY_SECOND_WINDOW) {
+            secondWindowKey(event.code);
         }
     }
 }
 
 void printInstructions() {
-    std::cout << "=== Assignment 2 Instructions ===" << std::endl;
-    std::cout << "Main Window:" << std::endl;
-    std::cout << "  - Single black & white rotating square (left-black, right-white)" << std::endl;
-    std::cout << "  - Subwindow with ellipse (top-right)" << std::endl;
-    std::cout << "  - Right click in subwindow: Change background color" << std::endl;
-    std::cout << "  - Right click outside subwindow: Main menu" << std::endl;
-    std::cout << "  - Left click: Add breathing circle" << std::endl;
-    std::cout << std::endl;
-    std::cout << "Second Window (Circle & Triangle):" << std::endl;
-    std::cout << "  R - Red, G - Green, B - Blue" << std::endl;
-    std::cout << "  Y - Yellow, O - Orange, P - Purple, W - White" << std::endl;
-    std::cout << "=================================" << std::endl;
-}
-
-int main() {
+    logInfo("=== Assignment 2 Instructions ===");
+    logInfo("Main Window:");
+    logInfo("  - Single black & white rotating square (left-black, right-white)");
+    logInfo("  - Subwindow with ellipse (top-right)");
+    logInfo("  - Right click in subwindow: Change background color");
+    logInfo("  - Right click outside subwindow: Main menu");
+    logInfo("  - Left click: Add breathing circle");
+    logInfo("\nSecond Window (Circle & Triangle):");
+    logInfo("  R - Red, G - Green, B - Blue");
+    logInfo("  Y - Yellow, O - Orange, P - Purple, W - White");
+    logInfo("=================================");
+}
+
+int main(int argc, char** argv) {
+    DemoOptions options;
+    if (!parseDemoOptions(argc, argv, options)) return -1;
+    logStart();
+    jobs.start();
+
     if (!glfwInit()) {
         std::cerr << "Failed to initialize GLFW" << std::endl;
         return -1;
@@ -419,6 +917,7 @@ int main() {
 
     // Enable double buffering
     glfwWindowHint(GLFW_DOUBLEBUFFER, GLFW_TRUE);
+    if (options.headless) glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
     // Create main window
     mainWindow = glfwCreateWindow(800, 600, "Main Window - Black & White Square + SubWindow", nullptr, nullptr);
@@ -436,20 +935,90 @@ int main() {
         return -1;
     }
 
+    // Initialize GLEW (needed for framebuffer objects)
+    glfwMakeContextCurrent(mainWindow);
+    if (glewInit() != GLEW_OK) {
+        std::cerr << "Failed to initialize GLEW" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    mainRegions.init();
+
+    if (options.replayPath) {
+        if (!session.startReplay(options.replayPath, !options.maxSpeed)) {
+            glfwTerminate();
+            return -1;
+        }
+    } else if (options.recordPath) {
+        if (!session.startRecording(options.recordPath, std::random_device()())) {
+            glfwTerminate();
+            return -1;
+        }
+    }
+    randomGenerator.seed(session.recording() || session.replaying() ? session.seed() : std::random_device()());
+    // Only the main window waits for vsync; with both waiting, the two swaps
+    // per loop would take two refreshes
+    applySwapInterval(options.swapMode);
+    glfwMakeContextCurrent(secondWindow);
+    glfwSwapInterval(0);
+    glfwMakeContextCurrent(mainWindow);
+    pacer.setTargetFps(options.targetFps);
+
+    lowLatency = options.lowLatency;
+    bool fencesSupported = mainFences.init(options.framesInFlight);
+    mainLatency.init(true);
+    glfwMakeContextCurrent(secondWindow);
+    fencesSupported = secondFences.init(options.framesInFlight) && fencesSupported;
+    secondLatency.init(true);
+    glfwMakeContextCurrent(mainWindow);
+    if (!fencesSupported) logWarning("Fences not supported, frames in flight not limited");
+
+    // Software frames are captured straight from the CPU image
+    softwareRendering = options.softwareRenderer;
+    if (options.capturePath) capture.start(options.capturePath, 60, !softwareRendering);
+
+    if (softwareRendering) {
+        mainPresenter.init();
+        glfwMakeContextCurrent(secondWindow);
+        secondPresenter.init();
+        glfwMakeContextCurrent(mainWindow);
+        logInfo("Renderer: software");
+    } else if (!options.cpuCircles) {
+        gpuCircles.init(CIRCLE_SEGMENTS);
+    }
+    setupScene();
+    if (!options.loadPath || !loadMainSnapshot(options.loadPath)) startShapeAnimations(START_MOTION);
+    setupMainRegions();
+
     // Position windows
     glfwSetWindowPos(mainWindow, 100, 100);
     glfwSetWindowPos(secondWindow, 950, 100);
 
-    // Set callbacks
-    glfwSetKeyCallback(secondWindow, keyboardCallback);
-    glfwSetMouseButtonCallback(mainWindow, mouseCallback);
+    // Set callbacks; while replaying, input only comes from the recording
+    if (!session.replaying()) {
+        glfwSetKeyCallback(secondWindow, keyboardCallback);
+        glfwSetMouseButtonCallback(mainWindow, mouseCallback);
+    }
 
     // Print instructions
     printInstructions();
 
     // Main loop
     while (!glfwWindowShouldClose(mainWindow) && !glfwWindowShouldClose(secondWindow)) {
+        // Input polled before beginFrame still belongs to the previous frame of
+        // a recording, so recordings replay the same in both modes
+        if (mainFences.ready()) waitForFrames();
+        if (lowLatency) pollEvents();
+
+        // Animations advance per frame, so the frame time only paces replays
+        double frameTime;
+        if (!session.beginFrame(glfwGetTime(), &frameTime)) break; // replay finished
+        allocationStats.beginFrame();
+
         updateAnimations();
+        scene.updateWorld(&jobs);
+        queueShapes();
+        recordShapeCommands();
 
         // Force refresh if needed
         if (needsRefresh) {
@@ -464,12 +1033,38 @@ int main() {
         glfwMakeContextCurrent(secondWindow);
         secondWindowDisplay();
 
-        glfwPollEvents();
+        if (!lowLatency) pollEvents();
+        allocationStats.endFrame();
+        pacer.endFrame();
     }
+    session.logSummary();
+    allocationStats.logSummary();
+    pacer.stats().logSummary();
+    mainFences.logSummary();
+    mainLatency.logSummary("Main window click");
+    secondLatency.logSummary("Second window key");
+    const RenderQueueStats& drawStats = renderQueue.stats();
+    logInfo("Render queue, last frame: %zu draws in %zu runs", drawStats.draws, drawStats.runs);
+    session.close();
+
+    glfwMakeContextCurrent(secondWindow);
+    secondPresenter.destroy();
+    secondFences.destroy();
+    secondLatency.destroy();
+    glfwMakeContextCurrent(mainWindow);
+    if (options.savePath) saveMainSnapshot(options.savePath);
+    mainFences.destroy();
+    mainLatency.destroy();
+    capture.stop();
+    mainPresenter.destroy();
+    gpuCircles.destroy();
+    mainRegions.destroy();
 
     glfwDestroyWindow(mainWindow);
     glfwDestroyWindow(secondWindow);
     glfwTerminate();
+    jobs.stop();
+    logStop();
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,131 @@
+#include "matrix.h"
+#include <cmath>
+
+void scaleMatrix(float* matrix, float sx, float sy, float sz) {
+    float temp[] = {
+        sx, 0.0f, 0.0f, 0.0f,
+        0.0f, sy, 0.0f, 0.0f,
+        0.0f, 0.0f, sz, 0.0f,
+        0.0f, 0.0f, 0.0f, 1.0f
+    };
+    for (int i = 0; i < 16; i++) matrix[i] = temp[i];
+}
+
+void rotateXMatrix(float* matrix, float angle) {
+    float cosA = cos(angle);
+    float sinA = sin(angle);
+    float temp[] = {
+        1.0f, 0.0f, 0.0f, 0.0f,
+        0.0f, cosA, -sinA, 0.0f,
+        0.0f, sinA, cosA, 0.0f,
+        0.0f, 0.0f, 0.0f, 1.0f
+    };
+    for (int i = 0; i < 16; i++) matrix[i] = temp[i];
+}
+
+void rotateYMatrix(float* matrix, float angle) {
+    float cosA = cos(angle);
+    float sinA = sin(angle);
+    float temp[] = {
+        cosA, 0.0f, sinA, 0.0f,
+        0.0f, 1.0f, 0.0f, 0.0f,
+        -sinA, 0.0f, cosA, 0.0f,
+        0.0f, 0.0f, 0.0f, 1.0f
+    };
+    for (int i = 0; i < 16; i++) matrix[i] = temp[i];
+}
+
+void rotateZMatrix(float* matrix, float angle) {
+    float cosA = cos(angle);
+    float sinA = sin(angle);
+    float temp[] = {
+        cosA, -sinA, 0.0f, 0.0f,
+        sinA, cosA, 0.0f, 0.0f,
+        0.0f, 0.0f, 1.0f, 0.0f,
+        0.0f, 0.0f, 0.0f, 1.0f
+    };
+    for (int i = 0; i < 16; i++) matrix[i] = temp[i];
+}
+
+void translateMatrix(float* matrix, float tx, float ty, float tz) {
+    float temp[] = {
+        1.0f, 0.0f, 0.0f, tx,
+        0.0f, 1.0f, 0.0f, ty,
+        0.0f, 0.0f, 1.0f, tz,
+        0.0f, 0.0f, 0.0f, 1.0f
+    };
+    for (int i = 0; i < 16; i++) matrix[i] = temp[i];
+}
+
+void multiplyMatrix(float* result, const float* a, const float* b) {
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++) {
+            result[i * 4 + j] = 0;
+            for (int k = 0; k < 4; k++)
+                result[i * 4 + j] += a[i * 4 + k] * b[k * 4 + j];
+        }
+}
+
+void identityMatrix(float* matrix) {
+    for (int i = 0; i < 16; i++) matrix[i] = 0.0f;
+    for (int i = 0; i < 4; i++) matrix[i * 4 + i] = 1.0f;
+}
+
+void transposeMatrix(float* result, const float* matrix) {
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++)
+            result[j * 4 + i] = matrix[i * 4 + j];
+}
+
+void orthoMatrix(float* matrix, float left, float right, float bottom, float top, float zNear, float zFar) {
+    float temp[] = {
+        2.0f / (right - left), 0.0f, 0.0f, -(right + left) / (right - left),
+        0.0f, 2.0f / (top - bottom), 0.0f, -(top + bottom) / (top - bottom),
+        0.0f, 0.0f, -2.0f / (zFar - zNear), -(zFar + zNear) / (zFar - zNear),
+        0.0f, 0.0f, 0.0f, 1.0f
+    };
+    for (int i = 0; i < 16; i++) matrix[i] = temp[i];
+}
+
+void perspectiveMatrix(float* matrix, float fovY, float aspect, float zNear, float zFar) {
+    float f = 1.0f / std::tan(0.5f * fovY);
+    float temp[] = {
+        f / aspect, 0.0f, 0.0f, 0.0f,
+        0.0f, f, 0.0f, 0.0f,
+        0.0f, 0.0f, (zFar + zNear) / (zNear - zFar), 2.0f * zFar * zNear / (zNear - zFar),
+        0.0f, 0.0f, -1.0f, 0.0f
+    };
+    for (int i = 0; i < 16; i++) matrix[i] = temp[i];
+}
+
+static void normalize3(float* v) {
+    float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (length > 0.0f) {
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    }
+}
+
+static void cross3(float* result, const float* a, const float* b) {
+    result[0] = a[1] * b[2] - a[2] * b[1];
+    result[1] = a[2] * b[0] - a[0] * b[2];
+    result[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+void lookAtMatrix(float* matrix, const float* eye, const float* target, const float* up) {
+    float forward[3] = {target[0] - eye[0], target[1] - eye[1], target[2] - eye[2]};
+    normalize3(forward);
+    float side[3], trueUp[3];
+    cross3(side, forward, up);
+    normalize3(side);
+    cross3(trueUp, side, forward);
+
+    float temp[] = {
+        side[0], side[1], side[2], -(side[0] * eye[0] + side[1] * eye[1] + side[2] * eye[2]),
+        trueUp[0], trueUp[1], trueUp[2], -(trueUp[0] * eye[0] + trueUp[1] * eye[1] + trueUp[2] * eye[2]),
+        -forward[0], -forward[1], -forward[2], forward[0] * eye[0] + forward[1] * eye[1] + forward[2] * eye[2],
+        0.0f, 0.0f, 0.0f, 1.0f
+    };
+    for (int i = 0; i < 16; i++) matrix[i] = temp[i];
+}
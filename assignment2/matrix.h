@@ -0,0 +1,23 @@
+#ifndef MATRIX_H
+#define MATRIX_H
+
+// 4x4 matrix helpers. Matrices are row-major float[16] acting on column
+// vectors, so translation lives in elements 3, 7 and 11. Angles are in radians.
+void scaleMatrix(float* matrix, float sx, float sy, float sz);
+void rotateXMatrix(float* matrix, float angle);
+void rotateYMatrix(float* matrix, float angle);
+void rotateZMatrix(float* matrix, float angle);
+void translateMatrix(float* matrix, float tx, float ty, float tz);
+// result = a * b (result must not alias a or b)
+void multiplyMatrix(float* result, const float* a, const float* b);
+void identityMatrix(float* matrix);
+// Same matrix as glOrtho
+void orthoMatrix(float* matrix, float left, float right, float bottom, float top, float zNear, float zFar);
+// Same matrix as gluPerspective; fovY is the vertical field of view
+void perspectiveMatrix(float* matrix, float fovY, float aspect, float zNear, float zFar);
+// View matrix of a camera at eye looking at target (as gluLookAt)
+void lookAtMatrix(float* matrix, const float* eye, const float* target, const float* up);
+// Row-major to column-major (for glLoadMatrixf) and back
+void transposeMatrix(float* result, const float* matrix);
+
+#endif
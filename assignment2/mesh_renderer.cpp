@@ -0,0 +1,228 @@
+#include "mesh_renderer.h"
+#include "logger.h"
+#include "matrix.h"
+
+static const char* DIRECT_VERTEX_SHADER = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aColor;
+out vec3 ourColor;
+uniform mat4 transform;
+uniform mat4 viewProjection;
+void main() {
+    gl_Position = viewProjection * (transform * vec4(aPos, 1.0));
+    ourColor = aColor;
+}
+)";
+
+// The per-draw matrix arrives row by row as the columns of a mat4, so
+// multiplying from the left applies the row-major matrix
+static const char* INDIRECT_VERTEX_SHADER = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aColor;
+layout (location = 2) in mat4 drawTransform;
+out vec3 ourColor;
+uniform mat4 viewProjection;
+void main() {
+    gl_Position = viewProjection * (vec4(aPos, 1.0) * drawTransform);
+    ourColor = aColor;
+}
+)";
+
+static const char* FRAGMENT_SHADER = R"(
+#version 330 core
+in vec3 ourColor;
+out vec4 FragColor;
+void main() {
+    FragColor = vec4(ourColor, 1.0);
+}
+)";
+
+// Locations 2-5 hold the columns of drawTransform
+const GLuint TRANSFORM_ATTRIBUTE = 2;
+
+static GLuint compileShader(GLenum type, const char* source) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+    GLint ok = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        char info[1024];
+        glGetShaderInfoLog(shader, sizeof(info), nullptr, info);
+        logError("Mesh shader compilation failed: %s", info);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+static GLuint linkProgram(const char* vertexSource) {
+    GLuint vertexShader = compileShader(GL_VERTEX_SHADER, vertexSource);
+    GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, FRAGMENT_SHADER);
+    if (!vertexShader || !fragmentShader) {
+        if (vertexShader) glDeleteShader(vertexShader);
+        if (fragmentShader) glDeleteShader(fragmentShader);
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glLinkProgram(program);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    GLint ok = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        char info[1024];
+        glGetProgramInfoLog(program, sizeof(info), nullptr, info);
+        logError("Mesh program link failed: %s", info);
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+// Grows a per-draw buffer to at least `bytes` and fills it; orphaning the old
+// storage lets the driver keep it for draws still in flight
+static void uploadStream(GLenum target, GLuint buffer, size_t& capacity, const void* data, size_t bytes) {
+    glBindBuffer(target, buffer);
+    if (bytes > capacity) capacity = bytes * 2;
+    glBufferData(target, capacity, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(target, 0, bytes, data);
+}
+
+MeshRenderer::MeshRenderer()
+    : vertexArray(0), vertexBuffer(0), indexBuffer(0), transformBuffer(0), indirectBuffer(0), directProgram(0),
+      indirectProgram(0), transformLocation(-1), directViewProjectionLocation(-1), indirectViewProjectionLocation(-1),
+      multiDraw(false), transformCapacity(0), indirectCapacity(0) {
+    identityMatrix(viewProjection);
+}
+
+int MeshRenderer::addMesh(const MeshData& mesh) {
+    MeshRange range;
+    range.firstIndex = (GLuint)packedIndices.size();
+    range.indexCount = (GLuint)mesh.indices.size();
+    range.baseVertex = (GLint)(packedVertices.size() / MESH_VERTEX_FLOATS);
+    packedVertices.insert(packedVertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+    packedIndices.insert(packedIndices.end(), mesh.indices.begin(), mesh.indices.end());
+    meshes.push_back(range);
+    return (int)meshes.size() - 1;
+}
+
+bool MeshRenderer::init() {
+    directProgram = linkProgram(DIRECT_VERTEX_SHADER);
+    if (!directProgram) return false;
+    transformLocation = glGetUniformLocation(directProgram, "transform");
+    directViewProjectionLocation = glGetUniformLocation(directProgram, "viewProjection");
+
+    multiDraw = GLEW_VERSION_4_3 ||
+                (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance && (GLEW_VERSION_4_0 || GLEW_ARB_draw_indirect));
+    if (multiDraw) indirectProgram = linkProgram(INDIRECT_VERTEX_SHADER);
+    if (!indirectProgram) {
+        multiDraw = false;
+        logInfo("Multi-draw indirect not supported, objects are drawn one call each");
+    } else {
+        indirectViewProjectionLocation = glGetUniformLocation(indirectProgram, "viewProjection");
+    }
+
+    glGenVertexArrays(1, &vertexArray);
+    glGenBuffers(1, &vertexBuffer);
+    glGenBuffers(1, &indexBuffer);
+    glGenBuffers(1, &transformBuffer);
+    glGenBuffers(1, &indirectBuffer);
+
+    glBindVertexArray(vertexArray);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, packedVertices.size() * sizeof(float), packedVertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, packedIndices.size() * sizeof(GLuint), packedIndices.data(), GL_STATIC_DRAW);
+
+    const GLsizei stride = MESH_VERTEX_FLOATS * sizeof(float);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+
+    // One matrix per draw, advanced per instance (so by baseInstance)
+    glBindBuffer(GL_ARRAY_BUFFER, transformBuffer);
+    for (GLuint column = 0; column < 4; column++) {
+        glVertexAttribPointer(TRANSFORM_ATTRIBUTE + column, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(float),
+                              (void*)(column * 4 * sizeof(float)));
+        glVertexAttribDivisor(TRANSFORM_ATTRIBUTE + column, 1);
+        if (multiDraw) glEnableVertexAttribArray(TRANSFORM_ATTRIBUTE + column);
+    }
+    glBindVertexArray(0);
+
+    // The GPU copies are all that is needed from here on
+    std::vector<float>().swap(packedVertices);
+    std::vector<GLuint>().swap(packedIndices);
+    return true;
+}
+
+void MeshRenderer::destroy() {
+    if (vertexArray) glDeleteVertexArrays(1, &vertexArray);
+    GLuint buffers[] = {vertexBuffer, indexBuffer, transformBuffer, indirectBuffer};
+    for (GLuint buffer : buffers) {
+        if (buffer) glDeleteBuffers(1, &buffer);
+    }
+    if (directProgram) glDeleteProgram(directProgram);
+    if (indirectProgram) glDeleteProgram(indirectProgram);
+    vertexArray = vertexBuffer = indexBuffer = transformBuffer = indirectBuffer = 0;
+    directProgram = indirectProgram = 0;
+    transformCapacity = indirectCapacity = 0;
+    multiDraw = false;
+}
+
+void MeshRenderer::setViewProjection(const float* matrix) {
+    for (int i = 0; i < 16; i++) viewProjection[i] = matrix[i];
+}
+
+void MeshRenderer::beginDirect() {
+    glUseProgram(directProgram);
+    glUniformMatrix4fv(directViewProjectionLocation, 1, GL_TRUE, viewProjection);
+    glBindVertexArray(vertexArray);
+}
+
+void MeshRenderer::drawDirect(int mesh, const float* transform) {
+    const MeshRange& range = meshes[mesh];
+    glUniformMatrix4fv(transformLocation, 1, GL_TRUE, transform);
+    glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT,
+                             (void*)(range.firstIndex * sizeof(GLuint)), range.baseVertex);
+}
+
+void MeshRenderer::beginIndirect() {
+    commands.clear();
+    transforms.clear();
+}
+
+DrawElementsIndirectCommand MeshRenderer::meshCommand(int mesh, GLuint instanceCount, GLuint baseInstance) const {
+    const MeshRange& range = meshes[mesh];
+    DrawElementsIndirectCommand command = {range.indexCount, instanceCount, range.firstIndex, range.baseVertex,
+                                           baseInstance};
+    return command;
+}
+
+void MeshRenderer::addIndirect(int mesh, const float* transform) {
+    commands.push_back(meshCommand(mesh, 1, (GLuint)commands.size()));
+    transforms.insert(transforms.end(), transform, transform + 16);
+}
+
+void MeshRenderer::flushIndirect() {
+    if (commands.empty()) return;
+    uploadStream(GL_ARRAY_BUFFER, transformBuffer, transformCapacity, transforms.data(),
+                 transforms.size() * sizeof(float));
+    uploadStream(GL_DRAW_INDIRECT_BUFFER, indirectBuffer, indirectCapacity, commands.data(),
+                 commands.size() * sizeof(DrawElementsIndirectCommand));
+
+    glUseProgram(indirectProgram);
+    glUniformMatrix4fv(indirectViewProjectionLocation, 1, GL_TRUE, viewProjection);
+    glBindVertexArray(vertexArray);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, (GLsizei)commands.size(), 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    commands.clear();
+    transforms.clear();
+}
@@ -0,0 +1,82 @@
+#ifndef MESH_RENDERER_H
+#define MESH_RENDERER_H
+
+#include <GL/glew.h>
+#include <vector>
+#include "meshes.h"
+
+// Record layout glMultiDrawElementsIndirect reads from GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// Draws many objects made of a few meshes. All meshes share one vertex and
+// one index buffer (each mesh is a range of indices plus a base vertex), so
+// every draw uses the same vertex array and they can be issued two ways:
+//   direct:   one glDrawElementsBaseVertex per object, its matrix in a uniform
+//   indirect: one DrawElementsIndirectCommand per object and a single
+//             glMultiDrawElementsIndirect for all of them (GL 4.3 or
+//             ARB_multi_draw_indirect). Matrices go to a per-draw buffer read
+//             as an instanced attribute; each command's baseInstance is its
+//             index, which selects its matrix.
+// Transforms are row-major (see matrix.h); the view-projection matrix is
+// applied on top of them in the shaders.
+class MeshRenderer {
+public:
+    MeshRenderer();
+
+    // Adds a mesh before init(); returns its id
+    int addMesh(const MeshData& mesh);
+    int meshCount() const { return (int)meshes.size(); }
+
+    // Compiles the programs and uploads the meshes; needs a GL 3.3 core context
+    bool init();
+    void destroy();
+    bool multiDrawSupported() const { return multiDraw; }
+
+    // Camera for the following draws (identity until set)
+    void setViewProjection(const float* matrix);
+
+    // Direct path: begin binds the program and vertex array, then one draw call per object
+    void beginDirect();
+    void drawDirect(int mesh, const float* transform);
+
+    // Indirect path: collects commands and matrices until flushIndirect(),
+    // which uploads them and draws everything with one call
+    void beginIndirect();
+    void addIndirect(int mesh, const float* transform);
+    void flushIndirect();
+
+    // The shared buffers and a mesh's draw, for passes that build their own draws
+    GLuint sharedVertexBuffer() const { return vertexBuffer; }
+    GLuint sharedIndexBuffer() const { return indexBuffer; }
+    DrawElementsIndirectCommand meshCommand(int mesh, GLuint instanceCount, GLuint baseInstance) const;
+
+private:
+    struct MeshRange {
+        GLuint firstIndex, indexCount;
+        GLint baseVertex;
+    };
+
+    std::vector<MeshRange> meshes;
+    std::vector<float> packedVertices;
+    std::vector<GLuint> packedIndices;
+
+    GLuint vertexArray, vertexBuffer, indexBuffer;
+    GLuint transformBuffer, indirectBuffer;
+    GLuint directProgram, indirectProgram;
+    GLint transformLocation;
+    GLint directViewProjectionLocation, indirectViewProjectionLocation;
+    float viewProjection[16];
+    bool multiDraw;
+    size_t transformCapacity, indirectCapacity; // bytes allocated in the per-draw buffers
+
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<float> transforms;
+};
+
+#endif
@@ -0,0 +1,119 @@
+#include "meshes.h"
+#include <cmath>
+
+static const float PI = 3.14159265358979323846f;
+
+static const float CUBE_VERTICES[] = {
+    // positions          // colors
+    -0.5f, -0.5f, -0.5f,  1.0f, 0.0f, 0.0f,  // red
+     0.5f, -0.5f, -0.5f,  0.0f, 1.0f, 0.0f,  // green
+     0.5f,  0.5f, -0.5f,  0.0f, 0.0f, 1.0f,  // blue
+    -0.5f,  0.5f, -0.5f,  1.0f, 1.0f, 0.0f,  // yellow
+    -0.5f, -0.5f,  0.5f,  1.0f, 0.0f, 1.0f,  // magenta
+     0.5f, -0.5f,  0.5f,  0.0f, 1.0f, 1.0f,  // cyan
+     0.5f,  0.5f,  0.5f,  1.0f, 1.0f, 1.0f,  // white
+    -0.5f,  0.5f,  0.5f,  0.5f, 0.5f, 0.5f   // gray
+};
+
+static const unsigned CUBE_INDICES[] = {
+    // back face
+    0, 1, 2, 2, 3, 0,
+    // front face
+    4, 5, 6, 6, 7, 4,
+    // left face
+    4, 0, 3, 3, 7, 4,
+    // right face
+    1, 5, 6, 6, 2, 1,
+    // bottom face
+    4, 5, 1, 1, 0, 4,
+    // top face
+    3, 2, 6, 6, 7, 3
+};
+
+// Vertex colored by its position, so faces can be told apart without lighting
+static void addVertex(MeshData& mesh, float x, float y, float z) {
+    const float v[MESH_VERTEX_FLOATS] = {x, y, z, x + 0.5f, y + 0.5f, z + 0.5f};
+    mesh.vertices.insert(mesh.vertices.end(), v, v + MESH_VERTEX_FLOATS);
+}
+
+static void addTriangle(MeshData& mesh, unsigned a, unsigned b, unsigned c) {
+    mesh.indices.push_back(a);
+    mesh.indices.push_back(b);
+    mesh.indices.push_back(c);
+}
+
+static void buildPyramid(MeshData& mesh) {
+    addVertex(mesh, -0.5f, -0.5f, -0.5f);
+    addVertex(mesh, 0.5f, -0.5f, -0.5f);
+    addVertex(mesh, 0.5f, -0.5f, 0.5f);
+    addVertex(mesh, -0.5f, -0.5f, 0.5f);
+    addVertex(mesh, 0.0f, 0.5f, 0.0f);
+    addTriangle(mesh, 0, 1, 2);
+    addTriangle(mesh, 2, 3, 0);
+    for (unsigned i = 0; i < 4; i++) addTriangle(mesh, i, (i + 1) % 4, 4);
+}
+
+static void buildOctahedron(MeshData& mesh) {
+    addVertex(mesh, 0.5f, 0.0f, 0.0f);
+    addVertex(mesh, 0.0f, 0.0f, 0.5f);
+    addVertex(mesh, -0.5f, 0.0f, 0.0f);
+    addVertex(mesh, 0.0f, 0.0f, -0.5f);
+    addVertex(mesh, 0.0f, 0.5f, 0.0f);
+    addVertex(mesh, 0.0f, -0.5f, 0.0f);
+    for (unsigned i = 0; i < 4; i++) {
+        addTriangle(mesh, i, (i + 1) % 4, 4);
+        addTriangle(mesh, (i + 1) % 4, i, 5);
+    }
+}
+
+// Hexagonal prism along Y
+static void buildPrism(MeshData& mesh) {
+    const unsigned sides = 6;
+    for (unsigned i = 0; i < sides; i++) {
+        float angle = 2.0f * PI * i / sides;
+        addVertex(mesh, 0.5f * cosf(angle), -0.5f, 0.5f * sinf(angle));
+        addVertex(mesh, 0.5f * cosf(angle), 0.5f, 0.5f * sinf(angle));
+    }
+    for (unsigned i = 0; i < sides; i++) {
+        unsigned j = (i + 1) % sides;
+        addTriangle(mesh, 2 * i, 2 * j, 2 * j + 1);
+        addTriangle(mesh, 2 * j + 1, 2 * i + 1, 2 * i);
+    }
+    for (unsigned i = 1; i + 1 < sides; i++) {
+        addTriangle(mesh, 0, 2 * (i + 1), 2 * i);
+        addTriangle(mesh, 1, 2 * i + 1, 2 * (i + 1) + 1);
+    }
+}
+
+static void buildSphere(MeshData& mesh) {
+    const unsigned rings = 8, segments = 12;
+    for (unsigned r = 0; r <= rings; r++) {
+        float polar = PI * r / rings;
+        for (unsigned s = 0; s <= segments; s++) {
+            float azimuth = 2.0f * PI * s / segments;
+            addVertex(mesh, 0.5f * sinf(polar) * cosf(azimuth), 0.5f * cosf(polar), 0.5f * sinf(polar) * sinf(azimuth));
+        }
+    }
+    for (unsigned r = 0; r < rings; r++) {
+        for (unsigned s = 0; s < segments; s++) {
+            unsigned a = r * (segments + 1) + s, b = a + segments + 1;
+            addTriangle(mesh, a, b, a + 1);
+            addTriangle(mesh, a + 1, b, b + 1);
+        }
+    }
+}
+
+void buildMesh(int kind, MeshData& mesh) {
+    mesh.vertices.clear();
+    mesh.indices.clear();
+    switch (kind) {
+        case MESH_CUBE:
+            mesh.vertices.assign(CUBE_VERTICES, CUBE_VERTICES + sizeof(CUBE_VERTICES) / sizeof(float));
+            mesh.indices.assign(CUBE_INDICES, CUBE_INDICES + sizeof(CUBE_INDICES) / sizeof(unsigned));
+            break;
+        case MESH_PYRAMID: buildPyramid(mesh); break;
+        case MESH_OCTAHEDRON: buildOctahedron(mesh); break;
+        case MESH_PRISM: buildPrism(mesh); break;
+        case MESH_SPHERE: buildSphere(mesh); break;
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef MESHES_H
+#define MESHES_H
+
+#include <cstddef>
+#include <vector>
+
+// Interleaved position (x, y, z) and color (r, g, b) per vertex
+const int MESH_VERTEX_FLOATS = 6;
+
+// Indexed triangle mesh around the origin, about one unit across
+struct MeshData {
+    std::vector<float> vertices;
+    std::vector<unsigned> indices;
+
+    size_t vertexCount() const { return vertices.size() / MESH_VERTEX_FLOATS; }
+};
+
+// Built-in shapes of the cube demo; the cube keeps its original corner colors,
+// the others are colored by position
+enum MeshKind { MESH_CUBE, MESH_PYRAMID, MESH_OCTAHEDRON, MESH_PRISM, MESH_SPHERE, MESH_KIND_COUNT };
+
+void buildMesh(int kind, MeshData& mesh);
+
+#endif
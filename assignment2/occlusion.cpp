@@ -0,0 +1,59 @@
+#include "occlusion.h"
+
+OcclusionQueries::OcclusionQueries()
+    : target(GL_ANY_SAMPLES_PASSED), current(0), tested(0), hidden(0), totalTested(0), totalHidden(0),
+      measuredFrames(0) {
+}
+
+void OcclusionQueries::init(size_t count) {
+    // The conservative query may answer early from coarse depth (GL 4.3 or ES3 compatibility)
+    target = GLEW_VERSION_4_3 || GLEW_ARB_ES3_compatibility ? GL_ANY_SAMPLES_PASSED_CONSERVATIVE
+                                                           : GL_ANY_SAMPLES_PASSED;
+    for (int set = 0; set < 2; set++) {
+        queries[set].assign(count, 0);
+        issued[set].clear();
+        issued[set].reserve(count);
+    }
+}
+
+void OcclusionQueries::destroy() {
+    for (int set = 0; set < 2; set++) {
+        for (GLuint query : queries[set]) {
+            if (query) glDeleteQueries(1, &query);
+        }
+        queries[set].clear();
+        issued[set].clear();
+    }
+}
+
+void OcclusionQueries::beginFrame() {
+    current ^= 1;
+    if (issued[current].empty()) return;
+    tested = hidden = 0;
+    for (int object : issued[current]) {
+        GLuint query = queries[current][object];
+        GLint available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) continue;
+        GLuint passed = 0;
+        glGetQueryObjectuiv(query, GL_QUERY_RESULT, &passed);
+        tested++;
+        if (!passed) hidden++;
+    }
+    issued[current].clear();
+    totalTested += tested;
+    totalHidden += hidden;
+    measuredFrames++;
+}
+
+GLuint OcclusionQueries::begin(int object) {
+    GLuint& query = queries[current][object];
+    if (!query) glGenQueries(1, &query);
+    issued[current].push_back(object);
+    glBeginQuery(target, query);
+    return query;
+}
+
+void OcclusionQueries::end() {
+    glEndQuery(target);
+}
@@ -0,0 +1,47 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <GL/glew.h>
+#include <cstddef>
+#include <vector>
+
+// One occlusion query per object and frame, for drawing an object's bounding
+// box before the object and skipping the object with conditional rendering
+// when none of the box passes the depth test. The conditional draw waits for
+// its query on the GPU, so a hidden result is exactly a draw that was skipped.
+// Queries come in two sets used on alternate frames: the set about to be
+// reused was issued two frames ago, so its results are counted for the
+// statistics without the CPU waiting for the GPU.
+class OcclusionQueries {
+public:
+    OcclusionQueries();
+
+    // Objects are 0..count-1; query objects are created on first use
+    void init(size_t count);
+    void destroy();
+    bool conservative() const { return target == GL_ANY_SAMPLES_PASSED_CONSERVATIVE; }
+
+    // Switches sets and counts the finished results of the one being reused
+    void beginFrame();
+    // Query for the object's box this frame, for glBeginConditionalRender
+    GLuint begin(int object);
+    void end();
+
+    // Objects whose box was tested and found hidden, i.e. whose draw was
+    // skipped, from the last results counted
+    size_t lastTested() const { return tested; }
+    size_t lastHidden() const { return hidden; }
+    // Averages over all frames with results
+    double hiddenPerFrame() const { return measuredFrames ? (double)totalHidden / measuredFrames : 0.0; }
+    double testedPerFrame() const { return measuredFrames ? (double)totalTested / measuredFrames : 0.0; }
+
+private:
+    GLenum target;
+    std::vector<GLuint> queries[2];
+    std::vector<int> issued[2]; // objects queried with each set
+    int current;
+    size_t tested, hidden;
+    size_t totalTested, totalHidden, measuredFrames;
+};
+
+#endif
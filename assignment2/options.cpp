@@ -0,0 +1,80 @@
+#include "options.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+bool parseDemoOptions(int argc, char** argv, DemoOptions& options) {
+    bool ok = true;
+    for (int i = 1; i < argc && ok; i++) {
+        if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) options.recordPath = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) options.replayPath = argv[++i];
+        else if (strcmp(argv[i], "--max-speed") == 0) options.maxSpeed = true;
+        else if (strcmp(argv[i], "--headless") == 0) options.headless = true;
+        else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) options.capturePath = argv[++i];
+        else if (strcmp(argv[i], "--load-snapshot") == 0 && i + 1 < argc) options.loadPath = argv[++i];
+        else if (strcmp(argv[i], "--save-snapshot") == 0 && i + 1 < argc) options.savePath = argv[++i];
+        else if (strcmp(argv[i], "--cpu-circles") == 0) options.cpuCircles = true;
+        else if (strcmp(argv[i], "--occlusion") == 0) options.occlusionCulling = true;
+        else if (strcmp(argv[i], "--low-latency") == 0) options.lowLatency = true;
+        else if (strcmp(argv[i], "--renderer") == 0 && i + 1 < argc) {
+            const char* renderer = argv[++i];
+            if (strcmp(renderer, "gl") == 0) options.softwareRenderer = false;
+            else if (strcmp(renderer, "soft") == 0) options.softwareRenderer = true;
+            else ok = false;
+        } else if (strcmp(argv[i], "--vsync") == 0 && i + 1 < argc) {
+            const char* mode = argv[++i];
+            if (strcmp(mode, "on") == 0) options.swapMode = SWAP_VSYNC_ON;
+            else if (strcmp(mode, "off") == 0) options.swapMode = SWAP_VSYNC_OFF;
+            else if (strcmp(mode, "adaptive") == 0) options.swapMode = SWAP_VSYNC_ADAPTIVE;
+            else ok = false;
+        } else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            char* end = nullptr;
+            options.targetFps = strtod(argv[++i], &end);
+            if (*end != '\0' || options.targetFps < 0.0) ok = false;
+        } else if (strcmp(argv[i], "--objects") == 0 && i + 1 < argc) {
+            char* end = nullptr;
+            long count = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || count < 0 || count > 100000000) ok = false;
+            options.objectCount = (int)count;
+        } else if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc) {
+            char* end = nullptr;
+            long count = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || count < 0 || count > 4) ok = false;
+            options.framesInFlight = (int)count;
+        } else if (strcmp(argv[i], "--frame-budget") == 0 && i + 1 < argc) {
+            char* end = nullptr;
+            options.frameBudgetMs = strtod(argv[++i], &end);
+            if (*end != '\0' || options.frameBudgetMs <= 0.0) ok = false;
+        } else if (strcmp(argv[i], "--upscale") == 0 && i + 1 < argc) {
+            const char* filter = argv[++i];
+            if (strcmp(filter, "sharpen") == 0) options.sharpenUpscale = true;
+            else if (strcmp(filter, "bilinear") == 0) options.sharpenUpscale = false;
+            else ok = false;
+        } else if (strcmp(argv[i], "--draw") == 0 && i + 1 < argc) {
+            const char* path = argv[++i];
+            options.gpuCulling = strcmp(path, "gpu") == 0;
+            if (strcmp(path, "indirect") == 0 || options.gpuCulling) options.multiDraw = true;
+            else if (strcmp(path, "direct") == 0) options.multiDraw = false;
+            else ok = false;
+        }
+        else ok = false;
+    }
+    if (options.recordPath && options.replayPath) ok = false;
+    if (options.framesInFlight < 0) options.framesInFlight = options.lowLatency ? 1 : 0;
+
+    // Replaying at full speed ignores pacing
+    if (options.maxSpeed) {
+        options.swapMode = SWAP_VSYNC_OFF;
+        options.targetFps = 0.0;
+    }
+
+    if (!ok) {
+        std::cerr << "Usage: " << argv[0] << " [--record <file> | --replay <file> [--max-speed] [--headless]]"
+                  << " [--capture <file.y4m|file.png|file.rgb>] [--cpu-circles] [--renderer gl|soft]"
+                  << " [--vsync on|off|adaptive] [--fps <n>] [--objects <n>] [--draw indirect|direct|gpu]"
+                  << " [--occlusion] [--frame-budget <ms>] [--upscale bilinear|sharpen]"
+                  << " [--low-latency] [--frames-in-flight <n>] [--load-snapshot <file>] [--save-snapshot <file>]"
+                  << std::endl;
+    }
+    return ok;
+}
@@ -0,0 +1,34 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include "pacing.h"
+
+// Command line shared by both demos
+struct DemoOptions {
+    const char* recordPath = nullptr;  // --record <file>: save all input, see replay.h
+    const char* replayPath = nullptr;  // --replay <file>: play a recording back
+    bool maxSpeed = false;             // --max-speed: no vsync, no waiting for recorded frame times
+    bool headless = false;             // --headless: hidden windows
+    const char* capturePath = nullptr; // --capture <file>: frame capture output, see capture.h
+    const char* loadPath = nullptr;    // --load-snapshot <file>: start from a saved scene, see snapshot.h;
+                                       // recordings made from one replay only from the same snapshot
+    const char* savePath = nullptr;    // --save-snapshot <file>: save the scene at exit
+    bool cpuCircles = false;           // --cpu-circles: animate breathing circles on the CPU (main)
+    bool softwareRenderer = false;     // --renderer soft: draw with the CPU rasterizer (--renderer gl is the default)
+    SwapMode swapMode = SWAP_VSYNC_ON; // --vsync on|off|adaptive
+    double targetFps = 0.0;            // --fps <n>: frame rate limit, 0 for none
+    int objectCount = 0;               // --objects <n>: extra objects of mixed meshes (cube)
+    bool multiDraw = true;             // --draw indirect|direct: one multi-draw or a call per object (cube)
+    bool gpuCulling = false;           // --draw gpu: cull and build the multi-draw in a compute shader (cube)
+    bool occlusionCulling = false;     // --occlusion: skip objects hidden behind others with occlusion queries (cube)
+    double frameBudgetMs = 0.0;        // --frame-budget <ms>: scale the render resolution to this GPU time (cube)
+    bool sharpenUpscale = true;        // --upscale bilinear|sharpen: filter for the scaled-down frames (cube)
+    bool lowLatency = false;           // --low-latency: sample input just before building each frame
+    int framesInFlight = -1;           // --frames-in-flight <n>: frames the driver may queue, 0 for no limit;
+                                       // -1 picks 1 with --low-latency and no limit otherwise
+};
+
+// Prints the usage and returns false on unknown or incomplete options
+bool parseDemoOptions(int argc, char** argv, DemoOptions& options);
+
+#endif
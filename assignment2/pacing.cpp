@@ -0,0 +1,101 @@
+#include "pacing.h"
+#include "logger.h"
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+void applySwapInterval(SwapMode mode) {
+    switch (mode) {
+        case SWAP_VSYNC_ON: glfwSwapInterval(1); break;
+        case SWAP_VSYNC_OFF: glfwSwapInterval(0); break;
+        case SWAP_VSYNC_ADAPTIVE:
+            if (glfwExtensionSupported("WGL_EXT_swap_control_tear") ||
+                glfwExtensionSupported("GLX_EXT_swap_control_tear")) {
+                glfwSwapInterval(-1);
+            } else {
+                logWarning("Adaptive vsync not supported, using vsync");
+                glfwSwapInterval(1);
+            }
+            break;
+    }
+}
+
+const double FrameTimeStats::BUCKET_SECONDS = 0.0001;
+
+FrameTimeStats::FrameTimeStats() : frames(0), mean(0.0), m2(0.0), minimum(0.0), maximum(0.0), histogram() {
+}
+
+void FrameTimeStats::addFrame(double seconds) {
+    frames++;
+    double delta = seconds - mean;
+    mean += delta / frames;
+    m2 += delta * (seconds - mean);
+    minimum = frames == 1 ? seconds : std::min(minimum, seconds);
+    maximum = frames == 1 ? seconds : std::max(maximum, seconds);
+    int bucket = std::min(BUCKETS - 1, std::max(0, (int)(seconds / BUCKET_SECONDS)));
+    histogram[bucket]++;
+}
+
+// Upper edge of the bucket holding the given fraction of frames
+double FrameTimeStats::percentile(double fraction) const {
+    unsigned target = (unsigned)std::ceil(fraction * frames);
+    unsigned seen = 0;
+    for (int i = 0; i < BUCKETS - 1; i++) {
+        seen += histogram[i];
+        if (seen >= target) return (i + 1) * BUCKET_SECONDS;
+    }
+    return maximum;
+}
+
+void FrameTimeStats::logSummary() const {
+    if (frames < 2) return;
+    double deviation = std::sqrt(m2 / (frames - 1));
+    logInfo("Frame time over %u frames: mean %.3f ms (%.1f fps), std dev %.3f ms, min %.3f ms, max %.3f ms, "
+            "median %.1f ms, 99th percentile %.1f ms",
+            frames, mean * 1000.0, 1.0 / mean, deviation * 1000.0, minimum * 1000.0, maximum * 1000.0,
+            percentile(0.5) * 1000.0, percentile(0.99) * 1000.0);
+}
+
+FramePacer::FramePacer()
+    : period(Clock::duration::zero()), spinMargin(std::chrono::milliseconds(1)), started(false) {
+}
+
+void FramePacer::setTargetFps(double fps) {
+    period = fps > 0.0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / fps))
+                       : Clock::duration::zero();
+    started = false;
+}
+
+void FramePacer::waitUntil(Clock::time_point target) {
+    Clock::time_point now = Clock::now();
+    if (target - now > spinMargin) {
+        Clock::duration sleep = target - now - spinMargin;
+        std::this_thread::sleep_for(sleep);
+        Clock::duration overshoot = Clock::now() - now - sleep;
+
+        // Margin: a quarter more than the worst recent overshoot, decaying
+        // slowly, and never more than half a frame
+        Clock::duration wanted = overshoot + overshoot / 4;
+        spinMargin = std::max(wanted, spinMargin - spinMargin / 64);
+        spinMargin = std::max<Clock::duration>(spinMargin, std::chrono::microseconds(200));
+        spinMargin = std::min(spinMargin, period / 2);
+    }
+    while (Clock::now() < target) std::this_thread::yield();
+}
+
+void FramePacer::endFrame() {
+    if (period > Clock::duration::zero()) {
+        Clock::time_point now = Clock::now();
+        if (!started) deadline = now;
+        deadline += period;
+        // After a long stall restart the schedule rather than rushing frames to catch up
+        if (now > deadline + period) deadline = now;
+        waitUntil(deadline);
+    }
+
+    Clock::time_point now = Clock::now();
+    if (started) frameTimes.addFrame(std::chrono::duration<double>(now - lastFrame).count());
+    lastFrame = now;
+    started = true;
+}
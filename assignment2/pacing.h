@@ -0,0 +1,69 @@
+#ifndef PACING_H
+#define PACING_H
+
+#include <chrono>
+
+enum SwapMode {
+    SWAP_VSYNC_ON,
+    SWAP_VSYNC_OFF,
+    SWAP_VSYNC_ADAPTIVE // vsync, but late frames swap immediately (tears instead of stalling a whole refresh)
+};
+
+// Sets the swap interval of the current context. Adaptive falls back to
+// plain vsync without the swap_control_tear extension.
+void applySwapInterval(SwapMode mode);
+
+// Frame-to-frame time statistics: mean and standard deviation (Welford),
+// extremes and percentiles from a fixed histogram, so recording never allocates
+class FrameTimeStats {
+public:
+    FrameTimeStats();
+    void addFrame(double seconds);
+    void logSummary() const;
+
+    // For other durations collected the same way (seconds)
+    unsigned count() const { return frames; }
+    double meanSeconds() const { return mean; }
+    double minSeconds() const { return minimum; }
+    double maxSeconds() const { return maximum; }
+    double percentile(double fraction) const;
+
+private:
+    static const int BUCKETS = 1000; // 0.1 ms each, the last one collects everything longer
+    static const double BUCKET_SECONDS;
+
+    unsigned frames;
+    double mean, m2;
+    double minimum, maximum;
+    unsigned histogram[BUCKETS];
+};
+
+// Holds the frame rate at a target by waiting until each frame's deadline:
+// a normal sleep for most of the wait, then yielding for the last stretch,
+// since sleeps overshoot by up to the timer resolution. The spin margin
+// follows the overshoot actually measured, so on precise timers almost the
+// whole wait is spent sleeping.
+class FramePacer {
+public:
+    FramePacer();
+
+    // 0 disables the limiter; frame times are still measured
+    void setTargetFps(double fps);
+    // Call once per frame after presenting
+    void endFrame();
+    const FrameTimeStats& stats() const { return frameTimes; }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    Clock::duration period;
+    Clock::duration spinMargin;
+    Clock::time_point deadline;
+    Clock::time_point lastFrame;
+    bool started;
+    FrameTimeStats frameTimes;
+
+    void waitUntil(Clock::time_point target);
+};
+
+#endif
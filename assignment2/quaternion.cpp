@@ -0,0 +1,116 @@
+#include "quaternion.h"
+#include <cmath>
+
+Quat quatIdentity() {
+    Quat q = {0.0f, 0.0f, 0.0f, 1.0f};
+    return q;
+}
+
+Quat quatFromAxisAngle(float ax, float ay, float az, float angle) {
+    float length = sqrt(ax * ax + ay * ay + az * az);
+    if (length <= 0.0f) return quatIdentity();
+    float s = sin(angle * 0.5f) / length;
+    float c = cos(angle * 0.5f);
+    Quat q = {ax * s, ay * s, az * s, c};
+    return q;
+}
+
+Quat quatFromEuler(float x, float y, float z) {
+    Quat qx = quatFromAxisAngle(1.0f, 0.0f, 0.0f, x);
+    Quat qy = quatFromAxisAngle(0.0f, 1.0f, 0.0f, y);
+    Quat qz = quatFromAxisAngle(0.0f, 0.0f, 1.0f, z);
+    return quatMultiply(qz, quatMultiply(qy, qx));
+}
+
+Quat quatMultiply(const Quat& a, const Quat& b) {
+    Quat q = {
+        a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+        a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+        a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+        a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z
+    };
+    return q;
+}
+
+float quatDot(const Quat& a, const Quat& b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+}
+
+Quat quatNormalize(const Quat& q) {
+    float length = sqrt(quatDot(q, q));
+    if (length <= 0.0f) return quatIdentity();
+    float inv = 1.0f / length;
+    Quat r = {q.x * inv, q.y * inv, q.z * inv, q.w * inv};
+    return r;
+}
+
+Quat quatNlerp(const Quat& a, const Quat& b, float t) {
+    // q and -q are the same orientation; flip b to take the shorter arc
+    float sign = quatDot(a, b) < 0.0f ? -1.0f : 1.0f;
+    float s = 1.0f - t, u = t * sign;
+    Quat q = {a.x * s + b.x * u, a.y * s + b.y * u, a.z * s + b.z * u, a.w * s + b.w * u};
+    return quatNormalize(q);
+}
+
+Quat quatSlerp(const Quat& a, const Quat& b, float t) {
+    float cosTheta = quatDot(a, b);
+    float sign = 1.0f;
+    if (cosTheta < 0.0f) {
+        cosTheta = -cosTheta;
+        sign = -1.0f;
+    }
+    // Nearly parallel: nlerp is exact enough and avoids dividing by sin(0)
+    if (cosTheta > 0.9995f) return quatNlerp(a, b, t);
+
+    float theta = acos(cosTheta);
+    float sinTheta = sin(theta);
+    float s = sin((1.0f - t) * theta) / sinTheta;
+    float u = sin(t * theta) / sinTheta * sign;
+    Quat q = {a.x * s + b.x * u, a.y * s + b.y * u, a.z * s + b.z * u, a.w * s + b.w * u};
+    return q;
+}
+
+void quatToMatrix3(const Quat& q, float* m) {
+    float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+    m[0] = 1.0f - 2.0f * (yy + zz);
+    m[1] = 2.0f * (xy - wz);
+    m[2] = 2.0f * (xz + wy);
+    m[4] = 2.0f * (xy + wz);
+    m[5] = 1.0f - 2.0f * (xx + zz);
+    m[6] = 2.0f * (yz - wx);
+    m[8] = 2.0f * (xz - wy);
+    m[9] = 2.0f * (yz + wx);
+    m[10] = 1.0f - 2.0f * (xx + yy);
+}
+
+void quatToAxisAngle(const Quat& q, float* axis, float* angle) {
+    Quat n = quatNormalize(q);
+    if (n.w < 0.0f) {
+        n.x = -n.x; n.y = -n.y; n.z = -n.z; n.w = -n.w;
+    }
+    float s = sqrt(1.0f - n.w * n.w);
+    *angle = 2.0f * acos(n.w > 1.0f ? 1.0f : n.w);
+    if (s < 1e-6f) {
+        axis[0] = 1.0f; axis[1] = 0.0f; axis[2] = 0.0f;
+    } else {
+        axis[0] = n.x / s; axis[1] = n.y / s; axis[2] = n.z / s;
+    }
+}
+
+void OrientationAnimation::begin(const Quat& current, const Quat& target, double now, double seconds) {
+    from = current;
+    to = target;
+    start = now;
+    duration = seconds;
+}
+
+Quat OrientationAnimation::sample(double now) const {
+    if (duration <= 0.0 || now >= start + duration) return to;
+    float t = (float)((now - start) / duration);
+    if (t < 0.0f) t = 0.0f;
+    t = t * t * (3.0f - 2.0f * t); // smoothstep
+    return quatSlerp(from, to, t);
+}
@@ -0,0 +1,39 @@
+#ifndef QUATERNION_H
+#define QUATERNION_H
+
+// Unit quaternion for orientations. Four packed floats, 16-byte aligned, so
+// arrays of them map directly onto SIMD registers.
+struct alignas(16) Quat {
+    float x, y, z, w;
+};
+
+Quat quatIdentity();
+// Rotation of `angle` radians about the (not necessarily normalized) axis
+Quat quatFromAxisAngle(float ax, float ay, float az, float angle);
+// Same rotation as rotateZMatrix * rotateYMatrix * rotateXMatrix (radians)
+Quat quatFromEuler(float x, float y, float z);
+// a * b: rotate by b first, then by a
+Quat quatMultiply(const Quat& a, const Quat& b);
+Quat quatNormalize(const Quat& q);
+float quatDot(const Quat& a, const Quat& b);
+// Normalized linear interpolation along the shorter arc
+Quat quatNlerp(const Quat& a, const Quat& b, float t);
+// Spherical linear interpolation along the shorter arc
+Quat quatSlerp(const Quat& a, const Quat& b, float t);
+// Writes the rotation into the upper-left 3x3 block of a row-major 4x4 matrix
+void quatToMatrix3(const Quat& q, float* matrix);
+// Angle in radians and unit axis (x axis for the identity)
+void quatToAxisAngle(const Quat& q, float* axis, float* angle);
+
+// Timed transition between two orientations, eased at both ends
+struct OrientationAnimation {
+    Quat from, to;
+    double start;
+    double duration; // seconds
+
+    void begin(const Quat& current, const Quat& target, double now, double seconds);
+    bool active(double now) const { return now < start + duration; }
+    Quat sample(double now) const;
+};
+
+#endif
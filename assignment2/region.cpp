@@ -0,0 +1,284 @@
+#include "region.h"
+#include <algorithm>
+#include <iostream>
+
+RegionTree::RegionTree() : layoutWidth(0), layoutHeight(0), framebufferObjectsSupported(false) {
+    regions.push_back(Region());
+}
+
+void RegionTree::init() {
+    framebufferObjectsSupported = GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object;
+}
+
+void RegionTree::destroy() {
+    for (auto& r : regions) {
+        if (r.fbo) glDeleteFramebuffers(1, &r.fbo);
+        if (r.texture) glDeleteTextures(1, &r.texture);
+        r.fbo = r.texture = 0;
+        r.textureWidth = r.textureHeight = 0;
+        r.dirty = true;
+    }
+}
+
+int RegionTree::addRegion(int parent, const RegionRect& rect) {
+    int id = (int)regions.size();
+    regions.push_back(Region());
+    regions[id].rect = rect;
+    regions[id].parent = parent;
+    regions[parent].children.push_back(id);
+    regions[parent].indexDirty = true;
+    markDirty(parent);
+    layoutWidth = layoutHeight = 0; // force layout
+    return id;
+}
+
+void RegionTree::setRect(int id, const RegionRect& rect) {
+    regions[id].rect = rect;
+    if (regions[id].parent >= 0) {
+        regions[regions[id].parent].indexDirty = true;
+        markDirty(regions[id].parent);
+    }
+    layoutWidth = layoutHeight = 0;
+}
+
+void RegionTree::setClearColor(int id, float r, float g, float b) {
+    Region& region = regions[id];
+    region.clearColor[0] = r;
+    region.clearColor[1] = g;
+    region.clearColor[2] = b;
+    markDirty(id);
+}
+
+void RegionTree::markDirty(int id) {
+    // Cached ancestors hold a copy of this region in their texture
+    for (; id >= 0; id = regions[id].parent) {
+        regions[id].dirty = true;
+    }
+}
+
+void RegionTree::computeViewport(int id) {
+    Region& r = regions[id];
+    if (r.parent < 0) return;
+
+    const int* pv = regions[r.parent].viewport;
+    int left = pv[0] + (int)((r.rect.left + 1.0f) * 0.5f * pv[2] + 0.5f);
+    int right = pv[0] + (int)((r.rect.right + 1.0f) * 0.5f * pv[2] + 0.5f);
+    int bottom = pv[1] + (int)((r.rect.bottom + 1.0f) * 0.5f * pv[3] + 0.5f);
+    int top = pv[1] + (int)((r.rect.top + 1.0f) * 0.5f * pv[3] + 0.5f);
+    r.viewport[0] = left;
+    r.viewport[1] = bottom;
+    r.viewport[2] = right - left;
+    r.viewport[3] = top - bottom;
+}
+
+void RegionTree::layout(int fbWidth, int fbHeight) {
+    for (auto& r : regions) {
+        if (r.indexDirty) buildIndex(r);
+    }
+    if (fbWidth == layoutWidth && fbHeight == layoutHeight) return;
+
+    regions[0].viewport[0] = 0;
+    regions[0].viewport[1] = 0;
+    regions[0].viewport[2] = fbWidth;
+    regions[0].viewport[3] = fbHeight;
+
+    // Parents are always created before their children
+    for (int id = 1; id < (int)regions.size(); id++) computeViewport(id);
+
+    layoutWidth = fbWidth;
+    layoutHeight = fbHeight;
+}
+
+void RegionTree::buildIndex(Region& r) {
+    r.slabEdges.clear();
+    r.slabStart.clear();
+    r.slabEntries.clear();
+    r.indexDirty = false;
+    if (r.children.empty()) return;
+
+    for (int child : r.children) {
+        r.slabEdges.push_back(regions[child].rect.left);
+        r.slabEdges.push_back(regions[child].rect.right);
+    }
+    std::sort(r.slabEdges.begin(), r.slabEdges.end());
+    r.slabEdges.erase(std::unique(r.slabEdges.begin(), r.slabEdges.end()), r.slabEdges.end());
+
+    for (size_t s = 0; s + 1 < r.slabEdges.size(); s++) {
+        size_t first = r.slabEntries.size();
+        r.slabStart.push_back((int)first);
+        for (int child : r.children) {
+            const RegionRect& c = regions[child].rect;
+            if (c.left <= r.slabEdges[s] && c.right >= r.slabEdges[s + 1]) {
+                Region::SlabEntry entry = {c.bottom, c.top, child};
+                r.slabEntries.push_back(entry);
+            }
+        }
+        std::sort(r.slabEntries.begin() + first, r.slabEntries.end(),
+                  [](const Region::SlabEntry& a, const Region::SlabEntry& b) { return a.bottom < b.bottom; });
+    }
+    r.slabStart.push_back((int)r.slabEntries.size());
+}
+
+int RegionTree::childAt(const Region& r, float x, float y) const {
+    if (r.slabEdges.size() < 2) return -1;
+
+    // Slab containing x (the right-most edge belongs to the last slab)
+    int slab = (int)(std::upper_bound(r.slabEdges.begin(), r.slabEdges.end(), x) - r.slabEdges.begin()) - 1;
+    if (slab == (int)r.slabEdges.size() - 1 && x == r.slabEdges.back()) slab--;
+    if (slab < 0 || slab >= (int)r.slabEdges.size() - 1) return -1;
+
+    // Child in that slab with the highest bottom edge not above y
+    const Region::SlabEntry* begin = r.slabEntries.data() + r.slabStart[slab];
+    const Region::SlabEntry* end = r.slabEntries.data() + r.slabStart[slab + 1];
+    const Region::SlabEntry* it = std::upper_bound(begin, end, y,
+        [](float value, const Region::SlabEntry& e) { return value < e.bottom; });
+    if (it == begin) return -1;
+    --it;
+    return y <= it->top ? it->child : -1;
+}
+
+int RegionTree::regionAt(double pixelX, double pixelY) const {
+    const int* v = regions[0].viewport;
+    if (pixelX < v[0] || pixelX > v[0] + v[2] || pixelY < v[1] || pixelY > v[1] + v[3]) return -1;
+
+    int id = 0;
+    for (;;) {
+        const Region& r = regions[id];
+        if (r.viewport[2] <= 0 || r.viewport[3] <= 0) return id;
+        float x = (float)((pixelX - r.viewport[0]) / r.viewport[2] * 2.0 - 1.0);
+        float y = (float)((pixelY - r.viewport[1]) / r.viewport[3] * 2.0 - 1.0);
+        int child = childAt(r, x, y);
+        if (child < 0) return id;
+        id = child;
+    }
+}
+
+bool RegionTree::dispatchMouseButton(double pixelX, double pixelY, int button) {
+    for (int id = regionAt(pixelX, pixelY); id >= 0; id = regions[id].parent) {
+        const Region& r = regions[id];
+        if (!r.onMouseButton || r.viewport[2] <= 0 || r.viewport[3] <= 0) continue;
+
+        // Pixel to the region's projection coordinates
+        float x = r.projection[0] + (float)((pixelX - r.viewport[0]) / r.viewport[2]) * (r.projection[1] - r.projection[0]);
+        float y = r.projection[2] + (float)((pixelY - r.viewport[1]) / r.viewport[3]) * (r.projection[3] - r.projection[2]);
+        if (r.onMouseButton(button, x, y)) return true;
+    }
+    return false;
+}
+
+bool RegionTree::ensureTarget(Region& r) {
+    if (!framebufferObjectsSupported) return false;
+    int width = r.viewport[2], height = r.viewport[3];
+    if (width <= 0 || height <= 0) return false;
+    if (r.fbo && r.textureWidth == width && r.textureHeight == height) return true;
+
+    if (!r.fbo) {
+        glGenFramebuffers(1, &r.fbo);
+        glGenTextures(1, &r.texture);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, r.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GLint previous = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+    glBindFramebuffer(GL_FRAMEBUFFER, r.fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, r.texture, 0);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, previous);
+
+    if (!complete) {
+        std::cerr << "Region framebuffer incomplete, drawing it directly" << std::endl;
+        glDeleteFramebuffers(1, &r.fbo);
+        glDeleteTextures(1, &r.texture);
+        r.fbo = r.texture = 0;
+        r.cached = false;
+        return false;
+    }
+
+    r.textureWidth = width;
+    r.textureHeight = height;
+    r.dirty = true;
+    return true;
+}
+
+void RegionTree::render() {
+    glEnable(GL_SCISSOR_TEST);
+    renderRegion(0, 0, 0);
+    glDisable(GL_SCISSOR_TEST);
+    glViewport(0, 0, layoutWidth, layoutHeight);
+}
+
+// originX/Y: pixel position of the current render target inside the window
+void RegionTree::renderRegion(int id, int originX, int originY) {
+    Region& r = regions[id];
+    if (r.viewport[2] <= 0 || r.viewport[3] <= 0) return;
+
+    if (r.cached && ensureTarget(r)) {
+        // Re-render the cached contents only when the region changed
+        if (r.dirty) {
+            GLint previous = 0;
+            glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+            glBindFramebuffer(GL_FRAMEBUFFER, r.fbo);
+            drawContents(id, r.viewport[0], r.viewport[1]);
+            glBindFramebuffer(GL_FRAMEBUFFER, previous);
+            r.dirty = false;
+        }
+        composite(r, originX, originY);
+    } else {
+        drawContents(id, originX, originY);
+        r.dirty = false;
+    }
+}
+
+void RegionTree::drawContents(int id, int originX, int originY) {
+    const Region& r = regions[id];
+    int x = r.viewport[0] - originX, y = r.viewport[1] - originY;
+    glViewport(x, y, r.viewport[2], r.viewport[3]);
+    glScissor(x, y, r.viewport[2], r.viewport[3]);
+
+    if (r.clear) {
+        glClearColor(r.clearColor[0], r.clearColor[1], r.clearColor[2], r.clearColor[3]);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glOrtho(r.projection[0], r.projection[1], r.projection[2], r.projection[3], -1, 1);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+
+    for (const auto& draw : r.drawList) draw();
+
+    for (int child : r.children) renderRegion(child, originX, originY);
+}
+
+// Draws the cached texture of a region with a single quad
+void RegionTree::composite(const Region& r, int originX, int originY) {
+    int x = r.viewport[0] - originX, y = r.viewport[1] - originY;
+    glViewport(x, y, r.viewport[2], r.viewport[3]);
+    glScissor(x, y, r.viewport[2], r.viewport[3]);
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glOrtho(-1, 1, -1, 1, -1, 1);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, r.texture);
+    glColor3f(1.0f, 1.0f, 1.0f);
+    glBegin(GL_QUADS);
+    glTexCoord2f(0.0f, 0.0f); glVertex2f(-1.0f, -1.0f);
+    glTexCoord2f(1.0f, 0.0f); glVertex2f(1.0f, -1.0f);
+    glTexCoord2f(1.0f, 1.0f); glVertex2f(1.0f, 1.0f);
+    glTexCoord2f(0.0f, 1.0f); glVertex2f(-1.0f, 1.0f);
+    glEnd();
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDisable(GL_TEXTURE_2D);
+}
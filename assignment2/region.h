@@ -0,0 +1,98 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include <GL/glew.h>
+#include <functional>
+#include <vector>
+
+// Rectangle in the [-1, 1] coordinates of the parent region
+struct RegionRect {
+    float left, bottom, right, top;
+};
+
+// One rectangular panel of a window: own viewport, projection, clear color,
+// draw list and mouse handler. Children are drawn on top of their parent and
+// must not overlap each other.
+struct Region {
+    typedef std::function<void()> DrawFunc;
+    // x, y are in the region's projection coordinates; return true if handled
+    typedef std::function<bool(int button, float x, float y)> MouseFunc;
+
+    RegionRect rect = {-1.0f, -1.0f, 1.0f, 1.0f};
+    float projection[4] = {-1.0f, 1.0f, -1.0f, 1.0f}; // ortho left, right, bottom, top
+    float clearColor[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+    bool clear = true;   // clear the viewport before drawing
+    bool cached = false; // render into a texture, redraw only when dirty
+    std::vector<DrawFunc> drawList;
+    MouseFunc onMouseButton;
+
+    int parent = -1;
+    std::vector<int> children;
+
+    // Computed by RegionTree::layout()
+    int viewport[4] = {0, 0, 0, 0}; // x, y, width, height in framebuffer pixels
+
+    // Render-to-texture cache
+    GLuint fbo = 0;
+    GLuint texture = 0;
+    int textureWidth = 0, textureHeight = 0;
+    bool dirty = true;
+
+    // Point lookup over children: sorted x edges of the children, and for each
+    // slab between two edges the children covering it, sorted by bottom edge.
+    struct SlabEntry {
+        float bottom, top;
+        int child;
+    };
+    std::vector<float> slabEdges;
+    std::vector<int> slabStart; // slabEdges.size() entries, offsets into slabEntries
+    std::vector<SlabEntry> slabEntries;
+    bool indexDirty = true;
+};
+
+// Tree of nested regions. Region 0 is the root and covers the whole window.
+class RegionTree {
+public:
+    RegionTree();
+
+    // Checks for framebuffer object support; call with a current GL context
+    void init();
+    // Deletes the GL resources of all regions
+    void destroy();
+
+    int root() const { return 0; }
+    int addRegion(int parent, const RegionRect& rect);
+    Region& region(int id) { return regions[id]; }
+    const Region& region(int id) const { return regions[id]; }
+    int regionCount() const { return (int)regions.size(); }
+
+    void setRect(int id, const RegionRect& rect);
+    void setClearColor(int id, float r, float g, float b);
+    // Contents of a cached region (or one nested in it) changed
+    void markDirty(int id);
+
+    // Computes pixel viewports for a framebuffer of the given size
+    void layout(int fbWidth, int fbHeight);
+    // Deepest region containing the pixel (origin bottom-left), -1 if none
+    int regionAt(double pixelX, double pixelY) const;
+    // Sends a click to the deepest region under the pixel, bubbling up to the
+    // parents until a handler returns true
+    bool dispatchMouseButton(double pixelX, double pixelY, int button);
+
+    void render();
+
+private:
+    std::vector<Region> regions;
+    int layoutWidth, layoutHeight;
+    bool framebufferObjectsSupported;
+
+    void buildIndex(Region& r);
+    int childAt(const Region& r, float x, float y) const;
+    void computeViewport(int id);
+    bool ensureTarget(Region& r);
+    void renderRegion(int id, int originX, int originY);
+    void drawContents(int id, int originX, int originY);
+    void composite(const Region& r, int originX, int originY);
+};
+
+#endif
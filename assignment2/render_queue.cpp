@@ -0,0 +1,174 @@
+#include "render_queue.h"
+#include <algorithm>
+#include <cstring>
+
+const int MATERIAL_SHIFT = 0;
+const int DEPTH_SHIFT = MATERIAL_SHIFT + SORT_MATERIAL_BITS;
+const int VERTEX_ARRAY_SHIFT = DEPTH_SHIFT + SORT_DEPTH_BITS;
+const int PROGRAM_SHIFT = VERTEX_ARRAY_SHIFT + SORT_VERTEX_ARRAY_BITS;
+const int LAYER_SHIFT = PROGRAM_SHIFT + SORT_PROGRAM_BITS;
+static_assert(LAYER_SHIFT + SORT_LAYER_BITS == 64, "sort key fields must fill 64 bits");
+
+static uint64_t field(unsigned value, int bits, int shift) {
+    return (uint64_t)(value & ((1u << bits) - 1)) << shift;
+}
+
+static unsigned extract(uint64_t key, int bits, int shift) {
+    return (unsigned)(key >> shift) & ((1u << bits) - 1);
+}
+
+uint64_t makeSortKey(unsigned layer, unsigned program, unsigned vertexArray, uint32_t depth, unsigned material) {
+    return field(layer, SORT_LAYER_BITS, LAYER_SHIFT) | field(program, SORT_PROGRAM_BITS, PROGRAM_SHIFT) |
+           field(vertexArray, SORT_VERTEX_ARRAY_BITS, VERTEX_ARRAY_SHIFT) |
+           field(depth, SORT_DEPTH_BITS, DEPTH_SHIFT) | field(material, SORT_MATERIAL_BITS, MATERIAL_SHIFT);
+}
+
+unsigned sortKeyLayer(uint64_t key) { return extract(key, SORT_LAYER_BITS, LAYER_SHIFT); }
+unsigned sortKeyProgram(uint64_t key) { return extract(key, SORT_PROGRAM_BITS, PROGRAM_SHIFT); }
+unsigned sortKeyVertexArray(uint64_t key) { return extract(key, SORT_VERTEX_ARRAY_BITS, VERTEX_ARRAY_SHIFT); }
+unsigned sortKeyMaterial(uint64_t key) { return extract(key, SORT_MATERIAL_BITS, MATERIAL_SHIFT); }
+
+uint32_t depthSortBits(float depth) {
+    const uint32_t maxDepth = (1u << SORT_DEPTH_BITS) - 1;
+    if (!(depth > 0.0f)) return 0; // also NaN
+    if (depth >= 1.0f) return maxDepth;
+    return (uint32_t)(depth * maxDepth);
+}
+
+RenderQueue::RenderQueue() : sorted(true) {
+    clear();
+}
+
+void RenderQueue::clear() {
+    drawItems.clear();
+    sorted = true;
+    memset(&counters, 0, sizeof(counters));
+}
+
+void RenderQueue::push(uint64_t key, uint32_t object) {
+    DrawItem item = {key, object};
+    if (!drawItems.empty() && key < drawItems.back().key) sorted = false;
+    drawItems.push_back(item);
+}
+
+DrawItem* RenderQueue::append(size_t count) {
+    size_t size = drawItems.size();
+    drawItems.resize(size + count);
+    sorted = false;
+    return drawItems.data() + size;
+}
+
+// Stable LSD radix sort, one byte per pass. All eight histograms are built in
+// one read of the keys, and passes where every key has the same byte (the
+// unused fields, usually the layer and program) are skipped.
+void RenderQueue::sort() {
+    if (sorted) return;
+    sorted = true;
+    size_t n = drawItems.size();
+
+    // Few items: insertion sort beats eight counting passes (and, unlike
+    // std::stable_sort, needs no temporary buffer from the heap)
+    if (n <= 64) {
+        for (size_t i = 1; i < n; i++) {
+            DrawItem item = drawItems[i];
+            size_t j = i;
+            for (; j > 0 && drawItems[j - 1].key > item.key; j--) drawItems[j] = drawItems[j - 1];
+            drawItems[j] = item;
+        }
+        return;
+    }
+
+    uint32_t counts[8][256];
+    memset(counts, 0, sizeof(counts));
+    for (const DrawItem& item : drawItems) {
+        for (int pass = 0; pass < 8; pass++) counts[pass][(item.key >> (pass * 8)) & 0xff]++;
+    }
+
+    scratch.resize(n);
+    DrawItem* from = drawItems.data();
+    DrawItem* to = scratch.data();
+    for (int pass = 0; pass < 8; pass++) {
+        int shift = pass * 8;
+        uint32_t* count = counts[pass];
+        if (count[(from[0].key >> shift) & 0xff] == n) continue;
+
+        uint32_t offset = 0;
+        for (int b = 0; b < 256; b++) {
+            uint32_t c = count[b];
+            count[b] = offset;
+            offset += c;
+        }
+        for (size_t i = 0; i < n; i++) to[count[(from[i].key >> shift) & 0xff]++] = from[i];
+        std::swap(from, to);
+    }
+    if (from != drawItems.data()) drawItems.swap(scratch);
+}
+
+void RenderQueue::submit(RenderSubmitter& submitter) {
+    sort();
+    submitRange(drawItems.data(), drawItems.data() + drawItems.size(), submitter, counters);
+}
+
+void RenderQueue::submitLayer(unsigned layer, RenderSubmitter& submitter) {
+    size_t begin, end;
+    layerRange(layer, &begin, &end);
+    submitRange(drawItems.data() + begin, drawItems.data() + end, submitter, counters);
+}
+
+void RenderQueue::layerRange(unsigned layer, size_t* begin, size_t* end) {
+    sort();
+    // The layer is the top field, so its draws are one contiguous range
+    const DrawItem* first = drawItems.data();
+    const DrawItem* last = first + drawItems.size();
+    auto layerBelow = [](const DrawItem& item, unsigned l) { return sortKeyLayer(item.key) < l; };
+    const DrawItem* layerBegin = std::lower_bound(first, last, layer, layerBelow);
+    *begin = layerBegin - first;
+    *end = std::lower_bound(layerBegin, last, layer + 1, layerBelow) - first;
+}
+
+void RenderQueue::submitItems(size_t begin, size_t end, RenderSubmitter& submitter, RenderQueueStats& stats) const {
+    submitRange(drawItems.data() + begin, drawItems.data() + end, submitter, stats);
+}
+
+void RenderQueue::addStats(const RenderQueueStats& stats) {
+    counters.draws += stats.draws;
+    counters.runs += stats.runs;
+    counters.programBinds += stats.programBinds;
+    counters.vertexArrayBinds += stats.vertexArrayBinds;
+    counters.materialBinds += stats.materialBinds;
+}
+
+void RenderQueue::submitRange(const DrawItem* begin, const DrawItem* end, RenderSubmitter& submitter,
+                              RenderQueueStats& stats) {
+    bool first = true;
+    unsigned program = 0, vertexArray = 0, material = 0;
+    const DrawItem* run = begin;
+    while (run != end) {
+        unsigned p = sortKeyProgram(run->key), v = sortKeyVertexArray(run->key), m = sortKeyMaterial(run->key);
+        if (first || p != program) {
+            submitter.bindProgram(p);
+            stats.programBinds++;
+        }
+        if (first || v != vertexArray) {
+            submitter.bindVertexArray(v);
+            stats.vertexArrayBinds++;
+        }
+        if (first || m != material) {
+            submitter.bindMaterial(m);
+            stats.materialBinds++;
+        }
+        first = false;
+        program = p;
+        vertexArray = v;
+        material = m;
+
+        // The run ends where any field but the depth changes
+        const uint64_t stateMask = ~field(~0u, SORT_DEPTH_BITS, DEPTH_SHIFT);
+        const DrawItem* runEnd = run + 1;
+        while (runEnd != end && (runEnd->key & stateMask) == (run->key & stateMask)) runEnd++;
+        submitter.draw(run, runEnd - run);
+        stats.draws += runEnd - run;
+        stats.runs++;
+        run = runEnd;
+    }
+}
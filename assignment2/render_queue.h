@@ -0,0 +1,97 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 64-bit draw sort key, most significant field first:
+//   layer (4) | program (10) | vertex array (12) | depth (24) | material (14)
+// Sorting by the key groups draws by layer, then by the state that is most
+// expensive to change; depth orders the draws sharing a mesh front to back.
+// Program, vertex array and material are small ids chosen by the demo, not
+// GL object names.
+const int SORT_LAYER_BITS = 4;
+const int SORT_PROGRAM_BITS = 10;
+const int SORT_VERTEX_ARRAY_BITS = 12;
+const int SORT_DEPTH_BITS = 24;
+const int SORT_MATERIAL_BITS = 14;
+
+uint64_t makeSortKey(unsigned layer, unsigned program, unsigned vertexArray, uint32_t depth, unsigned material);
+unsigned sortKeyLayer(uint64_t key);
+unsigned sortKeyProgram(uint64_t key);
+unsigned sortKeyVertexArray(uint64_t key);
+unsigned sortKeyMaterial(uint64_t key);
+// Depth field for a depth in [0, 1] (clamped), 0 being nearest
+uint32_t depthSortBits(float depth);
+
+// One draw: its key and whatever the demo needs to issue it (an entity, a node)
+struct DrawItem {
+    uint64_t key;
+    uint32_t object;
+};
+
+// State changes made by submit() since the last clear()
+struct RenderQueueStats {
+    size_t draws;
+    size_t runs; // draw() calls
+    size_t programBinds;
+    size_t vertexArrayBinds;
+    size_t materialBinds;
+};
+
+// Receives the sorted draws. Each bind is only called when its field differs
+// from the previous run's (and for the first run of every submit, as other
+// code may have changed the state in between).
+class RenderSubmitter {
+public:
+    virtual ~RenderSubmitter() {}
+    virtual void bindProgram(unsigned program) = 0;
+    virtual void bindVertexArray(unsigned vertexArray) = 0;
+    virtual void bindMaterial(unsigned material) = 0;
+    // Consecutive items with the same layer, program, vertex array and material
+    virtual void draw(const DrawItem* items, size_t count) = 0;
+};
+
+// Per-frame list of draws: pushed in any order, radix-sorted by key, then
+// submitted with redundant state changes left out. Items with equal keys keep
+// their push order, so 2D overlap among identical draws is preserved. The
+// buffers are reused, so after the first frames nothing is allocated.
+class RenderQueue {
+public:
+    RenderQueue();
+
+    void clear();
+    void push(uint64_t key, uint32_t object);
+    // Adds count items for the caller to fill, e.g. disjoint parts from several threads
+    DrawItem* append(size_t count);
+    size_t size() const { return drawItems.size(); }
+    const DrawItem* items() const { return drawItems.data(); }
+
+    void sort();
+    // Sorts if needed and submits everything, or only the draws of one layer
+    void submit(RenderSubmitter& submitter);
+    void submitLayer(unsigned layer, RenderSubmitter& submitter);
+
+    // For splitting a submit across threads: the range of a layer's items in
+    // the sorted queue, and submitting part of it. The state is bound anew at
+    // the start of every part, and changes are counted into stats rather than
+    // the queue's own, so parts may be submitted concurrently; addStats() sums
+    // them up afterwards.
+    void layerRange(unsigned layer, size_t* begin, size_t* end);
+    void submitItems(size_t begin, size_t end, RenderSubmitter& submitter, RenderQueueStats& stats) const;
+    void addStats(const RenderQueueStats& stats);
+
+    const RenderQueueStats& stats() const { return counters; }
+
+private:
+    std::vector<DrawItem> drawItems;
+    std::vector<DrawItem> scratch;
+    bool sorted;
+    RenderQueueStats counters;
+
+    static void submitRange(const DrawItem* begin, const DrawItem* end, RenderSubmitter& submitter,
+                            RenderQueueStats& stats);
+};
+
+#endif
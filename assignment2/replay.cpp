@@ -0,0 +1,279 @@
+#include "replay.h"
+#include "logger.h"
+#include <cstring>
+#include <thread>
+
+static const char REPLAY_MAGIC[4] = {'G', 'L', 'I', 'R'};
+static const uint8_t REPLAY_VERSION = 1;
+static const size_t REPLAY_HEADER_SIZE = 12;
+static const size_t WRITE_BUFFER_SIZE = 64 * 1024;
+
+ReplaySession::ReplaySession()
+    : mode(LIVE), readPos(0), file(nullptr), randomSeed(0), timeBase(0.0), started(false),
+      lastTime(0), frames(0), realTime(false) {
+}
+
+ReplaySession::~ReplaySession() {
+    close();
+}
+
+bool ReplaySession::startRecording(const char* path, uint32_t seed) {
+    close();
+    file = fopen(path, "wb");
+    if (!file) {
+        logError("Cannot create recording %s", path);
+        return false;
+    }
+
+    mode = RECORD;
+    randomSeed = seed;
+    data.clear();
+    data.reserve(WRITE_BUFFER_SIZE);
+    data.insert(data.end(), REPLAY_MAGIC, REPLAY_MAGIC + 4);
+    writeByte(REPLAY_VERSION);
+    writeByte(0);
+    writeByte(0);
+    writeByte(0);
+    for (int i = 0; i < 4; i++) writeByte((uint8_t)(seed >> (8 * i)));
+    logInfo("Recording input to %s", path);
+    return true;
+}
+
+bool ReplaySession::startReplay(const char* path, bool realTimePlayback) {
+    close();
+    FILE* in = fopen(path, "rb");
+    if (!in) {
+        logError("Cannot open recording %s", path);
+        return false;
+    }
+    data.clear();
+    uint8_t chunk[4096];
+    size_t count;
+    while ((count = fread(chunk, 1, sizeof(chunk), in)) > 0) data.insert(data.end(), chunk, chunk + count);
+    fclose(in);
+
+    if (data.size() < REPLAY_HEADER_SIZE || memcmp(data.data(), REPLAY_MAGIC, 4) != 0 ||
+        data[4] != REPLAY_VERSION) {
+        logError("%s is not a version %d input recording", path, (int)REPLAY_VERSION);
+        data.clear();
+        return false;
+    }
+
+    mode = REPLAY;
+    randomSeed = 0;
+    for (int i = 0; i < 4; i++) randomSeed |= (uint32_t)data[8 + i] << (8 * i);
+    readPos = REPLAY_HEADER_SIZE;
+    realTime = realTimePlayback;
+    logInfo("Replaying input from %s%s", path, realTime ? "" : " at maximum speed");
+    return true;
+}
+
+void ReplaySession::close() {
+    if (mode == RECORD) {
+        flushBuffer();
+        fclose(file);
+        file = nullptr;
+        logInfo("Recorded %u frames", frames);
+    }
+    mode = LIVE;
+    data.clear();
+    readPos = 0;
+    started = false;
+    lastTime = 0;
+    frames = 0;
+}
+
+uint64_t ReplaySession::toMicroseconds(double time) {
+    double relative = time - timeBase;
+    uint64_t t = relative > 0.0 ? (uint64_t)(relative * 1e6 + 0.5) : 0;
+    // Records are stored as deltas, so time never goes backwards
+    return t < lastTime ? lastTime : t;
+}
+
+bool ReplaySession::beginFrame(double now, double* frameTime) {
+    if (mode == LIVE) {
+        *frameTime = now;
+        return true;
+    }
+    if (!started) {
+        started = true;
+        timeBase = now;
+        wallStart = std::chrono::steady_clock::now();
+    }
+
+    if (mode == RECORD) {
+        uint64_t t = toMicroseconds(now);
+        writeRecord(REPLAY_FRAME, t);
+        frames++;
+        *frameTime = t / 1e6;
+        return true;
+    }
+
+    // Events the previous frame did not consume are dropped
+    ReplayEvent event;
+    while (readRecord(event)) {
+        if (event.type != REPLAY_FRAME) continue;
+        frames++;
+        *frameTime = event.time;
+        if (realTime) {
+            std::chrono::duration<double> target(event.time);
+            std::this_thread::sleep_until(wallStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(target));
+        }
+        return true;
+    }
+    return false;
+}
+
+double ReplaySession::recordKey(int window, int key, int action, int mods, double time) {
+    if (mode != RECORD || !started) return time;
+    uint64_t t = toMicroseconds(time);
+    writeRecord(REPLAY_KEY, t);
+    writeByte((uint8_t)window);
+    writeVarint((uint32_t)key);
+    writeByte((uint8_t)action);
+    writeByte((uint8_t)mods);
+    return t / 1e6;
+}
+
+double ReplaySession::recordMouseButton(int window, int button, int action, float x, float y, double time) {
+    if (mode != RECORD || !started) return time;
+    uint64_t t = toMicroseconds(time);
+    writeRecord(REPLAY_MOUSE_BUTTON, t);
+    writeByte((uint8_t)window);
+    writeByte((uint8_t)button);
+    writeByte((uint8_t)action);
+    writeFloat(x);
+    writeFloat(y);
+    return t / 1e6;
+}
+
+void ReplaySession::recordMenuChoice(int menu, int option) {
+    if (mode != RECORD || !started) return;
+    writeRecord(REPLAY_MENU_CHOICE, lastTime);
+    writeByte((uint8_t)menu);
+    writeVarint((uint32_t)option);
+}
+
+bool ReplaySession::nextEvent(ReplayEvent& event) {
+    if (mode != REPLAY) return false;
+    ReplayEventType type;
+    while (peekType(&type) && type != REPLAY_FRAME) {
+        if (!readRecord(event)) return false;
+        // A menu choice without the click that opened it is skipped
+        if (event.type != REPLAY_MENU_CHOICE) return true;
+    }
+    return false;
+}
+
+bool ReplaySession::nextMenuChoice(int menu, int& option) {
+    ReplayEventType type;
+    if (mode != REPLAY || !peekType(&type) || type != REPLAY_MENU_CHOICE) return false;
+    ReplayEvent event;
+    if (!readRecord(event) || event.code != menu) return false;
+    option = event.action;
+    return true;
+}
+
+void ReplaySession::logSummary() const {
+    if (frames == 0) return;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    logInfo("%s %u frames in %.3f s (%.3f ms/frame, %.1f fps)", mode == REPLAY ? "Replayed" : "Ran",
+            frames, seconds, seconds * 1000.0 / frames, frames / seconds);
+}
+
+void ReplaySession::writeRecord(ReplayEventType type, uint64_t time) {
+    writeByte((uint8_t)type);
+    writeVarint(time - lastTime);
+    lastTime = time;
+}
+
+void ReplaySession::writeByte(uint8_t value) {
+    data.push_back(value);
+    if (data.size() >= WRITE_BUFFER_SIZE) flushBuffer();
+}
+
+void ReplaySession::writeVarint(uint64_t value) {
+    // LEB128: 7 bits per byte, high bit set on all but the last byte
+    while (value >= 0x80) {
+        writeByte((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    writeByte((uint8_t)value);
+}
+
+void ReplaySession::writeFloat(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    for (int i = 0; i < 4; i++) writeByte((uint8_t)(bits >> (8 * i)));
+}
+
+void ReplaySession::flushBuffer() {
+    if (file && !data.empty()) fwrite(data.data(), 1, data.size(), file);
+    data.clear();
+}
+
+bool ReplaySession::peekType(ReplayEventType* type) const {
+    if (readPos >= data.size()) return false;
+    *type = (ReplayEventType)data[readPos];
+    return true;
+}
+
+bool ReplaySession::readRecord(ReplayEvent& event) {
+    size_t pos = readPos;
+    size_t size = data.size();
+    auto readVarint = [&](uint64_t& value) {
+        value = 0;
+        for (int shift = 0; pos < size && shift < 64; shift += 7) {
+            uint8_t b = data[pos++];
+            value |= (uint64_t)(b & 0x7f) << shift;
+            if (!(b & 0x80)) return true;
+        }
+        return false;
+    };
+
+    if (pos >= size) return false;
+    memset(&event, 0, sizeof(event));
+    event.type = (ReplayEventType)data[pos++];
+    uint64_t delta, value;
+    if (!readVarint(delta)) return false;
+
+    switch (event.type) {
+        case REPLAY_FRAME:
+            break;
+        case REPLAY_KEY:
+            if (pos + 1 > size) return false;
+            event.window = data[pos++];
+            if (!readVarint(value) || pos + 2 > size) return false;
+            event.code = (int)value;
+            event.action = data[pos++];
+            event.mods = data[pos++];
+            break;
+        case REPLAY_MOUSE_BUTTON: {
+            if (pos + 11 > size) return false;
+            event.window = data[pos++];
+            event.code = data[pos++];
+            event.action = data[pos++];
+            uint32_t bits[2] = {0, 0};
+            for (int f = 0; f < 2; f++) {
+                for (int i = 0; i < 4; i++) bits[f] |= (uint32_t)data[pos++] << (8 * i);
+            }
+            memcpy(&event.x, &bits[0], sizeof(float));
+            memcpy(&event.y, &bits[1], sizeof(float));
+            break;
+        }
+        case REPLAY_MENU_CHOICE:
+            if (pos + 1 > size) return false;
+            event.code = data[pos++];
+            if (!readVarint(value)) return false;
+            event.action = (int)(uint32_t)value;
+            break;
+        default:
+            logError("Corrupt input recording at byte %u", (unsigned)readPos);
+            return false;
+    }
+
+    lastTime += delta;
+    event.time = lastTime / 1e6;
+    readPos = pos;
+    return true;
+}
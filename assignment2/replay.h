@@ -0,0 +1,89 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+enum ReplayEventType { REPLAY_FRAME, REPLAY_KEY, REPLAY_MOUSE_BUTTON, REPLAY_MENU_CHOICE };
+
+// One recorded input. Times are seconds since the recording started.
+struct ReplayEvent {
+    ReplayEventType type;
+    double time;
+    int window; // demo-specific window index
+    int code;   // key, mouse button or menu id
+    int action; // GLFW_PRESS / GLFW_RELEASE, or the chosen menu option
+    int mods;
+    float x, y; // mouse position in framebuffer pixels
+};
+
+// Records the input of a session into a compact binary file, or plays such a
+// file back. Every frame starts with beginFrame(), which in replay returns the
+// recorded frame time, so everything driven by that clock (input repeat,
+// animations) runs exactly as it did while recording.
+//
+// File layout: "GLIR", version byte, 3 reserved bytes, random seed (uint32 LE),
+// then records of a type byte, the time since the previous record in
+// microseconds (LEB128) and a type-specific payload.
+class ReplaySession {
+public:
+    ReplaySession();
+    ~ReplaySession();
+
+    bool startRecording(const char* path, uint32_t seed);
+    // realTime: wait until each recorded frame time has passed
+    bool startReplay(const char* path, bool realTime);
+    void close();
+
+    bool recording() const { return mode == RECORD; }
+    bool replaying() const { return mode == REPLAY; }
+    uint32_t seed() const { return randomSeed; }
+    unsigned frameCount() const { return frames; }
+
+    // Returns the time the frame runs at: `now` when live, `now` quantized to
+    // the file resolution when recording, the recorded time when replaying.
+    // False once a replay has run out of frames.
+    bool beginFrame(double now, double* frameTime);
+
+    // Recording; the key and mouse calls return the quantized event time
+    double recordKey(int window, int key, int action, int mods, double time);
+    double recordMouseButton(int window, int button, int action, float x, float y, double time);
+    void recordMenuChoice(int menu, int option);
+
+    // Replay: next input event of the current frame, false at the end of the frame
+    bool nextEvent(ReplayEvent& event);
+    // Replay: the option chosen in a menu opened by the event just returned
+    bool nextMenuChoice(int menu, int& option);
+
+    // Frames played back and wall time, for benchmark runs
+    void logSummary() const;
+
+private:
+    enum Mode { LIVE, RECORD, REPLAY };
+
+    Mode mode;
+    std::vector<uint8_t> data; // write buffer or the whole replay file
+    size_t readPos;
+    FILE* file;                // open while recording
+    uint32_t randomSeed;
+    double timeBase;           // `now` of the first recorded frame
+    bool started;
+    uint64_t lastTime;         // microseconds, time of the previous record
+    unsigned frames;
+    bool realTime;
+    std::chrono::steady_clock::time_point wallStart;
+
+    uint64_t toMicroseconds(double time);
+    void writeRecord(ReplayEventType type, uint64_t time);
+    void writeByte(uint8_t value);
+    void writeVarint(uint64_t value);
+    void writeFloat(float value);
+    void flushBuffer();
+    bool readRecord(ReplayEvent& event);
+    bool peekType(ReplayEventType* type) const;
+};
+
+#endif
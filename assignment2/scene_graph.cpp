@@ -0,0 +1,207 @@
+#include "scene_graph.h"
+#include "jobs.h"
+#include "matrix.h"
+#include <algorithm>
+#include <cmath>
+
+const float DEG_TO_RAD = 3.14159265358979323846f / 180.0f;
+
+void composeTransform(float* m, const float* t, const Quat& r, const float* s) {
+    // Rotation block from the quaternion, columns scaled by s
+    quatToMatrix3(r, m);
+    m[0] *= s[0]; m[1] *= s[1]; m[2] *= s[2];
+    m[4] *= s[0]; m[5] *= s[1]; m[6] *= s[2];
+    m[8] *= s[0]; m[9] *= s[1]; m[10] *= s[2];
+    m[3] = t[0];
+    m[7] = t[1];
+    m[11] = t[2];
+    m[12] = 0.0f;
+    m[13] = 0.0f;
+    m[14] = 0.0f;
+    m[15] = 1.0f;
+}
+
+// Below this many dirty nodes, splitting the update into jobs costs more than it saves
+const int PARALLEL_UPDATE_MIN_NODES = 4096;
+
+SceneGraph::SceneGraph()
+    : dirtyBegin(0), dirtyEnd(0), lastChangedBegin(0), lastChangedEnd(0), parentNodesValid(false) {
+}
+
+int SceneGraph::createNode(int parentHandle) {
+    SceneNode n;
+    n.parent = parentHandle >= 0 ? handleToIndex[parentHandle] : -1;
+    n.handle = (int)handleToIndex.size();
+    n.translation[0] = n.translation[1] = n.translation[2] = 0.0f;
+    n.rotation = quatIdentity();
+    n.scale[0] = n.scale[1] = n.scale[2] = 1.0f;
+    identityMatrix(n.world);
+    n.dirty = true;
+
+    // The new node goes right after its parent's current subtree
+    int pos = n.parent >= 0 ? nodes[n.parent].subtreeEnd : (int)nodes.size();
+    n.subtreeEnd = pos + 1;
+    nodes.insert(nodes.begin() + pos, n);
+    handleToIndex.push_back(pos);
+    parentNodesValid = false;
+
+    // Fix up the nodes that moved one slot to the right
+    for (int i = pos + 1; i < (int)nodes.size(); i++) {
+        SceneNode& moved = nodes[i];
+        if (moved.parent >= pos) moved.parent++;
+        moved.subtreeEnd++;
+        handleToIndex[moved.handle] = i;
+    }
+    for (int ancestor = n.parent; ancestor >= 0; ancestor = nodes[ancestor].parent) {
+        nodes[ancestor].subtreeEnd++;
+    }
+
+    if (pos < (int)nodes.size() - 1) {
+        // Insertion in the middle shifts the pending dirty range; just rescan everything
+        dirtyBegin = 0;
+        dirtyEnd = (int)nodes.size();
+    } else {
+        if (dirtyBegin == dirtyEnd) dirtyBegin = pos;
+        dirtyBegin = std::min(dirtyBegin, pos);
+        dirtyEnd = (int)nodes.size();
+    }
+    return n.handle;
+}
+
+void SceneGraph::reserve(size_t count) {
+    nodes.reserve(nodes.size() + count);
+    handleToIndex.reserve(handleToIndex.size() + count);
+    worldChanged.reserve(nodes.size() + count);
+}
+
+void SceneGraph::clear() {
+    nodes.clear();
+    handleToIndex.clear();
+    parentNodes.clear();
+    parentNodesValid = false;
+    dirtyBegin = dirtyEnd = 0;
+    lastChangedBegin = lastChangedEnd = 0;
+}
+
+void SceneGraph::markDirty(int handle) {
+    int index = handleToIndex[handle];
+    SceneNode& n = nodes[index];
+    n.dirty = true;
+    if (dirtyBegin == dirtyEnd) {
+        dirtyBegin = index;
+        dirtyEnd = n.subtreeEnd;
+    } else {
+        dirtyBegin = std::min(dirtyBegin, index);
+        dirtyEnd = std::max(dirtyEnd, n.subtreeEnd);
+    }
+}
+
+void SceneGraph::setTranslation(int handle, float x, float y, float z) {
+    SceneNode& n = node(handle);
+    n.translation[0] = x;
+    n.translation[1] = y;
+    n.translation[2] = z;
+    markDirty(handle);
+}
+
+void SceneGraph::setRotation(int handle, const Quat& rotation) {
+    node(handle).rotation = rotation;
+    markDirty(handle);
+}
+
+void SceneGraph::setRotationEuler(int handle, float x, float y, float z) {
+    setRotation(handle, quatFromEuler(x * DEG_TO_RAD, y * DEG_TO_RAD, z * DEG_TO_RAD));
+}
+
+void SceneGraph::setRotation(int handle, const Quat& rotation, SceneDirtyRange& range) {
+    SceneNode& n = node(handle);
+    n.rotation = rotation;
+    n.dirty = true;
+    int index = handleToIndex[handle];
+    range.begin = std::min(range.begin, index);
+    range.end = std::max(range.end, n.subtreeEnd);
+}
+
+void SceneGraph::setScale(int handle, float x, float y, float z, SceneDirtyRange& range) {
+    SceneNode& n = node(handle);
+    n.scale[0] = x;
+    n.scale[1] = y;
+    n.scale[2] = z;
+    n.dirty = true;
+    int index = handleToIndex[handle];
+    range.begin = std::min(range.begin, index);
+    range.end = std::max(range.end, n.subtreeEnd);
+}
+
+void SceneGraph::markDirty(const SceneDirtyRange& range) {
+    if (range.begin >= range.end) return;
+    if (dirtyBegin == dirtyEnd) {
+        dirtyBegin = range.begin;
+        dirtyEnd = range.end;
+    } else {
+        dirtyBegin = std::min(dirtyBegin, range.begin);
+        dirtyEnd = std::max(dirtyEnd, range.end);
+    }
+}
+
+void SceneGraph::setScale(int handle, float x, float y, float z) {
+    SceneNode& n = node(handle);
+    n.scale[0] = x;
+    n.scale[1] = y;
+    n.scale[2] = z;
+    markDirty(handle);
+}
+
+void SceneGraph::updateNode(int i) {
+    SceneNode& n = nodes[i];
+    bool parentChanged = n.parent >= dirtyBegin && worldChanged[n.parent];
+    if (!n.dirty && !parentChanged) {
+        worldChanged[i] = 0;
+        return;
+    }
+
+    if (n.parent >= 0) {
+        float local[16];
+        composeTransform(local, n.translation, n.rotation, n.scale);
+        multiplyMatrix(n.world, nodes[n.parent].world, local);
+    } else {
+        composeTransform(n.world, n.translation, n.rotation, n.scale);
+    }
+    n.dirty = false;
+    worldChanged[i] = 1;
+}
+
+void SceneGraph::updateWorld(JobSystem* jobs) {
+    lastChangedBegin = dirtyBegin;
+    lastChangedEnd = dirtyEnd;
+    if (dirtyBegin == dirtyEnd) return;
+
+    // Nodes outside [dirtyBegin, dirtyEnd) are neither dirty nor below a dirty node
+    worldChanged.resize(nodes.size());
+    if (!jobs || jobs->threadCount() == 1 || dirtyEnd - dirtyBegin < PARALLEL_UPDATE_MIN_NODES) {
+        for (int i = dirtyBegin; i < dirtyEnd; i++) updateNode(i);
+        dirtyBegin = dirtyEnd = 0;
+        return;
+    }
+
+    if (!parentNodesValid) {
+        parentNodes.clear();
+        for (int i = 0; i < (int)nodes.size(); i++) {
+            if (nodes[i].subtreeEnd > i + 1) parentNodes.push_back(i);
+        }
+        parentNodesValid = true;
+    }
+
+    // Parents in depth-first order, so every parent's world matrix is final
+    // before any of its children (usually few nodes, e.g. one per window)
+    auto first = std::lower_bound(parentNodes.begin(), parentNodes.end(), dirtyBegin);
+    for (auto it = first; it != parentNodes.end() && *it < dirtyEnd; ++it) updateNode(*it);
+
+    // Leaves only depend on their parent, so they can all go in parallel
+    jobs->parallelFor(dirtyBegin, dirtyEnd, 1024, [this](size_t begin, size_t end) {
+        for (int i = (int)begin; i < (int)end; i++) {
+            if (nodes[i].subtreeEnd == i + 1) updateNode(i);
+        }
+    });
+    dirtyBegin = dirtyEnd = 0;
+}
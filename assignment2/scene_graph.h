@@ -0,0 +1,120 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+#include "jobs.h"
+#include "quaternion.h"
+
+// Node of a scene graph. Local transform is translation * rotation * scale.
+struct SceneNode {
+    int parent;          // index of the parent node, -1 for top-level nodes
+    int subtreeEnd;      // one past the index of the last descendant
+    int handle;
+    Quat rotation;
+    float translation[3];
+    float scale[3];
+    float world[16];     // cached world matrix (row-major, see matrix.h)
+    bool dirty;          // local transform changed since the last updateWorld()
+};
+
+// Index range of nodes changed by a parallel system, see the setters below
+struct SceneDirtyRange {
+    int begin = INT_MAX;
+    int end = 0;
+};
+
+// Scene graph stored as one flat array in depth-first order: every node is
+// followed by its whole subtree, so updateWorld() is a single forward pass in
+// which parents are always finished before their children. Only dirty nodes
+// and their descendants are recomputed. Nodes are addressed by handles, which
+// stay valid when insertions move nodes around in the array.
+class SceneGraph {
+public:
+    SceneGraph();
+
+    // Adds a node under parentHandle (-1 for a top-level node); returns its handle
+    int createNode(int parentHandle = -1);
+    // Makes room for `count` more nodes
+    void reserve(size_t count);
+    void clear();
+
+    void setTranslation(int handle, float x, float y, float z);
+    void setRotation(int handle, const Quat& rotation);
+    // Euler angles in degrees, applied X -> Y -> Z like the cube demo
+    void setRotationEuler(int handle, float x, float y, float z);
+    void setScale(int handle, float x, float y, float z);
+
+    // Setters for parallel systems: they only write the node itself, so threads
+    // may change different nodes at once. The touched nodes are collected in
+    // `range` and handed to markDirty() afterwards on one thread.
+    void setRotation(int handle, const Quat& rotation, SceneDirtyRange& range);
+    void setScale(int handle, float x, float y, float z, SceneDirtyRange& range);
+    void markDirty(const SceneDirtyRange& range);
+
+    const float* translation(int handle) const { return node(handle).translation; }
+    const Quat& rotation(int handle) const { return node(handle).rotation; }
+    const float* scale(int handle) const { return node(handle).scale; }
+    const float* worldMatrix(int handle) const { return node(handle).world; }
+
+    // Recomputes the world matrices of dirty subtrees. With a job system, nodes
+    // that have children are done first in order, then all leaves in parallel.
+    void updateWorld(JobSystem* jobs = nullptr);
+
+    // Nodes whose world matrix the last updateWorld() recomputed: the indices
+    // in [changedBegin(), changedEnd()) for which worldChangedAt() is true
+    int changedBegin() const { return lastChangedBegin; }
+    int changedEnd() const { return lastChangedEnd; }
+    bool worldChangedAt(int index) const { return worldChanged[index] != 0; }
+
+    // Depth-first traversal
+    int nodeCount() const { return (int)nodes.size(); }
+    const SceneNode& nodeAt(int index) const { return nodes[index]; }
+    int indexOf(int handle) const { return handleToIndex[handle]; }
+
+private:
+    std::vector<SceneNode> nodes;
+    std::vector<int> handleToIndex;
+    std::vector<char> worldChanged;
+    int dirtyBegin, dirtyEnd; // index range that may contain dirty nodes
+    int lastChangedBegin, lastChangedEnd; // the range the last updateWorld() went through
+    std::vector<int> parentNodes; // indices of nodes with children, in order
+    bool parentNodesValid;
+
+    SceneNode& node(int handle) { return nodes[handleToIndex[handle]]; }
+    const SceneNode& node(int handle) const { return nodes[handleToIndex[handle]]; }
+    void markDirty(int handle);
+    void updateNode(int index);
+};
+
+// Calls update(begin, end, range) over [0, count), which changes nodes with the
+// range setters above. With a job system the chunks (at least minChunk items)
+// run in parallel, each collecting its own range; they are merged under a lock.
+// The nodes in the merged range are then marked dirty.
+template <typename Func>
+void parallelUpdateDirty(SceneGraph& scene, JobSystem* jobs, size_t count, size_t minChunk, const Func& update) {
+    if (!jobs) {
+        SceneDirtyRange dirty;
+        update((size_t)0, count, dirty);
+        scene.markDirty(dirty);
+        return;
+    }
+    SceneDirtyRange merged;
+    std::mutex mergeMutex;
+    jobs->parallelFor(0, count, minChunk, [&](size_t begin, size_t end) {
+        SceneDirtyRange dirty;
+        update(begin, end, dirty);
+        std::lock_guard<std::mutex> lock(mergeMutex);
+        merged.begin = std::min(merged.begin, dirty.begin);
+        merged.end = std::max(merged.end, dirty.end);
+    });
+    scene.markDirty(merged);
+}
+
+// Builds translation * rotation * scale
+void composeTransform(float* matrix, const float* translation, const Quat& rotation, const float* scale);
+
+#endif
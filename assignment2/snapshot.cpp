@@ -0,0 +1,177 @@
+#include "snapshot.h"
+#include "logger.h"
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char SNAPSHOT_MAGIC[4] = {'G', 'L', 'S', 'S'};
+
+static uint64_t alignUp(uint64_t offset) {
+    return (offset + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+}
+
+void SnapshotWriter::addColumn(uint32_t id, const void* data, size_t elementBytes, size_t count) {
+    Pending pending;
+    pending.column.id = id;
+    pending.column.elementBytes = (uint32_t)elementBytes;
+    pending.column.count = count;
+    pending.column.offset = 0;
+    pending.data = data;
+    columns.push_back(pending);
+}
+
+bool SnapshotWriter::write(const char* path) const {
+    // Header and column table first, with the offsets the data will land at
+    std::vector<char> head(sizeof(SnapshotHeader) + columns.size() * sizeof(SnapshotColumn));
+    SnapshotColumn* table = (SnapshotColumn*)(head.data() + sizeof(SnapshotHeader));
+    uint64_t offset = head.size();
+    for (size_t i = 0; i < columns.size(); i++) {
+        table[i] = columns[i].column;
+        table[i].offset = alignUp(offset);
+        offset = table[i].offset + table[i].count * table[i].elementBytes;
+    }
+    SnapshotHeader* header = (SnapshotHeader*)head.data();
+    memcpy(header->magic, SNAPSHOT_MAGIC, 4);
+    header->version = SNAPSHOT_VERSION;
+    header->kind = kind;
+    header->columnCount = (uint32_t)columns.size();
+    header->fileBytes = offset;
+
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        logError("Cannot create snapshot %s", path);
+        return false;
+    }
+    static const char padding[SNAPSHOT_ALIGNMENT] = {};
+    bool ok = fwrite(head.data(), 1, head.size(), file) == head.size();
+    uint64_t written = head.size();
+    for (size_t i = 0; i < columns.size() && ok; i++) {
+        size_t pad = (size_t)(table[i].offset - written);
+        size_t bytes = (size_t)(table[i].count * table[i].elementBytes);
+        ok = fwrite(padding, 1, pad, file) == pad && fwrite(columns[i].data, 1, bytes, file) == bytes;
+        written = table[i].offset + bytes;
+    }
+    if (fclose(file) != 0) ok = false;
+    if (!ok) logError("Cannot write snapshot %s", path);
+    return ok;
+}
+
+SnapshotFile::SnapshotFile() : mapping(nullptr), size(0) {
+#ifdef _WIN32
+    fileHandle = INVALID_HANDLE_VALUE;
+    mappingHandle = nullptr;
+#endif
+}
+
+SnapshotFile::~SnapshotFile() {
+    close();
+}
+
+bool SnapshotFile::open(const char* path, uint32_t kind) {
+    close();
+#ifdef _WIN32
+    fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER fileSize;
+    if (fileHandle == INVALID_HANDLE_VALUE || !GetFileSizeEx(fileHandle, &fileSize)) {
+        logError("Cannot open snapshot %s", path);
+        close();
+        return false;
+    }
+    size = (size_t)fileSize.QuadPart;
+    if (size >= sizeof(SnapshotHeader)) {
+        mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mappingHandle) mapping = (const char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    }
+#else
+    int fd = ::open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        logError("Cannot open snapshot %s", path);
+        if (fd >= 0) ::close(fd);
+        return false;
+    }
+    size = (size_t)info.st_size;
+    if (size >= sizeof(SnapshotHeader)) {
+        void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view != MAP_FAILED) mapping = (const char*)view;
+    }
+    ::close(fd); // the mapping keeps the file
+#endif
+    if (!mapping) {
+        logError("Cannot map snapshot %s", path);
+        close();
+        return false;
+    }
+
+    const SnapshotHeader* header = (const SnapshotHeader*)mapping;
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, 4) != 0 || header->version != SNAPSHOT_VERSION) {
+        logError("%s is not a version %u snapshot", path, SNAPSHOT_VERSION);
+        close();
+        return false;
+    }
+    if (header->kind != kind) {
+        logError("%s is a snapshot of another demo", path);
+        close();
+        return false;
+    }
+    if (header->fileBytes != size ||
+        header->columnCount > (size - sizeof(SnapshotHeader)) / sizeof(SnapshotColumn)) {
+        logError("Snapshot %s is truncated", path);
+        close();
+        return false;
+    }
+
+    // Offsets to pointers, checking that every column lies inside the file
+    const SnapshotColumn* table = (const SnapshotColumn*)(mapping + sizeof(SnapshotHeader));
+    columns.resize(header->columnCount);
+    for (uint32_t i = 0; i < header->columnCount; i++) {
+        const SnapshotColumn& entry = table[i];
+        if (entry.elementBytes == 0 || entry.offset % SNAPSHOT_ALIGNMENT != 0 || entry.offset > size ||
+            entry.count > (size - entry.offset) / entry.elementBytes) {
+            logError("Snapshot %s has a damaged column table", path);
+            close();
+            return false;
+        }
+        columns[i].id = entry.id;
+        columns[i].elementBytes = entry.elementBytes;
+        columns[i].count = (size_t)entry.count;
+        columns[i].data = mapping + entry.offset;
+    }
+    return true;
+}
+
+void SnapshotFile::close() {
+#ifdef _WIN32
+    if (mapping) UnmapViewOfFile(mapping);
+    if (mappingHandle) CloseHandle(mappingHandle);
+    if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+    mappingHandle = nullptr;
+    fileHandle = INVALID_HANDLE_VALUE;
+#else
+    if (mapping) munmap((void*)mapping, size);
+#endif
+    mapping = nullptr;
+    size = 0;
+    columns.clear();
+}
+
+const void* SnapshotFile::column(uint32_t id, size_t elementBytes, size_t& count) const {
+    for (const Column& c : columns) {
+        if (c.id == id && c.elementBytes == elementBytes) {
+            count = c.count;
+            return c.data;
+        }
+    }
+    count = 0;
+    return nullptr;
+}
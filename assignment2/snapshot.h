@@ -0,0 +1,101 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+// Demo state saved as columns: arrays of fixed-size records laid out in the
+// file exactly as in memory, so saving is one write per column and loading
+// maps the file and points into it, with nothing to parse.
+//
+// File layout (little-endian): a SnapshotHeader, columnCount SnapshotColumn
+// entries, then the column data, each column starting at a multiple of
+// SNAPSHOT_ALIGNMENT from the start of the file. A demo reads the columns it
+// knows by id and skips the others, so new columns only need a new id; a
+// changed record layout needs a new id or SNAPSHOT_VERSION.
+const uint32_t SNAPSHOT_VERSION = 1;
+const size_t SNAPSHOT_ALIGNMENT = 64;
+
+struct SnapshotHeader {
+    char magic[4];        // "GLSS"
+    uint32_t version;     // SNAPSHOT_VERSION
+    uint32_t kind;        // which demo wrote it, chosen by the demo
+    uint32_t columnCount;
+    uint64_t fileBytes;   // whole file, to catch truncation
+};
+
+struct SnapshotColumn {
+    uint32_t id;
+    uint32_t elementBytes;
+    uint64_t count;
+    uint64_t offset; // from the start of the file
+};
+
+// Collects columns and writes them in one go. The data is not copied and
+// must stay valid until write().
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(uint32_t kind) : kind(kind) {}
+
+    void addColumn(uint32_t id, const void* data, size_t elementBytes, size_t count);
+    template <typename T> void addColumn(uint32_t id, const T* data, size_t count) {
+        static_assert(std::is_trivially_copyable<T>::value, "snapshot columns hold plain records");
+        addColumn(id, data, sizeof(T), count);
+    }
+
+    bool write(const char* path) const;
+
+private:
+    struct Pending {
+        SnapshotColumn column;
+        const void* data;
+    };
+
+    uint32_t kind;
+    std::vector<Pending> columns;
+};
+
+// A snapshot file mapped read-only into memory (mmap, or a file mapping on
+// Windows). Opening checks the header and the column table and turns the
+// column offsets into pointers into the mapping; column() then only looks
+// them up. The pointers stay valid until close().
+class SnapshotFile {
+public:
+    SnapshotFile();
+    ~SnapshotFile();
+    SnapshotFile(const SnapshotFile&) = delete;
+    SnapshotFile& operator=(const SnapshotFile&) = delete;
+
+    // Fails (with a log message) on a missing or damaged file, another
+    // version, or a snapshot of another kind
+    bool open(const char* path, uint32_t kind);
+    void close();
+    size_t fileBytes() const { return size; }
+
+    // nullptr and count 0 when the column is missing or its records have another size
+    const void* column(uint32_t id, size_t elementBytes, size_t& count) const;
+    template <typename T> const T* column(uint32_t id, size_t& count) const {
+        static_assert(std::is_trivially_copyable<T>::value, "snapshot columns hold plain records");
+        return (const T*)column(id, sizeof(T), count);
+    }
+
+private:
+    struct Column {
+        uint32_t id;
+        uint32_t elementBytes;
+        size_t count;
+        const void* data;
+    };
+
+    const char* mapping;
+    size_t size;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#endif
+    std::vector<Column> columns;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#include "soft_present.h"
+#include "logger.h"
+#include "soft_raster.h"
+
+SoftPresenter::SoftPresenter() : useBlit(false), texture(0), fbo(0), textureWidth(0), textureHeight(0) {
+}
+
+void SoftPresenter::init() {
+    useBlit = GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object;
+    if (!useBlit) {
+        logInfo("Framebuffer blits not supported, software frames are shown with glDrawPixels");
+        return;
+    }
+    glGenTextures(1, &texture);
+    glGenFramebuffers(1, &fbo);
+}
+
+void SoftPresenter::destroy() {
+    if (fbo) glDeleteFramebuffers(1, &fbo);
+    if (texture) glDeleteTextures(1, &texture);
+    fbo = texture = 0;
+    textureWidth = textureHeight = 0;
+}
+
+void SoftPresenter::present(const SoftRasterizer& image, int fbWidth, int fbHeight) {
+    int width = image.width(), height = image.height();
+    if (width <= 0 || height <= 0) return;
+
+    glDisable(GL_SCISSOR_TEST);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, image.rowPitch());
+
+    if (!useBlit) {
+        glViewport(0, 0, fbWidth, fbHeight);
+        glWindowPos2i(0, 0);
+        glPixelZoom((float)fbWidth / width, (float)fbHeight / height);
+        glDrawPixels(width, height, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels());
+        glPixelZoom(1.0f, 1.0f);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        return;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+    if (width != textureWidth || height != textureHeight) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        textureWidth = width;
+        textureHeight = height;
+
+        GLint previous = 0;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, previous);
+    }
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, fbWidth, fbHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
@@ -0,0 +1,27 @@
+#ifndef SOFT_PRESENT_H
+#define SOFT_PRESENT_H
+
+#include <GL/glew.h>
+
+class SoftRasterizer;
+
+// Shows a software-rendered image in a GL window: the pixels go into a
+// texture that is blitted to the default framebuffer, or through
+// glDrawPixels on old compatibility contexts without framebuffer objects.
+class SoftPresenter {
+public:
+    SoftPresenter();
+
+    // Needs the window's GL context to be current, as do the other calls
+    void init();
+    void destroy();
+    // Stretches the image over a framebuffer of the given size
+    void present(const SoftRasterizer& image, int fbWidth, int fbHeight);
+
+private:
+    bool useBlit;
+    GLuint texture, fbo;
+    int textureWidth, textureHeight;
+};
+
+#endif
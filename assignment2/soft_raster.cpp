@@ -0,0 +1,427 @@
+#include "soft_raster.h"
+#include "jobs.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOFT_RASTER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Vertices closer to the eye plane than this are clipped away, so the divide by w stays finite
+static const float MIN_CLIP_W = 1e-5f;
+
+static uint32_t packColor(float r, float g, float b, float a) {
+    auto channel = [](float v) { return (uint32_t)(std::min(std::max(v, 0.0f), 1.0f) * 255.0f + 0.5f); };
+    return channel(r) | channel(g) << 8 | channel(b) << 16 | channel(a) << 24;
+}
+
+SoftRasterizer::SoftRasterizer()
+    : fbWidth(0), fbHeight(0), pitch(0), scissorEnabled(false), depthTest(false),
+      clearValue(packColor(0.0f, 0.0f, 0.0f, 1.0f)), tilesX(0), tilesY(0) {
+    viewport[0] = viewport[1] = viewport[2] = viewport[3] = 0;
+    scissor.minX = scissor.minY = 0;
+    scissor.maxX = scissor.maxY = -1;
+    for (int i = 0; i < 16; i++) transform[i] = i % 5 == 0 ? 1.0f : 0.0f;
+}
+
+void SoftRasterizer::resize(int width, int height) {
+    width = std::max(width, 0);
+    height = std::max(height, 0);
+    // The viewport follows the size, as for a freshly created GL context
+    setViewport(0, 0, width, height);
+    if (width == fbWidth && height == fbHeight) return;
+
+    // Rows are padded to whole groups of four pixels for the SIMD loops
+    fbWidth = width;
+    fbHeight = height;
+    pitch = (width + 3) & ~3;
+    color.assign((size_t)pitch * height, packColor(0.0f, 0.0f, 0.0f, 1.0f));
+    depthBuffer.assign((size_t)pitch * height, 1.0f);
+
+    tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    bins.resize((size_t)tilesX * tilesY);
+    for (std::vector<uint32_t>& bin : bins) bin.clear();
+    triangles.clear();
+    clears.clear();
+}
+
+void SoftRasterizer::readPixels(uint8_t* rgba) const {
+    for (int y = 0; y < fbHeight; y++) {
+        memcpy(rgba + (size_t)y * fbWidth * 4, color.data() + (size_t)y * pitch, (size_t)fbWidth * 4);
+    }
+}
+
+void SoftRasterizer::setViewport(int x, int y, int width, int height) {
+    viewport[0] = x;
+    viewport[1] = y;
+    viewport[2] = width;
+    viewport[3] = height;
+}
+
+void SoftRasterizer::setScissor(int x, int y, int width, int height) {
+    scissor.minX = x;
+    scissor.minY = y;
+    scissor.maxX = x + width - 1;
+    scissor.maxY = y + height - 1;
+    scissorEnabled = true;
+}
+
+void SoftRasterizer::disableScissor() {
+    scissorEnabled = false;
+}
+
+void SoftRasterizer::setClearColor(float r, float g, float b, float a) {
+    clearValue = packColor(r, g, b, a);
+}
+
+void SoftRasterizer::setTransform(const float* matrix) {
+    memcpy(transform, matrix, sizeof(transform));
+}
+
+// Pixels a draw may touch: viewport, scissor and image intersected
+SoftRasterizer::Rect SoftRasterizer::clipRect() const {
+    Rect r = {std::max(viewport[0], 0), std::max(viewport[1], 0),
+              std::min(viewport[0] + viewport[2], fbWidth) - 1, std::min(viewport[1] + viewport[3], fbHeight) - 1};
+    if (scissorEnabled) {
+        r.minX = std::max(r.minX, scissor.minX);
+        r.minY = std::max(r.minY, scissor.minY);
+        r.maxX = std::min(r.maxX, scissor.maxX);
+        r.maxY = std::min(r.maxY, scissor.maxY);
+    }
+    return r;
+}
+
+void SoftRasterizer::clear(bool clearColor, bool clearDepth) {
+    if (!clearColor && !clearDepth) return;
+    Rect bounds = {0, 0, fbWidth - 1, fbHeight - 1};
+    if (scissorEnabled) {
+        bounds.minX = std::max(bounds.minX, scissor.minX);
+        bounds.minY = std::max(bounds.minY, scissor.minY);
+        bounds.maxX = std::min(bounds.maxX, scissor.maxX);
+        bounds.maxY = std::min(bounds.maxY, scissor.maxY);
+    }
+    if (bounds.minX > bounds.maxX || bounds.minY > bounds.maxY) return;
+
+    Clear c = {bounds, clearValue, clearColor, clearDepth};
+    clears.push_back(c);
+    binCommand(bounds, (uint32_t)(clears.size() - 1) * 2 + 1, nullptr);
+}
+
+void SoftRasterizer::loadVertex(const float* vertex, const SoftVertexFormat& format, ClipVertex& out) const {
+    float x = vertex[0], y = vertex[1], z = format.positionSize > 2 ? vertex[2] : 0.0f;
+    const float* m = transform;
+    out.x = m[0] * x + m[1] * y + m[2] * z + m[3];
+    out.y = m[4] * x + m[5] * y + m[6] * z + m[7];
+    out.z = m[8] * x + m[9] * y + m[10] * z + m[11];
+    out.w = m[12] * x + m[13] * y + m[14] * z + m[15];
+    const float* c = vertex + format.colorOffset;
+    out.r = c[0];
+    out.g = c[1];
+    out.b = c[2];
+}
+
+void SoftRasterizer::drawTriangles(const float* vertices, const SoftVertexFormat& format, size_t vertexCount) {
+    Rect clip = clipRect();
+    if (clip.minX > clip.maxX || clip.minY > clip.maxY) return;
+    ClipVertex v[3];
+    for (size_t i = 0; i + 2 < vertexCount; i += 3) {
+        for (int k = 0; k < 3; k++) loadVertex(vertices + (i + k) * format.stride, format, v[k]);
+        clipAndSubmit(v, clip);
+    }
+}
+
+void SoftRasterizer::drawIndexedTriangles(const float* vertices, const SoftVertexFormat& format,
+                                          const unsigned* indices, size_t indexCount) {
+    Rect clip = clipRect();
+    if (clip.minX > clip.maxX || clip.minY > clip.maxY) return;
+    ClipVertex v[3];
+    for (size_t i = 0; i + 2 < indexCount; i += 3) {
+        for (int k = 0; k < 3; k++) loadVertex(vertices + (size_t)indices[i + k] * format.stride, format, v[k]);
+        clipAndSubmit(v, clip);
+    }
+}
+
+void SoftRasterizer::drawTriangleFan(const float* vertices, const SoftVertexFormat& format, size_t vertexCount) {
+    Rect clip = clipRect();
+    if (vertexCount < 3 || clip.minX > clip.maxX || clip.minY > clip.maxY) return;
+    ClipVertex v[3];
+    loadVertex(vertices, format, v[0]);
+    loadVertex(vertices + format.stride, format, v[2]);
+    for (size_t i = 2; i < vertexCount; i++) {
+        v[1] = v[2];
+        loadVertex(vertices + i * format.stride, format, v[2]);
+        clipAndSubmit(v, clip);
+    }
+}
+
+// Distance of a clip-space vertex inside the near (0), far (1) and w (2) planes
+static float planeDistance(const float* v, int plane) {
+    // v points at x, y, z, w
+    switch (plane) {
+        case 0: return v[2] + v[3];
+        case 1: return v[3] - v[2];
+        default: return v[3] - MIN_CLIP_W;
+    }
+}
+
+void SoftRasterizer::clipAndSubmit(const ClipVertex* v, const Rect& clip) {
+    bool inside = true;
+    for (int i = 0; i < 3 && inside; i++) {
+        for (int plane = 0; plane < 3; plane++) inside = inside && planeDistance(&v[i].x, plane) >= 0.0f;
+    }
+    if (inside) {
+        setupTriangle(v, clip);
+        return;
+    }
+
+    // Sutherland-Hodgman against the depth range and w > 0; x and y need no
+    // clipping, the rasterizer only visits pixels inside the clip rectangle
+    polygon.assign(v, v + 3);
+    for (int plane = 0; plane < 3 && polygon.size() >= 3; plane++) {
+        clipScratch.clear();
+        for (size_t i = 0; i < polygon.size(); i++) {
+            const ClipVertex& a = polygon[i];
+            const ClipVertex& b = polygon[(i + 1) % polygon.size()];
+            float da = planeDistance(&a.x, plane), db = planeDistance(&b.x, plane);
+            if (da >= 0.0f) clipScratch.push_back(a);
+            if ((da >= 0.0f) != (db >= 0.0f)) {
+                float t = da / (da - db);
+                ClipVertex p;
+                p.x = a.x + (b.x - a.x) * t;
+                p.y = a.y + (b.y - a.y) * t;
+                p.z = a.z + (b.z - a.z) * t;
+                p.w = a.w + (b.w - a.w) * t;
+                p.r = a.r + (b.r - a.r) * t;
+                p.g = a.g + (b.g - a.g) * t;
+                p.b = a.b + (b.b - a.b) * t;
+                clipScratch.push_back(p);
+            }
+        }
+        polygon.swap(clipScratch);
+    }
+    for (size_t i = 2; i < polygon.size(); i++) {
+        ClipVertex fan[3] = {polygon[0], polygon[i - 1], polygon[i]};
+        setupTriangle(fan, clip);
+    }
+}
+
+void SoftRasterizer::setupTriangle(const ClipVertex* v, const Rect& clip) {
+    // Window coordinates; depth maps [-1, 1] to [0, 1] as in GL
+    float x[3], y[3], z[3], rgb[3][3];
+    for (int i = 0; i < 3; i++) {
+        float invW = 1.0f / v[i].w;
+        x[i] = viewport[0] + (v[i].x * invW * 0.5f + 0.5f) * viewport[2];
+        y[i] = viewport[1] + (v[i].y * invW * 0.5f + 0.5f) * viewport[3];
+        z[i] = v[i].z * invW * 0.5f + 0.5f;
+        rgb[0][i] = v[i].r * 255.0f;
+        rgb[1][i] = v[i].g * 255.0f;
+        rgb[2][i] = v[i].b * 255.0f;
+    }
+
+    double area = ((double)x[1] - x[0]) * ((double)y[2] - y[0]) - ((double)x[2] - x[0]) * ((double)y[1] - y[0]);
+    if (!(area != 0.0) || !std::isfinite(area)) return;
+    if (area < 0.0) {
+        // Both windings are drawn; make it counter-clockwise so inside is positive
+        std::swap(x[1], x[2]);
+        std::swap(y[1], y[2]);
+        std::swap(z[1], z[2]);
+        for (int c = 0; c < 3; c++) std::swap(rgb[c][1], rgb[c][2]);
+        area = -area;
+    }
+
+    Triangle t;
+    t.bounds.minX = std::max(clip.minX, (int)std::floor(std::min(std::min(x[0], x[1]), x[2])));
+    t.bounds.minY = std::max(clip.minY, (int)std::floor(std::min(std::min(y[0], y[1]), y[2])));
+    t.bounds.maxX = std::min(clip.maxX, (int)std::ceil(std::max(std::max(x[0], x[1]), x[2])) - 1);
+    t.bounds.maxY = std::min(clip.maxY, (int)std::ceil(std::max(std::max(y[0], y[1]), y[2])) - 1);
+    if (t.bounds.minX > t.bounds.maxX || t.bounds.minY > t.bounds.maxY) return;
+
+    // Edge i runs from vertex i + 1 to i + 2. A shared edge comes out exactly
+    // negated in the neighbouring triangle, so with the ownership rule every
+    // pixel center on it is drawn once.
+    for (int i = 0; i < 3; i++) {
+        int a = (i + 1) % 3, b = (i + 2) % 3;
+        t.edgeA[i] = y[a] - y[b];
+        t.edgeB[i] = x[b] - x[a];
+        t.edgeC[i] = x[a] * y[b] - x[b] * y[a];
+        t.edgeOwned[i] = t.edgeA[i] > 0.0f || (t.edgeA[i] == 0.0f && t.edgeB[i] > 0.0f);
+    }
+
+    auto plane = [&](const float* value, float* out) {
+        double d1 = (double)value[1] - value[0], d2 = (double)value[2] - value[0];
+        double a = (d1 * ((double)y[2] - y[0]) - d2 * ((double)y[1] - y[0])) / area;
+        double b = (d2 * ((double)x[1] - x[0]) - d1 * ((double)x[2] - x[0])) / area;
+        out[0] = (float)a;
+        out[1] = (float)b;
+        out[2] = (float)(value[0] - a * x[0] - b * y[0]);
+    };
+    plane(z, t.depth);
+    plane(rgb[0], t.red);
+    plane(rgb[1], t.green);
+    plane(rgb[2], t.blue);
+    t.depthTest = depthTest;
+
+    triangles.push_back(t);
+    binCommand(t.bounds, (uint32_t)(triangles.size() - 1) * 2, &triangles.back());
+}
+
+void SoftRasterizer::binCommand(const Rect& bounds, uint32_t command, const Triangle* triangle) {
+    int tx0 = bounds.minX / TILE_SIZE, tx1 = bounds.maxX / TILE_SIZE;
+    int ty0 = bounds.minY / TILE_SIZE, ty1 = bounds.maxY / TILE_SIZE;
+    for (int ty = ty0; ty <= ty1; ty++) {
+        for (int tx = tx0; tx <= tx1; tx++) {
+            if (triangle) {
+                // Skip tiles entirely outside one edge: the edge is largest at a corner
+                float x0 = std::max(tx * TILE_SIZE, bounds.minX) + 0.5f;
+                float x1 = std::min(tx * TILE_SIZE + TILE_SIZE - 1, bounds.maxX) + 0.5f;
+                float y0 = std::max(ty * TILE_SIZE, bounds.minY) + 0.5f;
+                float y1 = std::min(ty * TILE_SIZE + TILE_SIZE - 1, bounds.maxY) + 0.5f;
+                bool outside = false;
+                for (int i = 0; i < 3 && !outside; i++) {
+                    float a = triangle->edgeA[i], b = triangle->edgeB[i], c = triangle->edgeC[i];
+                    float best = std::max(a * x0, a * x1) + std::max(b * y0, b * y1) + c;
+                    outside = best < 0.0f;
+                }
+                if (outside) continue;
+            }
+            bins[(size_t)ty * tilesX + tx].push_back(command);
+        }
+    }
+}
+
+void SoftRasterizer::flush(JobSystem* jobs) {
+    if (triangles.empty() && clears.empty()) return;
+    size_t tileCount = bins.size();
+    if (jobs && jobs->threadCount() > 1) {
+        jobs->parallelFor(0, tileCount, 1, [this](size_t begin, size_t end) {
+            for (size_t tile = begin; tile < end; tile++) rasterizeTile((int)tile);
+        });
+    } else {
+        for (size_t tile = 0; tile < tileCount; tile++) rasterizeTile((int)tile);
+    }
+    triangles.clear();
+    clears.clear();
+}
+
+void SoftRasterizer::rasterizeTile(int tile) {
+    std::vector<uint32_t>& bin = bins[tile];
+    if (bin.empty()) return;
+    int tx = tile % tilesX, ty = tile / tilesX;
+    Rect area = {tx * TILE_SIZE, ty * TILE_SIZE, std::min(tx * TILE_SIZE + TILE_SIZE, fbWidth) - 1,
+                 std::min(ty * TILE_SIZE + TILE_SIZE, fbHeight) - 1};
+    for (uint32_t command : bin) {
+        if (command & 1) runClear(clears[command >> 1], area);
+        else runTriangle(triangles[command >> 1], area);
+    }
+    bin.clear();
+}
+
+void SoftRasterizer::runClear(const Clear& c, const Rect& area) {
+    int x0 = std::max(area.minX, c.bounds.minX), x1 = std::min(area.maxX, c.bounds.maxX);
+    int y0 = std::max(area.minY, c.bounds.minY), y1 = std::min(area.maxY, c.bounds.maxY);
+    for (int y = y0; y <= y1; y++) {
+        size_t row = (size_t)y * pitch;
+        if (c.clearColor) std::fill(color.begin() + row + x0, color.begin() + row + x1 + 1, c.color);
+        if (c.clearDepth) std::fill(depthBuffer.begin() + row + x0, depthBuffer.begin() + row + x1 + 1, 1.0f);
+    }
+}
+
+void SoftRasterizer::runTriangle(const Triangle& t, const Rect& area) {
+    int x0 = std::max(area.minX, t.bounds.minX), x1 = std::min(area.maxX, t.bounds.maxX);
+    int y0 = std::max(area.minY, t.bounds.minY), y1 = std::min(area.maxY, t.bounds.maxY);
+    if (x0 > x1 || y0 > y1) return;
+    int groupStart = x0 & ~3;
+
+#if SOFT_RASTER_SSE2
+    const __m128 laneCenters = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 firstCenter = _mm_set1_ps(x0 + 0.5f), lastCenter = _mm_set1_ps(x1 + 0.5f);
+    const __m128 maxChannel = _mm_set1_ps(255.0f);
+    const __m128i alpha = _mm_set1_epi32((int)0xFF000000u);
+    __m128 edgeA[3], owned[3];
+    for (int i = 0; i < 3; i++) {
+        edgeA[i] = _mm_set1_ps(t.edgeA[i]);
+        owned[i] = _mm_castsi128_ps(_mm_set1_epi32(t.edgeOwned[i] ? -1 : 0));
+    }
+    const __m128 depthA = _mm_set1_ps(t.depth[0]), redA = _mm_set1_ps(t.red[0]);
+    const __m128 greenA = _mm_set1_ps(t.green[0]), blueA = _mm_set1_ps(t.blue[0]);
+
+    for (int y = y0; y <= y1; y++) {
+        float cy = y + 0.5f;
+        __m128 rowEdge[3];
+        for (int i = 0; i < 3; i++) rowEdge[i] = _mm_set1_ps(t.edgeB[i] * cy + t.edgeC[i]);
+        __m128 rowDepth = _mm_set1_ps(t.depth[1] * cy + t.depth[2]);
+        __m128 rowRed = _mm_set1_ps(t.red[1] * cy + t.red[2]);
+        __m128 rowGreen = _mm_set1_ps(t.green[1] * cy + t.green[2]);
+        __m128 rowBlue = _mm_set1_ps(t.blue[1] * cy + t.blue[2]);
+        uint32_t* colorRow = color.data() + (size_t)y * pitch;
+        float* depthRow = depthBuffer.data() + (size_t)y * pitch;
+
+        for (int x = groupStart; x <= x1; x += 4) {
+            __m128 cx = _mm_add_ps(_mm_set1_ps((float)x), laneCenters);
+            __m128 mask = _mm_and_ps(_mm_cmpge_ps(cx, firstCenter), _mm_cmple_ps(cx, lastCenter));
+            for (int i = 0; i < 3; i++) {
+                __m128 e = _mm_add_ps(_mm_mul_ps(edgeA[i], cx), rowEdge[i]);
+                __m128 in = _mm_or_ps(_mm_cmpgt_ps(e, zero), _mm_and_ps(_mm_cmpeq_ps(e, zero), owned[i]));
+                mask = _mm_and_ps(mask, in);
+            }
+            if (_mm_movemask_ps(mask) == 0) continue;
+
+            if (t.depthTest) {
+                __m128 z = _mm_add_ps(_mm_mul_ps(depthA, cx), rowDepth);
+                __m128 stored = _mm_loadu_ps(depthRow + x);
+                mask = _mm_and_ps(mask, _mm_cmplt_ps(z, stored));
+                if (_mm_movemask_ps(mask) == 0) continue;
+                _mm_storeu_ps(depthRow + x, _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, stored)));
+            }
+
+            __m128 r = _mm_add_ps(_mm_mul_ps(redA, cx), rowRed);
+            __m128 g = _mm_add_ps(_mm_mul_ps(greenA, cx), rowGreen);
+            __m128 b = _mm_add_ps(_mm_mul_ps(blueA, cx), rowBlue);
+            __m128i ri = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(r, zero), maxChannel));
+            __m128i gi = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(g, zero), maxChannel));
+            __m128i bi = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(b, zero), maxChannel));
+            __m128i pixel = _mm_or_si128(_mm_or_si128(ri, _mm_slli_epi32(gi, 8)),
+                                         _mm_or_si128(_mm_slli_epi32(bi, 16), alpha));
+
+            __m128i* target = (__m128i*)(colorRow + x);
+            __m128i old = _mm_loadu_si128(target);
+            __m128i write = _mm_castps_si128(mask);
+            _mm_storeu_si128(target, _mm_or_si128(_mm_and_si128(write, pixel), _mm_andnot_si128(write, old)));
+        }
+    }
+#else
+    (void)groupStart;
+    auto channel = [](float v) { return (uint32_t)(std::min(std::max(v, 0.0f), 255.0f) + 0.5f); };
+    for (int y = y0; y <= y1; y++) {
+        float cy = y + 0.5f;
+        float rowEdge[3];
+        for (int i = 0; i < 3; i++) rowEdge[i] = t.edgeB[i] * cy + t.edgeC[i];
+        uint32_t* colorRow = color.data() + (size_t)y * pitch;
+        float* depthRow = depthBuffer.data() + (size_t)y * pitch;
+
+        for (int x = x0; x <= x1; x++) {
+            float cx = x + 0.5f;
+            bool inside = true;
+            for (int i = 0; i < 3 && inside; i++) {
+                float e = t.edgeA[i] * cx + rowEdge[i];
+                inside = e > 0.0f || (e == 0.0f && t.edgeOwned[i]);
+            }
+            if (!inside) continue;
+
+            if (t.depthTest) {
+                float z = t.depth[0] * cx + t.depth[1] * cy + t.depth[2];
+                if (!(z < depthRow[x])) continue;
+                depthRow[x] = z;
+            }
+            float r = t.red[0] * cx + t.red[1] * cy + t.red[2];
+            float g = t.green[0] * cx + t.green[1] * cy + t.green[2];
+            float b = t.blue[0] * cx + t.blue[1] * cy + t.blue[2];
+            colorRow[x] = channel(r) | channel(g) << 8 | channel(b) << 16 | 0xFF000000u;
+        }
+    }
+#endif
+}
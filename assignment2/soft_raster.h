@@ -0,0 +1,116 @@
+#ifndef SOFT_RASTER_H
+#define SOFT_RASTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+// Interleaved float vertices: a position of 2 or 3 floats (z = 0 for 2D)
+// followed somewhere by an RGB color in [0, 1]
+struct SoftVertexFormat {
+    int stride;       // floats per vertex
+    int positionSize; // 2 or 3
+    int colorOffset;  // floats from the start of a vertex to its r, g, b
+};
+
+// CPU renderer for what the demos draw: Gouraud-colored triangles with an
+// optional depth test, clipped to a viewport and scissor rectangle like GL.
+//
+// Draw calls transform, clip and set up their triangles right away and bin
+// them into 64x64 pixel tiles; flush() then rasterizes the tiles in parallel,
+// each one running its commands in submission order. Inside a tile, edge
+// functions, depth and colors are evaluated four pixels at a time with SSE2
+// (scalar code elsewhere). Colors interpolate linearly in screen space,
+// without perspective correction, which the demos' small shapes do not need.
+//
+// The image is RGBA8 with the bottom row first, the layout glReadPixels
+// returns, so it can go straight to a texture or to FrameCapture.
+class SoftRasterizer {
+public:
+    static const int TILE_SIZE = 64;
+
+    SoftRasterizer();
+
+    void resize(int width, int height);
+    int width() const { return fbWidth; }
+    int height() const { return fbHeight; }
+    // Pixels per row of pixels(); at least width()
+    int rowPitch() const { return pitch; }
+    const uint32_t* pixels() const { return color.data(); }
+    // Copies the image tightly packed, width() * 4 bytes per row
+    void readPixels(uint8_t* rgba) const;
+
+    // GL-like state; applies to the commands submitted after it
+    void setViewport(int x, int y, int width, int height);
+    void setScissor(int x, int y, int width, int height);
+    void disableScissor();
+    void setDepthTest(bool enabled) { depthTest = enabled; }
+    void setClearColor(float r, float g, float b, float a);
+    // Row-major matrix from vertex positions to clip space (see matrix.h)
+    void setTransform(const float* matrix);
+
+    // Clears the scissor rectangle (the whole image without one); depth clears to 1
+    void clear(bool clearColor, bool clearDepth);
+    void drawTriangles(const float* vertices, const SoftVertexFormat& format, size_t vertexCount);
+    void drawIndexedTriangles(const float* vertices, const SoftVertexFormat& format, const unsigned* indices,
+                              size_t indexCount);
+    // Convex polygons (GL_POLYGON, GL_TRIANGLE_FAN, GL_QUADS with 4 vertices)
+    void drawTriangleFan(const float* vertices, const SoftVertexFormat& format, size_t vertexCount);
+
+    // Runs everything submitted since the last flush; in parallel with jobs
+    void flush(JobSystem* jobs = nullptr);
+
+private:
+    struct Rect {
+        int minX, minY, maxX, maxY; // inclusive; empty when min > max
+    };
+    struct ClipVertex {
+        float x, y, z, w;
+        float r, g, b;
+    };
+    // A triangle ready to rasterize. Edge i is A x + B y + C, positive inside;
+    // attributes are planes a x + b y + c over pixel centers.
+    struct Triangle {
+        float edgeA[3], edgeB[3], edgeC[3];
+        bool edgeOwned[3]; // pixels exactly on the edge belong to this triangle
+        float depth[3], red[3], green[3], blue[3];
+        Rect bounds;
+        bool depthTest;
+    };
+    struct Clear {
+        Rect bounds;
+        uint32_t color;
+        bool clearColor, clearDepth;
+    };
+
+    int fbWidth, fbHeight, pitch;
+    std::vector<uint32_t> color;
+    std::vector<float> depthBuffer;
+
+    int viewport[4];
+    Rect scissor;
+    bool scissorEnabled;
+    bool depthTest;
+    uint32_t clearValue;
+    float transform[16];
+
+    int tilesX, tilesY;
+    std::vector<Triangle> triangles;
+    std::vector<Clear> clears;
+    // Per tile, the commands touching it: triangle index * 2, or clear index * 2 + 1
+    std::vector<std::vector<uint32_t>> bins;
+    std::vector<ClipVertex> polygon, clipScratch;
+
+    Rect clipRect() const;
+    void loadVertex(const float* vertex, const SoftVertexFormat& format, ClipVertex& out) const;
+    void clipAndSubmit(const ClipVertex* v, const Rect& clip);
+    void setupTriangle(const ClipVertex* v, const Rect& clip);
+    void binCommand(const Rect& bounds, uint32_t command, const Triangle* triangle);
+    void rasterizeTile(int tile);
+    void runClear(const Clear& c, const Rect& area);
+    void runTriangle(const Triangle& t, const Rect& area);
+};
+
+#endif